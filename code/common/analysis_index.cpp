@@ -0,0 +1,454 @@
+#include "analysis_index.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+
+#if _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "doctest.hpp"
+
+#include "audio_data.h"
+#include "common.h"
+
+// The file is a header, then the entries sorted by content hash so that they can be binary-searched, then
+// the statistics of the channels of all of the entries. Everything is fixed-size and 8-byte aligned so that
+// it can be used straight from the mapped file. The numbers are in the byte order of the machine; the index
+// is a cache in the temporary folder, it is not meant to be moved to other machines.
+struct IndexHeader {
+    char magic[8];
+    u32 version;
+    u32 run; // the number of times that the index has been saved
+    u64 num_entries;
+    u64 num_channel_statistics;
+};
+
+enum IndexEntryFlags : u32 {
+    IndexEntryHasDetectedPitch = 1 << 0,
+    IndexEntryPitchWasFound = 1 << 1,
+    IndexEntryHasChannelStatistics = 1 << 2,
+    IndexEntryHasSilenceBounds = 1 << 3,
+};
+
+struct IndexEntry {
+    u64 content_hash;
+    u32 flags;
+    u32 last_used_run;
+    double detected_pitch;
+    double silence_threshold_amp;
+    u64 first_loud_frame;
+    u64 end_loud_frame;
+    u64 first_channel_statistics;
+    u32 num_channels;
+    u32 unused;
+};
+
+struct IndexChannelStatistics {
+    double peak;
+    double sum_of_squares;
+    double sum;
+    u64 num_samples;
+};
+
+static_assert(sizeof(IndexHeader) == 32);
+static_assert(sizeof(IndexEntry) == 64);
+static_assert(sizeof(IndexChannelStatistics) == 32);
+
+static constexpr char k_index_magic[8] = {'S', 'G', 'N', 'T', 'A', 'N', 'L', 'X'};
+
+// Increase this whenever what is stored changes, or the way that any of the analyses are worked out changes.
+// An index from another version is ignored and replaced.
+static constexpr u32 k_index_version = 1;
+
+// Analyses that have not been looked up in this many saves of the index are removed from it.
+static constexpr u32 k_max_runs_unused = 64;
+
+static std::atomic<AnalysisIndex *> g_analysis_index {nullptr};
+
+void SetAnalysisIndex(AnalysisIndex *index) { g_analysis_index = index; }
+AnalysisIndex *GetAnalysisIndex() { return g_analysis_index; }
+
+u64 HashAudioContent(const AudioData &audio) {
+    return HashSamples(audio.interleaved_samples, ((u64)audio.num_channels << 32) | audio.sample_rate);
+}
+
+SilenceBounds FindSilenceBounds(const AudioData &audio, double threshold_amp) {
+    const auto num_frames = audio.IsEmpty() ? 0 : audio.NumFrames();
+    const auto FrameIsLoud = [&](usize frame) {
+        for (unsigned channel = 0; channel < audio.num_channels; ++channel) {
+            if (std::abs(audio.GetSample(channel, frame)) > threshold_amp) return true;
+        }
+        return false;
+    };
+
+    SilenceBounds result {threshold_amp, num_frames, 0};
+    for (usize frame = 0; frame < num_frames; ++frame) {
+        if (FrameIsLoud(frame)) {
+            result.first_loud_frame = frame;
+            break;
+        }
+    }
+    for (usize frame = num_frames; frame-- > result.first_loud_frame;) {
+        if (FrameIsLoud(frame)) {
+            result.end_loud_frame = frame + 1;
+            break;
+        }
+    }
+    return result;
+}
+
+// Returns null if the file is not mapped or it is not a valid index.
+static const IndexHeader *GetHeader(const MappedFile &file) {
+    if (!file.IsMapped() || file.Size() < sizeof(IndexHeader)) return nullptr;
+    const auto *header = reinterpret_cast<const IndexHeader *>(file.Data());
+    if (std::memcmp(header->magic, k_index_magic, sizeof(k_index_magic)) != 0) return nullptr;
+    if (header->version != k_index_version) return nullptr;
+    if (file.Size() != sizeof(IndexHeader) + header->num_entries * sizeof(IndexEntry) +
+                           header->num_channel_statistics * sizeof(IndexChannelStatistics)) {
+        return nullptr;
+    }
+    return header;
+}
+
+static tcb::span<const IndexEntry> GetEntries(const MappedFile &file) {
+    const auto *header = GetHeader(file);
+    if (!header) return {};
+    return {reinterpret_cast<const IndexEntry *>(file.Data() + sizeof(IndexHeader)),
+            (usize)header->num_entries};
+}
+
+static tcb::span<const IndexChannelStatistics> GetChannelStatistics(const MappedFile &file) {
+    const auto *header = GetHeader(file);
+    if (!header) return {};
+    return {reinterpret_cast<const IndexChannelStatistics *>(file.Data() + sizeof(IndexHeader) +
+                                                             header->num_entries * sizeof(IndexEntry)),
+            (usize)header->num_channel_statistics};
+}
+
+static AudioAnalysis AnalysisFromEntry(const IndexEntry &entry,
+                                       tcb::span<const IndexChannelStatistics> channel_statistics) {
+    AudioAnalysis result {};
+    if (entry.flags & IndexEntryHasDetectedPitch) {
+        result.detected_pitch = (entry.flags & IndexEntryPitchWasFound)
+                                    ? std::optional<double> {entry.detected_pitch}
+                                    : std::optional<double> {};
+    }
+    if ((entry.flags & IndexEntryHasChannelStatistics) &&
+        entry.first_channel_statistics + entry.num_channels <= channel_statistics.size()) {
+        for (const auto &s : channel_statistics.subspan(entry.first_channel_statistics, entry.num_channels)) {
+            result.channel_statistics.push_back({s.peak, s.sum_of_squares, s.sum, (usize)s.num_samples});
+        }
+    }
+    if (entry.flags & IndexEntryHasSilenceBounds) {
+        result.silence_bounds = SilenceBounds {entry.silence_threshold_amp, (usize)entry.first_loud_frame,
+                                               (usize)entry.end_loud_frame};
+    }
+    return result;
+}
+
+static void AddEntry(u64 content_hash,
+                     const AudioAnalysis &analysis,
+                     u32 last_used_run,
+                     std::vector<IndexEntry> &entries,
+                     std::vector<IndexChannelStatistics> &channel_statistics) {
+    IndexEntry entry {};
+    entry.content_hash = content_hash;
+    entry.last_used_run = last_used_run;
+    if (analysis.detected_pitch) {
+        entry.flags |= IndexEntryHasDetectedPitch;
+        if (*analysis.detected_pitch) {
+            entry.flags |= IndexEntryPitchWasFound;
+            entry.detected_pitch = **analysis.detected_pitch;
+        }
+    }
+    if (analysis.channel_statistics.size()) {
+        entry.flags |= IndexEntryHasChannelStatistics;
+        entry.first_channel_statistics = channel_statistics.size();
+        entry.num_channels = (u32)analysis.channel_statistics.size();
+        for (const auto &s : analysis.channel_statistics) {
+            channel_statistics.push_back({s.peak, s.sum_of_squares, s.sum, (u64)s.num_samples});
+        }
+    }
+    if (analysis.silence_bounds) {
+        entry.flags |= IndexEntryHasSilenceBounds;
+        entry.silence_threshold_amp = analysis.silence_bounds->threshold_amp;
+        entry.first_loud_frame = analysis.silence_bounds->first_loud_frame;
+        entry.end_loud_frame = analysis.silence_bounds->end_loud_frame;
+    }
+    entries.push_back(entry);
+}
+
+void AnalysisIndex::MapFileIfNeeded() {
+    if (m_tried_mapping_file) return;
+    m_tried_mapping_file = true;
+    if (!fs::exists(m_path)) return;
+
+    std::error_code ec;
+    if (!m_file.Map(m_path, ec)) {
+        MessageWithNewLine("Signet", {}, "Could not read the analysis index {}: {}", m_path, ec.message());
+        return;
+    }
+    if (!GetHeader(m_file)) {
+        // An index from another version of Signet is replaced without mentioning it.
+        const auto *header = reinterpret_cast<const IndexHeader *>(m_file.Data());
+        const bool from_other_version =
+            m_file.Size() >= sizeof(IndexHeader) &&
+            std::memcmp(header->magic, k_index_magic, sizeof(k_index_magic)) == 0 &&
+            header->version != k_index_version;
+        if (!from_other_version) {
+            MessageWithNewLine("Signet", {}, "The analysis index {} is not valid, it will be rebuilt",
+                               m_path);
+        }
+    }
+}
+
+void AnalysisIndex::Rebuild() {
+    std::scoped_lock lock {m_mutex};
+    m_file.Unmap();
+    m_tried_mapping_file = true;
+}
+
+AudioAnalysis AnalysisIndex::Find(u64 content_hash) {
+    std::scoped_lock lock {m_mutex};
+    if (const auto it = m_updated.find(content_hash); it != m_updated.end()) return it->second;
+
+    MapFileIfNeeded();
+    const auto entries = GetEntries(m_file);
+    const auto it = std::lower_bound(entries.begin(), entries.end(), content_hash,
+                                     [](const IndexEntry &e, u64 hash) { return e.content_hash < hash; });
+    if (it == entries.end() || it->content_hash != content_hash) return {};
+    m_used.insert(content_hash);
+    return AnalysisFromEntry(*it, GetChannelStatistics(m_file));
+}
+
+void AnalysisIndex::Update(u64 content_hash, const AudioAnalysis &analysis) {
+    std::scoped_lock lock {m_mutex};
+    m_updated[content_hash] = analysis;
+}
+
+bool AnalysisIndex::Save() {
+    std::scoped_lock lock {m_mutex};
+    if (m_updated.empty() && m_used.empty()) return true;
+
+    MapFileIfNeeded();
+    const auto *old_header = GetHeader(m_file);
+    const auto old_entries = GetEntries(m_file);
+    const auto old_channel_statistics = GetChannelStatistics(m_file);
+    const u32 run = (old_header ? old_header->run : 0) + 1;
+
+    // Both the old entries and the updated ones are sorted, so they can be merged.
+    std::vector<IndexEntry> entries;
+    std::vector<IndexChannelStatistics> channel_statistics;
+    auto updated = m_updated.begin();
+    usize old_index = 0;
+    while (old_index != old_entries.size() || updated != m_updated.end()) {
+        if (updated != m_updated.end() &&
+            (old_index == old_entries.size() || updated->first <= old_entries[old_index].content_hash)) {
+            if (old_index != old_entries.size() && old_entries[old_index].content_hash == updated->first) {
+                ++old_index;
+            }
+            AddEntry(updated->first, updated->second, run, entries, channel_statistics);
+            ++updated;
+        } else {
+            auto entry = old_entries[old_index++];
+            if (m_used.count(entry.content_hash)) entry.last_used_run = run;
+            if (run - entry.last_used_run >= k_max_runs_unused) continue;
+            if (entry.flags & IndexEntryHasChannelStatistics) {
+                // An entry whose statistics are not in the file is damaged, so it is not kept.
+                if (entry.first_channel_statistics + entry.num_channels > old_channel_statistics.size()) {
+                    continue;
+                }
+                const auto first = channel_statistics.size();
+                const auto statistics =
+                    old_channel_statistics.subspan(entry.first_channel_statistics, entry.num_channels);
+                channel_statistics.insert(channel_statistics.end(), statistics.begin(), statistics.end());
+                entry.first_channel_statistics = first;
+            }
+            entries.push_back(entry);
+        }
+    }
+
+    IndexHeader header {};
+    std::memcpy(header.magic, k_index_magic, sizeof(k_index_magic));
+    header.version = k_index_version;
+    header.run = run;
+    header.num_entries = entries.size();
+    header.num_channel_statistics = channel_statistics.size();
+
+    // The new index is written next to the old one and then moved over it, so that an index that was only
+    // partly written is never read. The temporary file is named after the process so that instances of
+    // Signet that are saving at the same time do not write into the same file.
+#if _WIN32
+    const auto process_id = _getpid();
+#else
+    const auto process_id = getpid();
+#endif
+    const auto temp_path = fs::path(fmt::format("{}.{}.tmp", m_path.generic_string(), process_id));
+    std::error_code ec;
+    {
+        std::ofstream out(temp_path.generic_string(), std::ofstream::out | std::ofstream::binary);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(IndexEntry));
+        out.write(reinterpret_cast<const char *>(channel_statistics.data()),
+                  channel_statistics.size() * sizeof(IndexChannelStatistics));
+        if (!out) {
+            MessageWithNewLine("Signet", {}, "Could not write the analysis index {}", temp_path);
+            out.close();
+            fs::remove(temp_path, ec);
+            return false;
+        }
+    }
+
+    m_file.Unmap();
+    m_tried_mapping_file = false;
+    m_updated.clear();
+    m_used.clear();
+    fs::rename(temp_path, m_path, ec);
+    if (ec) {
+        MessageWithNewLine("Signet", {}, "Could not write the analysis index {}: {}", m_path, ec.message());
+        fs::remove(temp_path, ec);
+        return false;
+    }
+    return true;
+}
+
+void AnalysisIndex::Delete() {
+    std::scoped_lock lock {m_mutex};
+    m_file.Unmap();
+    m_tried_mapping_file = true;
+    m_updated.clear();
+    m_used.clear();
+    std::error_code ec;
+    fs::remove(m_path, ec);
+}
+
+TEST_CASE("AnalysisIndex") {
+    const fs::path path = "analysis-index-test";
+    std::error_code ec;
+    fs::remove(path, ec);
+
+    AudioAnalysis analysis {};
+    analysis.detected_pitch = 440.0;
+    analysis.channel_statistics = {{0.5, 20, 0.25, 100}, {0.75, 30, -0.5, 100}};
+    analysis.silence_bounds = SilenceBounds {0.001, 10, 90};
+    AudioAnalysis no_pitch {};
+    no_pitch.detected_pitch = std::optional<double> {};
+
+    {
+        AnalysisIndex index {path};
+        CHECK(!index.Find(1).detected_pitch);
+        index.Update(1, analysis);
+        index.Update(2, no_pitch);
+        REQUIRE(index.Save());
+    }
+    {
+        AnalysisIndex index {path};
+        const auto found = index.Find(1);
+        REQUIRE(found.detected_pitch);
+        CHECK(*found.detected_pitch == 440.0);
+        REQUIRE(found.channel_statistics.size() == 2);
+        CHECK(found.channel_statistics[1].peak == 0.75);
+        CHECK(found.channel_statistics[1].sum == -0.5);
+        CHECK(found.channel_statistics[1].num_samples == 100);
+        REQUIRE(found.silence_bounds);
+        CHECK(found.silence_bounds->threshold_amp == 0.001);
+        CHECK(found.silence_bounds->end_loud_frame == 90);
+
+        const auto found_no_pitch = index.Find(2);
+        REQUIRE(found_no_pitch.detected_pitch);
+        CHECK(!*found_no_pitch.detected_pitch);
+        CHECK(found_no_pitch.channel_statistics.empty());
+        CHECK(!found_no_pitch.silence_bounds);
+
+        index.Update(3, analysis);
+        REQUIRE(index.Save());
+    }
+
+    SUBCASE("analyses that are not used are removed") {
+        for (u32 run = 0; run < k_max_runs_unused; ++run) {
+            AnalysisIndex index {path};
+            CHECK(index.Find(3).detected_pitch);
+            REQUIRE(index.Save());
+        }
+        AnalysisIndex index {path};
+        CHECK(index.Find(3).detected_pitch);
+        CHECK(!index.Find(1).detected_pitch);
+        CHECK(!index.Find(2).detected_pitch);
+    }
+
+    SUBCASE("rebuilding") {
+        {
+            AnalysisIndex index {path};
+            index.Rebuild();
+            CHECK(!index.Find(1).detected_pitch);
+            index.Update(4, analysis);
+            REQUIRE(index.Save());
+        }
+        AnalysisIndex index {path};
+        CHECK(!index.Find(1).detected_pitch);
+        CHECK(index.Find(4).detected_pitch);
+    }
+
+    SUBCASE("an entry with statistics that are not in the file is removed") {
+        {
+            // Entry 1 is the first entry in the file.
+            std::fstream file(path.generic_string(),
+                              std::fstream::in | std::fstream::out | std::fstream::binary);
+            const u64 first_channel_statistics = 1000;
+            file.seekp(sizeof(IndexHeader) + offsetof(IndexEntry, first_channel_statistics));
+            file.write(reinterpret_cast<const char *>(&first_channel_statistics),
+                       sizeof(first_channel_statistics));
+            REQUIRE(file);
+        }
+        {
+            AnalysisIndex index {path};
+            CHECK(index.Find(1).channel_statistics.empty());
+            index.Update(4, analysis);
+            REQUIRE(index.Save());
+        }
+        AnalysisIndex index {path};
+        CHECK(!index.Find(1).detected_pitch);
+        CHECK(index.Find(3).channel_statistics.size() == 2);
+        CHECK(index.Find(4).channel_statistics.size() == 2);
+    }
+
+    SUBCASE("an invalid file is ignored") {
+        {
+            std::ofstream out(path.generic_string(), std::ofstream::out | std::ofstream::binary);
+            out << "not an index";
+        }
+        AnalysisIndex index {path};
+        CHECK(!index.Find(1).detected_pitch);
+    }
+
+    fs::remove(path, ec);
+}
+
+TEST_CASE("Analysing audio") {
+    AudioData audio {};
+    audio.num_channels = 2;
+    audio.sample_rate = 44100;
+    audio.interleaved_samples = {0, 0, 0, 0.1, 0.5, 0, 0, 0, 0, 0};
+
+    const auto bounds = FindSilenceBounds(audio, 0.01);
+    CHECK(bounds.first_loud_frame == 1);
+    CHECK(bounds.end_loud_frame == 3);
+    const auto silent_bounds = FindSilenceBounds(audio, 0.9);
+    CHECK(silent_bounds.first_loud_frame == 5);
+    CHECK(silent_bounds.end_loud_frame == 0);
+
+    const auto hash = HashAudioContent(audio);
+    auto other = audio;
+    CHECK(HashAudioContent(other) == hash);
+    other.sample_rate = 48000;
+    CHECK(HashAudioContent(other) != hash);
+    other = audio;
+    other.num_channels = 1;
+    CHECK(HashAudioContent(other) != hash);
+}
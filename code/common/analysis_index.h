@@ -0,0 +1,71 @@
+#pragma once
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <vector>
+
+#include "filesystem.hpp"
+
+#include "mapped_file.h"
+#include "sample_kernels.h"
+#include "types.h"
+
+struct AudioData;
+
+// Where the audio is louder than a threshold.
+struct SilenceBounds {
+    double threshold_amp {};
+    usize first_loud_frame {}; // the number of frames if none of them are loud
+    usize end_loud_frame {}; // one past the last loud frame, or 0 if none of them are loud
+};
+
+// Analyses of some audio. Each is only worked out when it is needed, so any of them can be missing.
+struct AudioAnalysis {
+    std::optional<std::optional<double>> detected_pitch {}; // the inner one is empty if there is no pitch
+    std::vector<SampleStatistics> channel_statistics {}; // empty if they have not been worked out
+    std::optional<SilenceBounds> silence_bounds {}; // for the threshold that was last asked for
+};
+
+// Identifies audio by its content: a hash of its samples, number of channels and sample rate.
+u64 HashAudioContent(const AudioData &audio);
+
+SilenceBounds FindSilenceBounds(const AudioData &audio, double threshold_amp);
+
+// The analyses of audio from previous runs of Signet, kept in a file so that audio that has not changed since
+// does not have to be analysed again. The file is only read when the first analysis is looked up, and then
+// it is mapped into memory rather than loaded. The analyses are looked up by HashAudioContent. It can be used
+// from multiple threads.
+class AnalysisIndex {
+  public:
+    AnalysisIndex(const fs::path &path) : m_path(path) {}
+
+    // Ignores the analyses that are in the file; the file is replaced by the ones from this run when it is
+    // saved.
+    void Rebuild();
+
+    AudioAnalysis Find(u64 content_hash);
+    void Update(u64 content_hash, const AudioAnalysis &analysis);
+
+    // Writes the file, if there is anything new to write. Analyses that have not been used for many runs are
+    // removed so that the file does not keep growing.
+    bool Save();
+
+    void Delete();
+
+    const fs::path &GetPath() const { return m_path; }
+
+  private:
+    void MapFileIfNeeded();
+
+    std::mutex m_mutex {};
+    fs::path m_path;
+    MappedFile m_file {};
+    bool m_tried_mapping_file {};
+    std::map<u64, AudioAnalysis> m_updated {};
+    std::set<u64> m_used {};
+};
+
+// The index that analyses are looked up in and added to; null, the default, for none.
+void SetAnalysisIndex(AnalysisIndex *index);
+AnalysisIndex *GetAnalysisIndex();
@@ -1,10 +1,17 @@
 #include "audio_data.h"
 
-#include "dywapitchtrack/dywapitchtrack.h"
+#include <chrono>
+
+#include "doctest.hpp"
 #include "r8brain-resampler/CDSPResampler.h"
 
 #include "common.h"
-#include "gain_calculators.h"
+#include "pitch_detector.h"
+#include "planar_samples.h"
+#include "resampling.h"
+#include "sample_kernels.h"
+#include "test_helpers.h"
+#include "thread_pool.h"
 
 size_t AudioData::NumFrames() const {
     assert(num_channels != 0);
@@ -21,153 +28,98 @@ const double &AudioData::GetSample(unsigned channel, size_t frame) const {
 
 //
 
-void AudioData::ChangePitch(double cents) {
+static double PitchChangeToSampleRateMultiplier(double cents) {
     constexpr auto cents_in_octave = 100.0 * 12.0;
-    const auto multiplier = std::pow(2, -cents / cents_in_octave);
-    const auto new_sample_rate = (double)sample_rate * multiplier;
+    return std::pow(2, -cents / cents_in_octave);
+}
+
+void AudioData::ChangePitch(double cents) {
+    const auto new_sample_rate = (double)sample_rate * PitchChangeToSampleRateMultiplier(cents);
     const auto original_sample_rate = sample_rate;
     Resample(new_sample_rate);
     sample_rate = original_sample_rate; // we don't want to change the sample rate
 }
 
+AudioData AudioData::WithPitchChanged(double cents) const {
+    auto result = CopyWithoutSamples();
+    const auto new_sample_rate = (double)sample_rate * PitchChangeToSampleRateMultiplier(cents);
+    if (new_sample_rate == sample_rate) {
+        result.interleaved_samples = interleaved_samples;
+        return result;
+    }
+    ResampleInterleaved(interleaved_samples, num_channels, sample_rate, new_sample_rate,
+                        result.interleaved_samples);
+    result.AudioDataWasStretched(new_sample_rate / (double)sample_rate);
+    return result;
+}
+
 void AudioData::Resample(double new_sample_rate) {
     if (sample_rate == new_sample_rate) return;
 
-    const auto result_num_frames = (usize)(NumFrames() * (new_sample_rate / (double)sample_rate));
-    std::vector<double> result_interleaved_samples(num_channels * result_num_frames);
-
-    r8b::CDSPResampler24 resampler(sample_rate, new_sample_rate, (int)NumFrames());
-
-    ForEachDeinterleavedChannel(
-        interleaved_samples, num_channels, [&](const auto &channel_buffer, auto channel) {
-            std::vector<double> output_buffer(result_num_frames);
-            resampler.oneshot(channel_buffer.data(), (int)channel_buffer.size(), output_buffer.data(),
-                              (int)result_num_frames);
-            for (size_t frame = 0; frame < result_num_frames; ++frame) {
-                result_interleaved_samples[frame * num_channels + channel] = output_buffer[frame];
-            }
-
-            resampler.clear();
-        });
-
-    interleaved_samples = std::move(result_interleaved_samples);
+    ResampleInterleaved(interleaved_samples, num_channels, sample_rate, new_sample_rate, interleaved_samples);
 
     const auto stretch_factor = new_sample_rate / (double)sample_rate;
     AudioDataWasStretched(stretch_factor);
     sample_rate = (unsigned int)new_sample_rate;
 }
 
-void AudioData::MultiplyByScalar(const double amount) {
-    for (auto &s : interleaved_samples) {
-        s *= amount;
-    }
+AudioData AudioData::CopyWithoutSamples() const {
+    AudioData result;
+    result.num_channels = num_channels;
+    result.sample_rate = sample_rate;
+    result.bits_per_sample = bits_per_sample;
+    result.format = format;
+    result.flac_encoding_settings = flac_encoding_settings;
+    result.dither = dither;
+    result.metadata = metadata;
+    result.wave_metadata = wave_metadata;
+    result.flac_metadata = flac_metadata;
+    return result;
 }
 
+void AudioData::MultiplyByScalar(const double amount) { MultiplySamples(interleaved_samples, amount); }
+
 void AudioData::MultiplyByScalar(unsigned channel, double amount) {
     for (size_t frame = 0; frame < NumFrames(); ++frame) {
         GetSample(channel, frame) *= amount;
     }
 }
 
+void AudioData::MultiplyByScalars(const std::vector<double> &channel_amounts) {
+    assert(channel_amounts.size() == num_channels);
+    for (usize i = 0; i < interleaved_samples.size(); i += num_channels) {
+        for (unsigned chan = 0; chan < num_channels; ++chan) {
+            interleaved_samples[i + chan] *= channel_amounts[chan];
+        }
+    }
+}
+
 void AudioData::AddOther(const AudioData &other) {
     if (other.interleaved_samples.size() > interleaved_samples.size()) {
         interleaved_samples.resize(other.interleaved_samples.size());
     }
-    for (usize i = 0; i < other.interleaved_samples.size(); ++i) {
-        interleaved_samples[i] += other.interleaved_samples[i];
-    }
+    AddSamples(interleaved_samples, other.interleaved_samples);
 }
 
 std::vector<double> AudioData::MixDownToMono() const {
-    std::vector<double> mono_signal;
-    mono_signal.reserve(NumFrames());
-    for (usize frame = 0; frame < NumFrames(); ++frame) {
-        double v = 0;
-        for (unsigned chan = 0; chan < num_channels; ++chan) {
-            v += GetSample(chan, frame);
-        }
-        mono_signal.push_back(v);
-    }
+    std::vector<double> mono_signal(NumFrames());
+    MixChannelsDown(interleaved_samples, num_channels, mono_signal);
     return mono_signal;
 }
 
-static std::optional<double> DetectSinglePitch(const AudioData &audio) {
-    auto mono_signal = audio.MixDownToMono();
-    NormaliseToTarget(mono_signal, 1);
-
-    struct ChunkData {
-        double detected_pitch {};
-        double rms {};
-        double suitability {};
-    };
-    constexpr auto chunk_seconds = 0.1;
-
-    std::vector<ChunkData> chunks;
-    const auto chunk_frames = (usize)(chunk_seconds * audio.sample_rate);
-    for (usize frame = 0; frame < audio.NumFrames(); frame += chunk_frames) {
-        const auto chunk_size = (int)std::min(chunk_frames, audio.NumFrames() - frame);
-
-        dywapitchtracker pitch_tracker;
-        dywapitch_inittracking(&pitch_tracker);
-        auto detected_pitch = dywapitch_computepitch(&pitch_tracker, const_cast<double *>(mono_signal.data()),
-                                                     (int)frame, chunk_size);
-        if (audio.sample_rate != 44100) {
-            detected_pitch *= static_cast<double>(audio.sample_rate) / 44100.0;
-        }
-        chunks.push_back({detected_pitch, GetRMS({mono_signal.data() + frame, (usize)chunk_size}), 0});
-    }
-
-    for (auto &chunk : chunks) {
-        const auto p1 = chunk.detected_pitch;
-
-        for (const auto &other_c : chunks) {
-            const auto p2 = other_c.detected_pitch;
-            if (p2 == 0) continue;
-
-            const auto GaussianFunction = [](const auto x) {
-                constexpr auto height = 10;
-                constexpr auto peak_centre = 0;
-                constexpr auto width = 0.9;
-                return height * std::exp(-(std::pow(x - peak_centre, 2) / (2 * std::pow(width, 2))));
-            };
-
-            const auto pitch_delta = p2 - p1;
-            chunk.suitability += GaussianFunction(pitch_delta);
-        }
-    }
-
-    // Make chunks that contain louder audio a little bit more important
-    {
-        double max_rms = 0;
-        double min_rms = DBL_MAX;
-        for (auto &chunk : chunks) {
-            REQUIRE(chunk.rms >= 0);
-            if (chunk.rms < min_rms) min_rms = chunk.rms;
-            if (chunk.rms > max_rms) max_rms = chunk.rms;
-        }
-
-        for (auto &chunk : chunks) {
-            if ((max_rms - min_rms) == 0) continue;
-            const auto rms_relative = (chunk.rms - min_rms) / (max_rms - min_rms);
-            REQUIRE(rms_relative >= 0);
-            REQUIRE(rms_relative <= 1);
-            constexpr auto multiplier_for_loudest_chunk = 1.5;
-            chunk.suitability *=
-                1 + (std::cos(half_pi - (rms_relative * half_pi)) * multiplier_for_loudest_chunk);
-        }
+void AudioData::ProcessChannels(
+    const std::function<void(tcb::span<double> samples, unsigned channel)> &process) {
+    if (num_channels == 1) {
+        process(interleaved_samples, 0);
+        return;
     }
 
-    const ChunkData *most_suitable_chunk = &chunks[0];
-    for (const auto &c : chunks) {
-        if (c.suitability > most_suitable_chunk->suitability) {
-            most_suitable_chunk = &c;
-        }
-    }
-
-    if (most_suitable_chunk->detected_pitch != 0.0) {
-        return most_suitable_chunk->detected_pitch;
-    }
-    return std::nullopt;
+    thread_local PlanarSamples thread_planar;
+    // Inside the tasks, the name of the thread_local variable would refer to the worker threads' own copy.
+    auto &planar = thread_planar;
+    planar.Deinterleave(interleaved_samples, num_channels);
+    ParallelFor(num_channels, [&](usize chan) { process(planar.Channel((unsigned)chan), (unsigned)chan); });
+    planar.Interleave(interleaved_samples);
 }
 
 bool ApproxEqual(double a, double b, double epsilon) {
@@ -175,55 +127,10 @@ bool ApproxEqual(double a, double b, double epsilon) {
 }
 
 std::optional<double> AudioData::DetectPitch() const {
-    // The pitch detection algorithm that we are using can get it wrong sometimes when the audio is very
-    // high pitch or very low pitch. To help with this, we detect the pitch at different octaves and then
-    // work out which one is giving us the best results.
-
-    struct PitchedData {
-        std::optional<double> detected_pitch {};
-        double cents {};
-        double suitability {};
-    };
-
-    std::vector<PitchedData> pitches;
-    for (double cents = -2400; cents < 2400; cents += 1200) {
-        AudioData pitched_audio = *this;
-        pitched_audio.ChangePitch(cents);
-        pitches.push_back({DetectSinglePitch(pitched_audio), cents});
-    }
-
-    for (auto &p : pitches) {
-        if (!p.detected_pitch) continue;
-        for (const auto &p2 : pitches) {
-            if (!p2.detected_pitch) continue;
-            const auto delta_cents = p2.cents - p.cents;
-            const auto expected_hz = GetFreqWithCentDifference(*p.detected_pitch, delta_cents);
-            if (ApproxEqual(expected_hz, *p2.detected_pitch, 3)) {
-                p.suitability += 1;
-            }
-        }
-    }
-
-    const PitchedData *most_suitable = &pitches[0];
-    for (const auto &p : pitches) {
-        if (p.suitability > most_suitable->suitability) {
-            most_suitable = &p;
-        }
-    }
-
-    if (!most_suitable->detected_pitch) {
-        return {};
-    }
-
-    return GetFreqWithCentDifference(*most_suitable->detected_pitch, -most_suitable->cents);
+    return DetectPitchOfMonoSignal(MixDownToMono(), sample_rate);
 }
 
-bool AudioData::IsSilent() const {
-    for (const auto v : interleaved_samples) {
-        if (v != 0.0) return false;
-    }
-    return true;
-}
+bool AudioData::IsSilent() const { return AllSamplesAreZero(interleaved_samples); }
 
 //
 
@@ -239,16 +146,19 @@ void AudioData::FramesWereRemovedFromStart(size_t num_frames) {
     }
 }
 
-void AudioData::FramesWereRemovedFromEnd() {
-    if (metadata.HandleEndFramesRemovedForType<MetadataItems::Region>(metadata.regions, NumFrames())) {
+void AudioData::FramesWereRemovedFromEnd() { FramesWereRemovedFromEnd(NumFrames()); }
+
+void AudioData::FramesWereRemovedFromEnd(size_t num_frames_remaining) {
+    if (metadata.HandleEndFramesRemovedForType<MetadataItems::Region>(metadata.regions,
+                                                                      num_frames_remaining)) {
         PrintMetadataRemovalWarning("regions");
     }
-    if (metadata.HandleEndFramesRemovedForType<MetadataItems::Loop>(metadata.loops, NumFrames())) {
+    if (metadata.HandleEndFramesRemovedForType<MetadataItems::Loop>(metadata.loops, num_frames_remaining)) {
         PrintMetadataRemovalWarning("loops");
     }
     bool markers_removed = false;
     for (auto it = metadata.markers.begin(); it != metadata.markers.end();) {
-        if (it->start_frame >= NumFrames()) {
+        if (it->start_frame >= num_frames_remaining) {
             it = metadata.markers.erase(it);
             markers_removed = true;
         } else {
@@ -283,4 +193,88 @@ void AudioData::PrintMetadataRemovalWarning(std::string_view metadata_name) {
     WarningWithNewLine("Signet", {},
                        "One or more metadata {} were removed from the file because the file changed size",
                        metadata_name);
-}
\ No newline at end of file
+}
+
+TEST_CASE("Changing the pitch without copying the samples") {
+    auto sine = TestHelpers::CreateSineWaveAtFrequency(2, 44100, 0.5, 440);
+    sine.metadata.markers.push_back({"marker", 1000});
+    const auto original = sine;
+
+    for (const auto cents : {-1200.0, 0.0, 700.0}) {
+        const auto result = sine.WithPitchChanged(cents);
+        auto expected = sine;
+        expected.ChangePitch(cents);
+
+        CHECK(sine.interleaved_samples == original.interleaved_samples);
+        CHECK(result.interleaved_samples == expected.interleaved_samples);
+        CHECK(result.sample_rate == expected.sample_rate);
+        CHECK(result.metadata.markers.at(0).start_frame == expected.metadata.markers.at(0).start_frame);
+    }
+}
+
+TEST_CASE("Resampling") {
+    auto sine = TestHelpers::CreateSineWaveAtFrequency(2, 96000, 0.5, 440);
+    sine.interleaved_samples[1] = 0.25; // so that the channels are different
+
+    for (const auto new_sample_rate : {48000.0, 44100.0, 192000.0}) {
+        CAPTURE(new_sample_rate);
+        auto expected = sine;
+        const auto result_num_frames = (usize)(sine.NumFrames() * (new_sample_rate / sine.sample_rate));
+        for (unsigned chan = 0; chan < sine.num_channels; ++chan) {
+            std::vector<double> in_channel, out_channel(result_num_frames);
+            for (usize frame = 0; frame < sine.NumFrames(); ++frame) {
+                in_channel.push_back(sine.GetSample(chan, frame));
+            }
+            r8b::CDSPResampler24 resampler(sine.sample_rate, new_sample_rate, (int)in_channel.size());
+            resampler.oneshot(in_channel.data(), (int)in_channel.size(), out_channel.data(),
+                              (int)out_channel.size());
+            expected.interleaved_samples.resize(result_num_frames * sine.num_channels);
+            for (usize frame = 0; frame < result_num_frames; ++frame) {
+                expected.GetSample(chan, frame) = out_channel[frame];
+            }
+        }
+
+        // The cached resamplers give the same result as a new one that is given the whole file at once, each
+        // time they are used.
+        for (const unsigned num_jobs : {1u, 4u}) {
+            SetNumParallelJobs(num_jobs);
+            for (int repeat = 0; repeat < 2; ++repeat) {
+                auto result = sine;
+                result.Resample(new_sample_rate);
+                REQUIRE(result.interleaved_samples.size() == expected.interleaved_samples.size());
+                for (usize i = 0; i < result.interleaved_samples.size(); ++i) {
+                    REQUIRE(result.interleaved_samples[i] ==
+                            doctest::Approx(expected.interleaved_samples[i]).epsilon(1e-12));
+                }
+            }
+        }
+        SetNumParallelJobs(1);
+    }
+}
+
+// Run with: tests --test-case="Resampling benchmark" --no-skip
+TEST_CASE("Resampling benchmark" * doctest::skip()) {
+    // Lots of short files, like a sample library: half a second of stereo.
+    const auto sine = TestHelpers::CreateSineWaveAtFrequency(2, 96000, 0.5, 440);
+    constexpr int num_files = 1000;
+
+    const auto Benchmark = [&](std::string_view name, auto resample) {
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < num_files; ++i) {
+            auto audio = sine;
+            resample(audio);
+        }
+        const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        MessageWithNewLine("Benchmark", {}, "{}: {:.0f} files/s", name, num_files / seconds);
+    };
+
+    SetNumParallelJobs(1);
+    Benchmark("new resampler for each file", [](AudioData &audio) {
+        std::vector<double> channel(audio.NumFrames()), result(audio.NumFrames() / 2);
+        for (unsigned chan = 0; chan < audio.num_channels; ++chan) {
+            r8b::CDSPResampler24 resampler(96000, 48000, (int)channel.size());
+            resampler.oneshot(channel.data(), (int)channel.size(), result.data(), (int)result.size());
+        }
+    });
+    Benchmark("cached resamplers", [](AudioData &audio) { audio.Resample(48000); });
+}
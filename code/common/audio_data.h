@@ -6,7 +6,10 @@
 #include "FLAC/metadata.h"
 
 #include "common.h"
+#include "dither.h"
+#include "flac_encoder.h"
 #include "metadata.h"
+#include "span.hpp"
 #include "types.h"
 
 enum class AudioFileFormat {
@@ -22,6 +25,8 @@ struct AudioData {
     unsigned sample_rate {};
     unsigned bits_per_sample = 24;
     AudioFileFormat format {AudioFileFormat::Wav};
+    FlacEncodingSettings flac_encoding_settings {};
+    DitherType dither {DitherType::None}; // used when the file is written at an integer bit depth
 
     Metadata metadata {};
 
@@ -42,18 +47,30 @@ struct AudioData {
     //
     void MultiplyByScalar(const double amount);
     void MultiplyByScalar(unsigned channel, const double amount);
+    void MultiplyByScalars(const std::vector<double> &channel_amounts);
     void AddOther(const AudioData &other);
     void Resample(double new_sample_rate);
     void ChangePitch(double cents);
+    // The same as copying and then calling ChangePitch, but the samples of this object are never copied.
+    AudioData WithPitchChanged(double cents) const;
     std::optional<double> DetectPitch() const;
     bool IsSilent() const;
 
     std::vector<double> MixDownToMono() const;
 
+    // Everything apart from the samples, which are the bulk of the memory.
+    AudioData CopyWithoutSamples() const;
+
+    // Calls process once per channel with that channel's samples in contiguous memory. The channels are
+    // deinterleaved into a buffer that is reused between calls on the same thread, and the channels may be
+    // processed in parallel.
+    void ProcessChannels(const std::function<void(tcb::span<double> samples, unsigned channel)> &process);
+
     //
     //
     void FramesWereRemovedFromStart(size_t num_frames);
     void FramesWereRemovedFromEnd();
+    void FramesWereRemovedFromEnd(size_t num_frames_remaining);
     void AudioDataWasStretched(double stretch_factor);
 
   private:
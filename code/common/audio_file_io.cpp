@@ -1,5 +1,7 @@
 #include "audio_file_io.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <iostream>
 
@@ -16,6 +18,10 @@
 
 #include "common.h"
 #include "flac_decoder.h"
+#include "flac_encoder.h"
+#include "mapped_file.h"
+#include "pcm_conversion.h"
+#include "sample_kernels.h"
 #include "test_helpers.h"
 #include "tests_config.h"
 #include "types.h"
@@ -47,7 +53,7 @@ std::string GetLowercaseExtension(AudioFileFormat format) {
 bool IsPathReadableAudioFile(const fs::path &path) {
     if (StartsWith(path.filename().generic_string(), ".")) return false;
     const auto ext = path.extension();
-    return ext == ".wav" || ext == ".flac";
+    return ext == ".wav" || ext == ".w64" || ext == ".flac";
 }
 
 static size_t OnReadFile(void *file, void *buffer_out, size_t bytes_to_read) {
@@ -56,7 +62,7 @@ static size_t OnReadFile(void *file, void *buffer_out, size_t bytes_to_read) {
 
 static drwav_bool32 OnSeekFile(void *file, int offset, drwav_seek_origin origin) {
     constexpr int fseek_success = 0;
-    if (std::fseek((FILE *)file, offset, (origin == (int)drwav_seek_origin_current) ? SEEK_CUR : SEEK_SET) ==
+    if (SeekFile((FILE *)file, offset, (origin == (int)drwav_seek_origin_current) ? SEEK_CUR : SEEK_SET) ==
         fseek_success) {
         return 1;
     }
@@ -222,8 +228,14 @@ std::ostream &operator<<(std::ostream &os, const drwav_bext &b) {
 
 class WaveMetadataToNonSpecificMetadata {
   public:
-    WaveMetadataToNonSpecificMetadata(const WaveMetadata &wave_metadata, const AudioData &audio)
-        : m_wave_metadata(wave_metadata), m_audio(audio) {}
+    WaveMetadataToNonSpecificMetadata(const WaveMetadata &wave_metadata,
+                                      unsigned num_channels,
+                                      unsigned bits_per_sample,
+                                      u64 num_frames)
+        : m_wave_metadata(wave_metadata)
+        , m_num_channels(num_channels)
+        , m_bits_per_sample(bits_per_sample)
+        , m_num_frames(num_frames) {}
 
     Metadata Convert() const {
         Metadata result {};
@@ -309,15 +321,15 @@ class WaveMetadataToNonSpecificMetadata {
         }
 
         result.start_frame =
-            loop.firstSampleByteOffset / (m_audio.bits_per_sample / 8) / m_audio.num_channels;
+            loop.firstSampleByteOffset / (m_bits_per_sample / 8) / m_num_channels;
         const auto end_frame =
-            (loop.lastSampleByteOffset / (m_audio.bits_per_sample / 8) / m_audio.num_channels) + 1;
+            (loop.lastSampleByteOffset / (m_bits_per_sample / 8) / m_num_channels) + 1;
         result.num_frames = end_frame - result.start_frame;
         result.num_times_to_loop = loop.playCount;
 
         // TODO: handle these cases properly instead of asserting
-        assert(result.start_frame < m_audio.NumFrames());
-        assert(end_frame <= m_audio.NumFrames());
+        assert(result.start_frame < m_num_frames);
+        assert(end_frame <= m_num_frames);
 
         return result;
     }
@@ -334,7 +346,7 @@ class WaveMetadataToNonSpecificMetadata {
                     const auto &cue_point = m.data.cue.pCuePoints[i];
                     if (cue_point.id == region.cuePointId) {
                         result.start_frame =
-                            cue_point.sampleByteOffset / (m_audio.bits_per_sample / 8) / m_audio.num_channels;
+                            cue_point.sampleByteOffset / (m_bits_per_sample / 8) / m_num_channels;
                         found_cue = true;
                         break;
                     }
@@ -346,12 +358,12 @@ class WaveMetadataToNonSpecificMetadata {
             }
         }
 
-        result.num_frames = region.sampleLength / m_audio.num_channels;
+        result.num_frames = region.sampleLength / m_num_channels;
 
         // TODO: handle these cases properly instead of asserting
         assert(found_cue);
-        assert(result.start_frame < m_audio.NumFrames());
-        assert((result.start_frame + result.num_frames) <= m_audio.NumFrames());
+        assert(result.start_frame < m_num_frames);
+        assert((result.start_frame + result.num_frames) <= m_num_frames);
         (void)found_cue;
 
         return result;
@@ -368,9 +380,9 @@ class WaveMetadataToNonSpecificMetadata {
             }
         }
         result.start_frame =
-            cue_point.sampleByteOffset / (m_audio.bits_per_sample / 8) / m_audio.num_channels;
+            cue_point.sampleByteOffset / (m_bits_per_sample / 8) / m_num_channels;
         // TODO: handle thi cases properly instead of asserting
-        assert(result.start_frame < m_audio.NumFrames());
+        assert(result.start_frame < m_num_frames);
         return result;
     }
 
@@ -398,7 +410,9 @@ class WaveMetadataToNonSpecificMetadata {
     }
 
     const WaveMetadata &m_wave_metadata;
-    const AudioData &m_audio;
+    const unsigned m_num_channels;
+    const unsigned m_bits_per_sample;
+    const u64 m_num_frames;
 };
 
 void DebugPrintAllMetadata(const WaveMetadata &metadata) {
@@ -467,6 +481,48 @@ void DebugPrintAllMetadata(const WaveMetadata &metadata) {
     }
 }
 
+// The samples are decoded in blocks of roughly this size so that the intermediate data stays in the cache.
+static constexpr usize k_wav_decode_block_size_bytes = 64 * 1024;
+
+static bool ReadWavPcmSamplesAsDouble(drwav &wav,
+                                      PcmSampleType type,
+                                      const MappedFile &mapped_file,
+                                      std::vector<double> &out) {
+    const usize bytes_per_sample = BytesPerPcmSample(type);
+    const usize num_samples = out.size();
+
+    // When the file is mapped, the samples can be converted straight out of the mapping.
+    if (mapped_file.IsMapped() && wav.dataChunkDataPos <= mapped_file.Size() &&
+        num_samples * bytes_per_sample <= mapped_file.Size() - wav.dataChunkDataPos) {
+        ConvertPcmToDouble(type, mapped_file.Data() + wav.dataChunkDataPos, num_samples, out.data());
+        return true;
+    }
+
+    std::vector<u8> block(k_wav_decode_block_size_bytes / bytes_per_sample * bytes_per_sample);
+    usize samples_read = 0;
+    while (samples_read != num_samples) {
+        const auto samples_to_read = std::min(block.size() / bytes_per_sample, num_samples - samples_read);
+        const auto bytes_to_read = samples_to_read * bytes_per_sample;
+        if (drwav_read_raw(&wav, bytes_to_read, block.data()) != bytes_to_read) return false;
+        ConvertPcmToDouble(type, block.data(), samples_to_read, out.data() + samples_read);
+        samples_read += samples_to_read;
+    }
+    return true;
+}
+
+static bool ReadWavSamplesViaF32(drwav &wav, std::vector<double> &out) {
+    const drwav_uint64 block_num_frames = k_wav_decode_block_size_bytes / sizeof(float) / wav.channels;
+    std::vector<float> f32_block(block_num_frames * wav.channels);
+    drwav_uint64 frames_read = 0;
+    while (frames_read != wav.totalPCMFrameCount) {
+        const auto num_frames = std::min(block_num_frames, wav.totalPCMFrameCount - frames_read);
+        if (drwav_read_pcm_frames_f32(&wav, num_frames, f32_block.data()) != num_frames) return false;
+        std::copy_n(f32_block.begin(), num_frames * wav.channels, out.begin() + frames_read * wav.channels);
+        frames_read += num_frames;
+    }
+    return true;
+}
+
 std::optional<AudioData> ReadAudioFile(const fs::path &path) {
     MessageWithNewLine("Signet", path, "Reading file");
     const auto file = OpenFile(path, "rb");
@@ -474,11 +530,20 @@ std::optional<AudioData> ReadAudioFile(const fs::path &path) {
 
     AudioData result {};
     const auto ext = path.extension();
-    if (ext == ".wav") {
-        std::vector<float> f32_buf {};
+    if (ext == ".wav" || ext == ".w64") {
+        // dr_wav detects RF64 and Wave64 files itself, they are read in the same way as normal WAV files.
+        //
+        // Where possible, the file is mapped into memory rather than read through the FILE. dr_wav then
+        // parses the chunks in-place and the samples are decoded straight out of the OS's page cache, rather
+        // than being copied into buffers first.
+        MappedFile mapped_file;
+        std::error_code ec;
         drwav wav;
-
-        if (!drwav_init_with_metadata(&wav, OnReadFile, OnSeekFile, file.get(), 0, nullptr)) {
+        const bool initialised =
+            mapped_file.Map(path, ec)
+                ? drwav_init_memory_with_metadata(&wav, mapped_file.Data(), mapped_file.Size(), 0, nullptr)
+                : drwav_init_with_metadata(&wav, OnReadFile, OnSeekFile, file.get(), 0, nullptr);
+        if (!initialised) {
             WarningWithNewLine("Wav", path, "could not init the WAV file");
             return {};
         }
@@ -491,22 +556,28 @@ std::optional<AudioData> ReadAudioFile(const fs::path &path) {
             const auto num_metadata = wav.metadataCount; // drwav_take_ownership_of_metadata clears it
             result.wave_metadata.Assign(drwav_take_ownership_of_metadata(&wav), num_metadata);
             // DebugPrintAllMetadata(result.wave_metadata);
-            WaveMetadataToNonSpecificMetadata converter(result.wave_metadata, result);
+            WaveMetadataToNonSpecificMetadata converter(result.wave_metadata, wav.channels, wav.bitsPerSample,
+                                                        wav.totalPCMFrameCount);
             result.metadata = converter.Convert();
         }
 
-        f32_buf.resize(result.interleaved_samples.size());
-        const auto frames_read = drwav_read_pcm_frames_f32(&wav, wav.totalPCMFrameCount, f32_buf.data());
-        if (frames_read != wav.totalPCMFrameCount) {
+        // Integer and float PCM is converted straight to double. Other encodings, such as ADPCM, have to be
+        // decoded by dr_wav.
+        std::optional<PcmSampleType> pcm_type {};
+        if ((wav.translatedFormatTag == DR_WAVE_FORMAT_PCM ||
+             wav.translatedFormatTag == DR_WAVE_FORMAT_IEEE_FLOAT) &&
+            wav.fmt.blockAlign == wav.channels * (wav.bitsPerSample / 8)) {
+            pcm_type =
+                GetPcmSampleType(wav.translatedFormatTag == DR_WAVE_FORMAT_IEEE_FLOAT, wav.bitsPerSample);
+        }
+        const bool read_all_frames =
+            pcm_type ? ReadWavPcmSamplesAsDouble(wav, *pcm_type, mapped_file, result.interleaved_samples)
+                     : ReadWavSamplesViaF32(wav, result.interleaved_samples);
+        if (!read_all_frames) {
             WarningWithNewLine("Wav", path, "failed to get all the frames from file");
             return {};
         }
         result.format = AudioFileFormat::Wav;
-
-        // TODO: would be nice to have a way to get double values direct rather than just casting floats...
-        for (usize sample = 0; sample < f32_buf.size(); ++sample) {
-            result.interleaved_samples[sample] = (double)f32_buf[sample];
-        }
     } else if (ext == ".flac") {
         const bool decoded = DecodeFlacFile(file.get(), result);
         if (!decoded) {
@@ -522,115 +593,164 @@ std::optional<AudioData> ReadAudioFile(const fs::path &path) {
     return result;
 }
 
-template <typename SignedIntType>
-SignedIntType ScaleSampleToSignedInt(const double s, const unsigned bits_per_sample) {
-    const auto negative_max = std::pow(2, bits_per_sample) / 2;
-    const auto positive_max = negative_max - 1;
-    return static_cast<SignedIntType>(std::round(s < 0 ? s * negative_max : s * positive_max));
+static size_t FlacIoRead(void *ptr, size_t size, size_t num, FLAC__IOHandle handle) {
+    return std::fread(ptr, size, num, (FILE *)handle);
 }
-
-double GetScaleToAvoidClipping(const std::vector<double> &buf) {
-    double max = 0;
-    for (const auto s : buf) {
-        max = std::max(max, std::abs(s));
-    }
-    if (max <= 1) return 1;
-    return 1.0 / max;
+static size_t FlacIoWrite(const void *ptr, size_t size, size_t num, FLAC__IOHandle handle) {
+    return std::fwrite(ptr, size, num, (FILE *)handle);
+}
+static int FlacIoSeek(FLAC__IOHandle handle, FLAC__int64 offset, int whence) {
+    return SeekFile((FILE *)handle, offset, whence);
 }
+static FLAC__int64 FlacIoTell(FLAC__IOHandle handle) { return TellFile((FILE *)handle); }
+static int FlacIoEof(FLAC__IOHandle handle) { return std::feof((FILE *)handle); }
 
-template <typename SignedIntType>
-std::vector<SignedIntType> CreateSignedIntSamplesFromFloat(const std::vector<double> &buf,
-                                                           const unsigned bits_per_sample) {
-    std::vector<SignedIntType> result;
-    result.reserve(buf.size());
-    const auto multiplier = GetScaleToAvoidClipping(buf);
-    for (const auto s : buf) {
-        result.push_back(ScaleSampleToSignedInt<SignedIntType>(s * multiplier, bits_per_sample));
-    }
+static const FLAC__IOCallbacks flac_file_io_callbacks {FlacIoRead, FlacIoWrite, FlacIoSeek,
+                                                       FlacIoTell, FlacIoEof,   nullptr};
 
-    if (multiplier != 1.0) {
-        WarningWithNewLine(
-            "Signet", {},
-            "this audio file contained samples outside of the valid range, to avoid distortion, the whole file was scaled down in volume");
+using FlacChainPtr = std::unique_ptr<FLAC__Metadata_Chain, decltype(&FLAC__metadata_chain_delete)>;
+using FlacIteratorPtr = std::unique_ptr<FLAC__Metadata_Iterator, decltype(&FLAC__metadata_iterator_delete)>;
+
+// Only the metadata blocks at the start of a FLAC file are read, libFLAC stops at the first audio frame.
+static FlacChainPtr ReadFlacMetadataChain(const fs::path &path) {
+    FlacChainPtr chain {FLAC__metadata_chain_new(), &FLAC__metadata_chain_delete};
+    if (!chain) return chain;
+    const auto file = OpenFile(path, "rb");
+    if (!file || !FLAC__metadata_chain_read_with_callbacks(chain.get(), file.get(), flac_file_io_callbacks)) {
+        chain.reset();
     }
+    return chain;
+}
 
+std::optional<AudioFileInfo> ReadAudioFileInfo(const fs::path &path) {
+    AudioFileInfo result {};
+    const auto ext = path.extension();
+    if (ext == ".wav" || ext == ".w64") {
+        // dr_wav reads the chunks up to the data chunk, and then seeks past the audio to find any metadata
+        // chunks that come after it.
+        const auto file = OpenFile(path, "rb");
+        if (!file) return {};
+        drwav wav;
+        if (!drwav_init_with_metadata(&wav, OnReadFile, OnSeekFile, file.get(), 0, nullptr)) {
+            WarningWithNewLine("Wav", path, "could not init the WAV file");
+            return {};
+        }
+        result.format = AudioFileFormat::Wav;
+        result.num_channels = wav.channels;
+        result.sample_rate = wav.sampleRate;
+        result.bits_per_sample = wav.bitsPerSample;
+        result.num_frames = wav.totalPCMFrameCount;
+        if (wav.metadataCount) {
+            const auto num_metadata = wav.metadataCount;
+            WaveMetadata wave_metadata;
+            wave_metadata.Assign(drwav_take_ownership_of_metadata(&wav), num_metadata);
+            WaveMetadataToNonSpecificMetadata converter(wave_metadata, wav.channels, wav.bitsPerSample,
+                                                        wav.totalPCMFrameCount);
+            result.metadata = converter.Convert();
+        }
+        drwav_uninit(&wav);
+    } else if (ext == ".flac") {
+        const auto chain = ReadFlacMetadataChain(path);
+        FlacIteratorPtr iterator {FLAC__metadata_iterator_new(), &FLAC__metadata_iterator_delete};
+        if (!chain || !iterator) {
+            WarningWithNewLine("Flac", path, "could not read the FLAC metadata");
+            return {};
+        }
+        result.format = AudioFileFormat::Flac;
+        FLAC__metadata_iterator_init(iterator.get(), chain.get());
+        do {
+            const auto block = FLAC__metadata_iterator_get_block(iterator.get());
+            if (block->type == FLAC__METADATA_TYPE_STREAMINFO) {
+                result.num_channels = block->data.stream_info.channels;
+                result.sample_rate = block->data.stream_info.sample_rate;
+                result.bits_per_sample = block->data.stream_info.bits_per_sample;
+                result.num_frames = block->data.stream_info.total_samples;
+            } else {
+                ReadSignetFlacMetadataBlock(block, result.metadata);
+            }
+        } while (FLAC__metadata_iterator_next(iterator.get()));
+    } else {
+        WarningWithNewLine("Wav", path, "file is not a WAV or a FLAC");
+        return {};
+    }
     return result;
 }
 
-template <typename UnsignedIntType>
-std::vector<UnsignedIntType> CreateUnsignedIntSamplesFromFloat(const std::vector<double> &buf,
-                                                               const unsigned bits_per_sample) {
-    std::vector<UnsignedIntType> result;
-    result.reserve(buf.size());
-    const auto multiplier = GetScaleToAvoidClipping(buf);
-    for (auto s : buf) {
-        s *= multiplier;
-        const auto scaled_val = ((s + 1.0) / 2.0f) * ((1 << bits_per_sample) - 1);
-        result.push_back(static_cast<UnsignedIntType>(scaled_val));
-    }
+AudioFileInfo GetAudioFileInfo(const AudioData &audio_data) {
+    return {audio_data.format,          audio_data.num_channels, audio_data.sample_rate,
+            audio_data.bits_per_sample, audio_data.NumFrames(),  audio_data.metadata};
+}
 
-    if (multiplier != 1.0) {
+// Integer formats cannot store samples outside of [-1, 1], so if there are any the whole file is turned down
+// rather than letting them clip. The dither is seeded from the samples so that each file gets different
+// noise, but the same file always gets the same noise.
+static SampleQuantiser CreateSampleQuantiser(tcb::span<const double> interleaved_samples,
+                                             unsigned num_channels,
+                                             unsigned bits_per_sample,
+                                             DitherType dither) {
+    const auto peak = GetPeakMagnitude(interleaved_samples);
+    double gain = 1;
+    if (peak > 1) {
         WarningWithNewLine(
             "Signet", {},
             "this audio file contained samples outside of the valid range, to avoid distortion, the whole file was scaled down in volume");
+        gain = 1.0 / peak;
     }
-
-    return result;
-}
-
-static std::array<u8, 3> Convert24BitIntToBytes(const s32 sample) {
-    std::array<u8, 3> bytes;
-    bytes[0] = (u8)sample & 0xFF;
-    bytes[1] = (u8)(sample >> 8) & 0xFF;
-    bytes[2] = (u8)(sample >> 16) & 0xFF;
-    return bytes;
+    u64 peak_bits;
+    std::memcpy(&peak_bits, &peak, sizeof(peak));
+    const auto seed = (u32)(peak_bits ^ (peak_bits >> 32) ^ (u64)interleaved_samples.size());
+    return {num_channels, bits_per_sample, gain, dither, seed};
 }
 
-static void GetAudioDataConvertedAndScaledToBitDepth(const std::vector<double> f64_buf,
-                                                     unsigned bits_per_sample,
-                                                     std::function<void(const void *)> callback) {
-    switch (bits_per_sample) {
-        case 8: {
-            // 8-bit is the exception in that it uses unsigned ints
-            const auto buf = CreateUnsignedIntSamplesFromFloat<u8>(f64_buf, 8);
-            callback(buf.data());
-            break;
-        }
-        case 16: {
-            const auto buf = CreateSignedIntSamplesFromFloat<s16>(f64_buf, 16);
-            callback(buf.data());
-            break;
-        }
-        case 24: {
-            std::vector<u8> buf;
-            buf.reserve(f64_buf.size() * 3);
-            for (const auto &s : f64_buf) {
-                const auto sample = ScaleSampleToSignedInt<s32>(s, 24);
-                for (const auto byte : Convert24BitIntToBytes(sample)) {
-                    buf.push_back(byte);
-                }
-            }
-            callback(buf.data());
-            break;
-        }
-        case 32: {
-            std::vector<float> buf;
-            buf.reserve(f64_buf.size());
-            for (const auto s : f64_buf) {
-                buf.push_back(static_cast<float>(s));
-            }
-            callback(buf.data());
-            break;
+// Files are converted to their bit depth a block at a time into a buffer that is reused, so writing a file
+// never needs a converted copy of all of it.
+static constexpr usize k_conversion_block_num_frames = 4096;
+
+// Calls callback with the data and number of frames of each block of the samples, converted to the sample
+// format that a WAV file of the given bit depth uses. Stops and returns false if the callback returns false.
+static bool ForEachBlockConvertedToBitDepth(tcb::span<const double> interleaved_samples,
+                                            unsigned num_channels,
+                                            unsigned bits_per_sample,
+                                            DitherType dither,
+                                            const std::function<bool(const void *, usize)> &callback) {
+    // 32 and 64-bit WAV files are floating point.
+    const auto type = GetPcmSampleType(bits_per_sample >= 32, bits_per_sample);
+    assert(type);
+    const usize num_frames = interleaved_samples.size() / num_channels;
+
+    if (*type == PcmSampleType::Float64) {
+        for (usize start = 0; start < num_frames; start += k_conversion_block_num_frames) {
+            const auto block_num_frames = std::min(k_conversion_block_num_frames, num_frames - start);
+            if (!callback(interleaved_samples.data() + start * num_channels, block_num_frames)) return false;
         }
-        case 64: {
-            callback(f64_buf.data());
-            break;
-        }
-        default: {
-            REQUIRE(0);
-            return;
+        return true;
+    }
+
+    std::optional<SampleQuantiser> quantiser {};
+    double gain = 1;
+    if (bits_per_sample < 32) {
+        quantiser = CreateSampleQuantiser(interleaved_samples, num_channels, bits_per_sample, dither);
+        gain = quantiser->Gain();
+    }
+
+    thread_local std::vector<u8> buffer;
+    thread_local std::vector<s32> quantised;
+    buffer.resize(k_conversion_block_num_frames * num_channels * BytesPerPcmSample(*type));
+    for (usize start = 0; start < num_frames; start += k_conversion_block_num_frames) {
+        const auto block_num_frames = std::min(k_conversion_block_num_frames, num_frames - start);
+        const auto block = interleaved_samples.subspan(start * num_channels, block_num_frames * num_channels);
+        // 8-bit WAV files are unsigned, and have always been converted with their own scaling. They are not
+        // dithered.
+        if (quantiser && *type != PcmSampleType::UnsignedInt8) {
+            quantised.resize(block.size());
+            quantiser->Quantise(interleaved_samples, start, block_num_frames, quantised.data());
+            ConvertInt32ToPcm(*type, quantised.data(), quantised.size(), buffer.data());
+        } else {
+            ConvertDoubleToPcm(*type, block.data(), block.size(), gain, buffer.data());
         }
+        if (!callback(buffer.data(), block_num_frames)) return false;
     }
+    return true;
 }
 
 class NonSpecificMetadataToWaveMetadata {
@@ -883,6 +1003,26 @@ class NonSpecificMetadataToWaveMetadata {
     std::vector<drwav_metadata> m_wave_metadata {};
 };
 
+// The RIFF container stores the sizes of its chunks in 32 bits, so files that would be larger than 4 GB are
+// written as RF64 instead. RF64 is the same as RIFF, except for an extra chunk that has 64-bit sizes. Wave64
+// is only used if the file has the .w64 extension.
+static drwav_container GetWaveContainer(const fs::path &path,
+                                        drwav_data_format format,
+                                        u64 num_frames,
+                                        const std::vector<drwav_metadata> &metadata) {
+    if (path.extension() == ".w64") return drwav_container_w64;
+
+    // dr_wav clamps the size to the largest that RIFF can store.
+    format.container = drwav_container_riff;
+    constexpr u64 riff_header_size = 8;
+    const auto file_size =
+        drwav_target_write_size_bytes(&format, num_frames,
+                                      metadata.size() ? (drwav_metadata *)metadata.data() : NULL,
+                                      (u32)metadata.size());
+    if (file_size >= riff_header_size + UINT32_MAX) return drwav_container_rf64;
+    return drwav_container_riff;
+}
+
 static bool WriteWaveFile(const fs::path &path, const AudioData &audio_data, const unsigned bits_per_sample) {
     if (std::find(std::begin(valid_wave_bit_depths), std::end(valid_wave_bit_depths), bits_per_sample) ==
         std::end(valid_wave_bit_depths)) {
@@ -895,7 +1035,6 @@ static bool WriteWaveFile(const fs::path &path, const AudioData &audio_data, con
     if (!file) return false;
 
     drwav_data_format format {};
-    format.container = drwav_container_riff; // Use rf64 for large files?
     format.format =
         (bits_per_sample == 32 || bits_per_sample == 64) ? DR_WAVE_FORMAT_IEEE_FLOAT : DR_WAVE_FORMAT_PCM;
     format.channels = audio_data.num_channels;
@@ -907,23 +1046,28 @@ static bool WriteWaveFile(const fs::path &path, const AudioData &audio_data, con
     NonSpecificMetadataToWaveMetadata wave_file_metadata(audio_data, bits_per_sample);
     const auto metadata = wave_file_metadata.BuildMetadata();
 
+    format.container = GetWaveContainer(path, format, audio_data.NumFrames(), metadata);
+    if (format.container == drwav_container_w64 && metadata.size()) {
+        WarningWithNewLine("Wav", path, "metadata cannot be written to Wave64 files, it will be discarded");
+    }
+
     drwav wav;
     drwav_init_write_with_metadata(&wav, &format, OnWrite, OnSeekFile, file.get(), nullptr,
                                    metadata.size() ? (drwav_metadata *)metadata.data() : NULL,
                                    (u32)metadata.size());
 
-    bool succeed_writing = true;
-    GetAudioDataConvertedAndScaledToBitDepth(
-        audio_data.interleaved_samples, bits_per_sample, [&](const void *raw_data) {
-            if (!succeed_writing) return;
-            const auto frames_written = drwav_write_pcm_frames(&wav, audio_data.NumFrames(), raw_data);
-            if (frames_written != audio_data.NumFrames()) {
+    const bool succeed_writing = ForEachBlockConvertedToBitDepth(
+        audio_data.interleaved_samples, audio_data.num_channels, bits_per_sample, audio_data.dither,
+        [&](const void *raw_data, usize num_frames) {
+            const auto frames_written = drwav_write_pcm_frames(&wav, num_frames, raw_data);
+            if (frames_written != num_frames) {
                 ErrorWithNewLine(
                     "Wav", path,
                     "failed to write the correct number of frames, {} were written, {} we requested",
-                    frames_written, audio_data.NumFrames());
-                succeed_writing = true;
+                    frames_written, num_frames);
+                return false;
             }
+            return true;
         });
 
     drwav_uninit(&wav);
@@ -1020,6 +1164,28 @@ static void SafeMetadataDelete(FLAC__StreamMetadata *obj) {
     if (obj) FLAC__metadata_object_delete(obj);
 }
 
+using FlacMetadataPtr = std::unique_ptr<FLAC__StreamMetadata, decltype(&SafeMetadataDelete)>;
+
+// Our metadata is stored as JSON in a custom FLAC block.
+static FlacMetadataPtr CreateSignetFlacMetadataBlock(const AudioData &audio_data) {
+    FlacMetadataPtr signet_metadata {nullptr, &SafeMetadataDelete};
+    std::stringstream ss;
+    try {
+        cereal::JSONOutputArchive archive(ss);
+        archive(cereal::make_nvp(signet_root_json_object_name, audio_data.metadata));
+    } catch (const std::exception &e) {
+        ErrorWithNewLine("Flac", {}, "Internal error when writing FLAC signet json metadata: {}", e.what());
+    }
+    const auto str = ss.str();
+    if (str.size()) {
+        signet_metadata.reset(FLAC__metadata_object_new(FLAC__METADATA_TYPE_APPLICATION));
+        memcpy(signet_metadata->data.application.id, flac_custom_signet_application_id, 4);
+        FLAC__metadata_object_application_set_data(signet_metadata.get(), (FLAC__byte *)str.data(),
+                                                   (unsigned)str.size(), true);
+    }
+    return signet_metadata;
+}
+
 static bool
 WriteFlacFile(const fs::path &filename, const AudioData &audio_data, const unsigned bits_per_sample) {
     if (std::find(std::begin(valid_flac_bit_depths), std::end(valid_flac_bit_depths), bits_per_sample) ==
@@ -1036,37 +1202,17 @@ WriteFlacFile(const fs::path &filename, const AudioData &audio_data, const unsig
         return false;
     }
 
-    FLAC__stream_encoder_set_channels(encoder.get(), audio_data.num_channels);
-    FLAC__stream_encoder_set_bits_per_sample(encoder.get(), bits_per_sample);
-    FLAC__stream_encoder_set_sample_rate(encoder.get(), audio_data.sample_rate);
-    FLAC__stream_encoder_set_total_samples_estimate(encoder.get(), audio_data.interleaved_samples.size());
+    const auto &settings = audio_data.flac_encoding_settings;
+    ConfigureFlacEncoder(encoder.get(), settings, audio_data.num_channels, bits_per_sample,
+                         audio_data.sample_rate, audio_data.NumFrames());
 
     std::vector<FLAC__StreamMetadata *> metadata;
     for (auto m : audio_data.flac_metadata) {
         metadata.push_back(m.get());
     }
 
-    // Add in our metadata to a custom FLAC block
-    std::unique_ptr<FLAC__StreamMetadata, decltype(&SafeMetadataDelete)> signet_metadata {
-        nullptr, &SafeMetadataDelete};
-    {
-        std::stringstream ss;
-        try {
-            cereal::JSONOutputArchive archive(ss);
-            archive(cereal::make_nvp(signet_root_json_object_name, audio_data.metadata));
-        } catch (const std::exception &e) {
-            ErrorWithNewLine("Flac", {}, "Internal error when writing FLAC signet json metadata: {}",
-                             e.what());
-        }
-        const auto str = ss.str();
-        if (str.size()) {
-            signet_metadata.reset(FLAC__metadata_object_new(FLAC__METADATA_TYPE_APPLICATION));
-            memcpy(signet_metadata->data.application.id, flac_custom_signet_application_id, 4);
-            FLAC__metadata_object_application_set_data(signet_metadata.get(), (FLAC__byte *)str.data(),
-                                                       (unsigned)str.size(), true);
-            metadata.push_back(signet_metadata.get());
-        }
-    }
+    const auto signet_metadata = CreateSignetFlacMetadataBlock(audio_data);
+    if (signet_metadata) metadata.push_back(signet_metadata.get());
 
     if (metadata.size()) {
         const bool set_metadata =
@@ -1080,19 +1226,39 @@ WriteFlacFile(const fs::path &filename, const AudioData &audio_data, const unsig
         return false;
     }
 
+    auto quantiser = CreateSampleQuantiser(audio_data.interleaved_samples, audio_data.num_channels,
+                                           bits_per_sample, audio_data.dither);
+
+    if (ShouldEncodeFlacInParallel(settings, audio_data.NumFrames())) {
+        const bool written = WriteFlacFileInParallel(f, settings, audio_data.num_channels, bits_per_sample,
+                                                     audio_data.sample_rate, metadata,
+                                                     audio_data.interleaved_samples, quantiser);
+        std::fclose(f);
+        if (!written) {
+            WarningWithNewLine("Flac", filename, "could not write flac file - failed encoding samples");
+        }
+        return written;
+    }
+
     if (const auto o = FLAC__stream_encoder_init_FILE(encoder.get(), f, nullptr, nullptr);
         o != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
         WarningWithNewLine("Flac", filename, "could not write flac file");
         PrintFlacStatusCode(o);
         return false;
     }
-
-    const auto int32_buffer =
-        CreateSignedIntSamplesFromFloat<s32>(audio_data.interleaved_samples, bits_per_sample);
-    if (!FLAC__stream_encoder_process_interleaved(encoder.get(), int32_buffer.data(),
-                                                  (unsigned)audio_data.NumFrames())) {
-        WarningWithNewLine("Flac", filename, "could not write flac file - failed encoding samples");
-        return false;
+    // The encoder buffers the samples itself, so they are converted and passed to it a block at a time.
+    thread_local std::vector<s32> block;
+    const auto num_channels = audio_data.num_channels;
+    const auto num_frames = audio_data.NumFrames();
+    for (usize start = 0; start < num_frames; start += k_conversion_block_num_frames) {
+        const auto block_num_frames = std::min(k_conversion_block_num_frames, num_frames - start);
+        block.resize(block_num_frames * num_channels);
+        quantiser.Quantise(audio_data.interleaved_samples, start, block_num_frames, block.data());
+        if (!FLAC__stream_encoder_process_interleaved(encoder.get(), block.data(),
+                                                      (unsigned)block_num_frames)) {
+            WarningWithNewLine("Flac", filename, "could not write flac file - failed encoding samples");
+            return false;
+        }
     }
 
     if (!FLAC__stream_encoder_finish(encoder.get())) {
@@ -1112,23 +1278,332 @@ bool WriteAudioFile(const fs::path &filename,
     const auto ext = filename.extension();
     if (ext == ".flac") {
         result = WriteFlacFile(filename, audio_data, bits_per_sample);
-    } else if (ext == ".wav") {
+    } else if (ext == ".wav" || ext == ".w64") {
         result = WriteWaveFile(filename, audio_data, bits_per_sample);
     }
 
     return result;
 }
 
+// Metadata-only rewriting
+// ========================
+// When only the metadata has changed the audio in the file is already correct, so rather than re-encoding it,
+// only the bytes around it are rewritten. If the metadata no longer fits in the space that there is for it,
+// the audio bytes are copied into a new file as they are.
+
+static bool WriteBytes(FILE *file, const std::vector<u8> &bytes) {
+    return std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+}
+
+static void AppendU32LE(std::vector<u8> &bytes, u32 value) {
+    for (int i = 0; i < 4; ++i) {
+        bytes.push_back((u8)(value >> (i * 8)));
+    }
+}
+
+static u32 ReadU32LE(const u8 *bytes) {
+    return (u32)bytes[0] | ((u32)bytes[1] << 8) | ((u32)bytes[2] << 16) | ((u32)bytes[3] << 24);
+}
+
+struct RiffChunk {
+    u64 TotalSize() const { return 8 + size + (size & 1); }
+    bool Is(const char *chunk_id) const { return memcmp(id, chunk_id, 4) == 0; }
+
+    char id[4];
+    u64 offset;
+    u32 size;
+};
+
+struct MemoryStream {
+    std::vector<u8> bytes {};
+    usize pos {};
+};
+
+static size_t OnWriteMemory(void *user_data, const void *data, size_t num_bytes) {
+    auto &stream = *(MemoryStream *)user_data;
+    if (stream.pos + num_bytes > stream.bytes.size()) stream.bytes.resize(stream.pos + num_bytes);
+    memcpy(stream.bytes.data() + stream.pos, data, num_bytes);
+    stream.pos += num_bytes;
+    return num_bytes;
+}
+
+static drwav_bool32 OnSeekMemory(void *user_data, int offset, drwav_seek_origin origin) {
+    auto &stream = *(MemoryStream *)user_data;
+    const auto pos = (s64)(origin == drwav_seek_origin_current ? stream.pos : 0) + offset;
+    if (pos < 0 || pos > (s64)stream.bytes.size()) return 0;
+    stream.pos = (usize)pos;
+    return 1;
+}
+
+// The chunks that a full write of the file would create from our metadata, exactly as they would be written.
+static std::optional<std::vector<u8>> BuildWaveMetadataChunks(const AudioData &audio_data) {
+    drwav_data_format format {};
+    format.container = drwav_container_riff;
+    format.format = DR_WAVE_FORMAT_PCM;
+    format.channels = audio_data.num_channels;
+    format.sampleRate = audio_data.sample_rate;
+    format.bitsPerSample = audio_data.bits_per_sample;
+
+    NonSpecificMetadataToWaveMetadata wave_file_metadata(audio_data, audio_data.bits_per_sample);
+    const auto metadata = wave_file_metadata.BuildMetadata();
+
+    MemoryStream header {};
+    drwav wav;
+    if (!drwav_init_write_with_metadata(&wav, &format, OnWriteMemory, OnSeekMemory, &header, nullptr,
+                                        metadata.size() ? (drwav_metadata *)metadata.data() : NULL,
+                                        (u32)metadata.size())) {
+        return {};
+    }
+    drwav_uninit(&wav);
+
+    // The metadata is everything between the fmt chunk and the (empty) data chunk.
+    std::vector<u8> result;
+    for (usize offset = 12; offset + 8 <= header.bytes.size();) {
+        RiffChunk chunk {};
+        memcpy(chunk.id, header.bytes.data() + offset, 4);
+        chunk.size = ReadU32LE(header.bytes.data() + offset + 4);
+        if (chunk.Is("data") || offset + chunk.TotalSize() > header.bytes.size()) break;
+        if (!chunk.Is("fmt ")) {
+            result.insert(result.end(), header.bytes.begin() + offset,
+                          header.bytes.begin() + offset + chunk.TotalSize());
+        }
+        offset += chunk.TotalSize();
+    }
+    return result;
+}
+
+// The chunks that we write from our metadata are replaced, any other chunks are kept. The data chunk is left
+// where it is if the new chunks fit in the space before it, with a JUNK chunk filling any gap.
+static bool RewriteWaveFileMetadata(const fs::path &path, const AudioData &audio_data) {
+    const auto new_metadata = BuildWaveMetadataChunks(audio_data);
+    if (!new_metadata) return false;
+
+    auto file = OpenFile(path, "r+b");
+    if (!file) return false;
+    const auto file_size = (u64)GetFileSize(file.get());
+
+    // RF64 and Wave64 files are rare, and the sizes in their headers are more involved, so they are always
+    // rewritten in full.
+    u8 riff_header[12];
+    if (std::fread(riff_header, 1, sizeof(riff_header), file.get()) != sizeof(riff_header) ||
+        memcmp(riff_header, "RIFF", 4) != 0 || memcmp(riff_header + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+
+    std::vector<RiffChunk> chunks;
+    std::optional<usize> data_index;
+    for (u64 offset = sizeof(riff_header); offset + 8 <= file_size;) {
+        u8 chunk_header[8];
+        if (SeekFile(file.get(), (s64)offset, SEEK_SET) != 0 ||
+            std::fread(chunk_header, 1, sizeof(chunk_header), file.get()) != sizeof(chunk_header)) {
+            return false;
+        }
+        RiffChunk chunk {};
+        memcpy(chunk.id, chunk_header, 4);
+        chunk.offset = offset;
+        chunk.size = ReadU32LE(chunk_header + 4);
+        if (offset + 8 + chunk.size > file_size) return false;
+        if (chunk.Is("data")) {
+            if (data_index) return false;
+            data_index = chunks.size();
+        }
+        chunks.push_back(chunk);
+        offset += chunk.TotalSize();
+    }
+    if (!data_index) return false;
+
+    const auto IsReplacedChunk = [](const RiffChunk &chunk) {
+        for (const auto id : {"smpl", "inst", "cue ", "acid", "LIST", "JUNK", "junk", "PAD "}) {
+            if (chunk.Is(id)) return true;
+        }
+        return false;
+    };
+    // The last chunk of the file might be missing its padding byte, so that is always written explicitly.
+    const auto ReadChunk = [&](const RiffChunk &chunk, std::vector<u8> &out) {
+        const auto pos = out.size();
+        out.resize(pos + chunk.TotalSize());
+        return SeekFile(file.get(), (s64)chunk.offset, SEEK_SET) == 0 &&
+               std::fread(out.data() + pos, 1, 8 + chunk.size, file.get()) == 8 + chunk.size;
+    };
+
+    std::vector<u8> head;
+    std::vector<u8> tail;
+    for (usize i = 0; i < chunks.size(); ++i) {
+        if (i == *data_index || IsReplacedChunk(chunks[i])) continue;
+        if (!ReadChunk(chunks[i], i < *data_index ? head : tail)) return false;
+    }
+    head.insert(head.end(), new_metadata->begin(), new_metadata->end());
+
+    const auto &data = chunks[*data_index];
+    const u64 data_end = data.offset + 8 + data.size;
+    if (data.size & 1) tail.insert(tail.begin(), 0);
+
+    const u64 head_space = data.offset - sizeof(riff_header);
+    if (head.size() == head_space || (head.size() + 8 <= head_space && (head_space - head.size()) % 2 == 0)) {
+        if (head.size() != head_space) {
+            const auto junk_size = (u32)(head_space - head.size() - 8);
+            head.insert(head.end(), {'J', 'U', 'N', 'K'});
+            AppendU32LE(head, junk_size);
+            head.resize(head.size() + junk_size);
+        }
+        const auto new_file_size = data_end + tail.size();
+        if (new_file_size - 8 > UINT32_MAX) return false;
+
+        std::vector<u8> riff_size;
+        AppendU32LE(riff_size, (u32)(new_file_size - 8));
+        if (SeekFile(file.get(), 4, SEEK_SET) != 0 || !WriteBytes(file.get(), riff_size) ||
+            SeekFile(file.get(), sizeof(riff_header), SEEK_SET) != 0 || !WriteBytes(file.get(), head) ||
+            SeekFile(file.get(), (s64)data_end, SEEK_SET) != 0 || !WriteBytes(file.get(), tail)) {
+            return false;
+        }
+        file.reset();
+
+        if (new_file_size < file_size) {
+            std::error_code ec;
+            fs::resize_file(path, new_file_size, ec);
+            if (ec) return false;
+        }
+        return true;
+    }
+
+    const auto new_file_size = sizeof(riff_header) + head.size() + 8 + data.size + tail.size();
+    if (new_file_size - 8 > UINT32_MAX) return false;
+
+    auto temp_path = path;
+    temp_path += ".signet-temp";
+    {
+        auto temp_file = OpenFile(temp_path, "wb");
+        if (!temp_file) return false;
+
+        std::vector<u8> header {'R', 'I', 'F', 'F'};
+        AppendU32LE(header, (u32)(new_file_size - 8));
+        header.insert(header.end(), {'W', 'A', 'V', 'E'});
+        header.insert(header.end(), head.begin(), head.end());
+        header.insert(header.end(), {'d', 'a', 't', 'a'});
+        AppendU32LE(header, data.size);
+
+        const bool written = WriteBytes(temp_file.get(), header) &&
+                             SeekFile(file.get(), (s64)data.offset + 8, SEEK_SET) == 0 &&
+                             CopyFileBytes(file.get(), temp_file.get(), data.size) &&
+                             WriteBytes(temp_file.get(), tail) && std::fflush(temp_file.get()) == 0;
+        if (!written) {
+            temp_file.reset();
+            fs::remove(temp_path);
+            return false;
+        }
+    }
+    file.reset();
+
+    std::error_code ec;
+    fs::rename(temp_path, path, ec);
+    if (ec) {
+        fs::remove(temp_path, ec);
+        return false;
+    }
+    return true;
+}
+
+// When there's no room for the metadata the whole file has to be rewritten, and so some padding is added so
+// that next time it can be rewritten in place.
+static constexpr unsigned flac_metadata_padding_size = 4096;
+
+// The metadata blocks that we read into AudioData are replaced, the rest are kept. libFLAC uses the PADDING
+// blocks to fit the new blocks in without moving the audio frames if it can.
+static bool RewriteFlacFileMetadata(const fs::path &path, const AudioData &audio_data) {
+    const auto chain = ReadFlacMetadataChain(path);
+    FlacIteratorPtr iterator {FLAC__metadata_iterator_new(), &FLAC__metadata_iterator_delete};
+    if (!chain || !iterator) return false;
+
+    // Seek tables and cue sheets are not read into AudioData, but they are still valid because the audio
+    // hasn't changed.
+    FLAC__metadata_iterator_init(iterator.get(), chain.get());
+    do {
+        switch (FLAC__metadata_iterator_get_block_type(iterator.get())) {
+            case FLAC__METADATA_TYPE_STREAMINFO:
+            case FLAC__METADATA_TYPE_SEEKTABLE:
+            case FLAC__METADATA_TYPE_CUESHEET:
+            case FLAC__METADATA_TYPE_PADDING: break;
+            default:
+                if (!FLAC__metadata_iterator_delete_block(iterator.get(), false)) return false;
+        }
+    } while (FLAC__metadata_iterator_next(iterator.get()));
+
+    const auto InsertBlock = [&](FlacMetadataPtr block) {
+        if (!block || !FLAC__metadata_iterator_insert_block_after(iterator.get(), block.get())) return false;
+        block.release();
+        return true;
+    };
+    for (const auto &m : audio_data.flac_metadata) {
+        if (m->type == FLAC__METADATA_TYPE_PADDING) continue;
+        if (!InsertBlock({FLAC__metadata_object_clone(m.get()), &SafeMetadataDelete})) return false;
+    }
+    if (auto signet_metadata = CreateSignetFlacMetadataBlock(audio_data)) {
+        if (!InsertBlock(std::move(signet_metadata))) return false;
+    }
+    FLAC__metadata_chain_sort_padding(chain.get());
+
+    if (!FLAC__metadata_chain_check_if_tempfile_needed(chain.get(), true)) {
+        const auto file = OpenFile(path, "r+b");
+        return file && FLAC__metadata_chain_write_with_callbacks(chain.get(), true, file.get(),
+                                                                 flac_file_io_callbacks);
+    }
+
+    while (FLAC__metadata_iterator_next(iterator.get())) {
+    }
+    FlacMetadataPtr padding {FLAC__metadata_object_new(FLAC__METADATA_TYPE_PADDING), &SafeMetadataDelete};
+    if (padding) padding->length = flac_metadata_padding_size;
+    if (!InsertBlock(std::move(padding))) return false;
+
+    auto temp_path = path;
+    temp_path += ".signet-temp";
+    {
+        const auto file = OpenFile(path, "rb");
+        const auto temp_file = OpenFile(temp_path, "wb");
+        const bool written = file && temp_file &&
+                             FLAC__metadata_chain_write_with_callbacks_and_tempfile(
+                                 chain.get(), true, file.get(), flac_file_io_callbacks, temp_file.get(),
+                                 flac_file_io_callbacks) &&
+                             std::fflush(temp_file.get()) == 0;
+        if (!written) {
+            std::error_code ec;
+            fs::remove(temp_path, ec);
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(temp_path, path, ec);
+    if (ec) {
+        fs::remove(temp_path, ec);
+        return false;
+    }
+    return true;
+}
+
+bool RewriteAudioFileMetadata(const fs::path &filename, const AudioData &audio_data) {
+    const auto ext = filename.extension();
+    if (ext == ".flac") return RewriteFlacFileMetadata(filename, audio_data);
+    if (ext == ".wav") return RewriteWaveFileMetadata(filename, audio_data);
+    return false;
+}
+
 struct BufferConversionTest {
     template <typename T>
     static void
     Check(const std::vector<double> &buf, const unsigned bits_per_sample, const std::vector<T> expected) {
-        GetAudioDataConvertedAndScaledToBitDepth(buf, bits_per_sample, [&](const void *raw_data) {
-            const auto data = (const T *)raw_data;
-            for (usize i = 0; i < expected.size(); ++i) {
-                REQUIRE(data[i] == expected[i]);
-            }
-        });
+        std::vector<u8> result;
+        const auto add_block = [&](const void *raw_data, usize num_frames) {
+            const auto data = (const u8 *)raw_data;
+            result.insert(result.end(), data, data + num_frames * ((bits_per_sample + 7) / 8));
+            return true;
+        };
+        ForEachBlockConvertedToBitDepth(buf, 1, bits_per_sample, DitherType::None, add_block);
+        REQUIRE(result.size() == expected.size() * sizeof(T));
+        for (usize i = 0; i < expected.size(); ++i) {
+            T value;
+            std::memcpy(&value, result.data() + i * sizeof(T), sizeof(T));
+            REQUIRE(value == expected[i]);
+        }
     }
 };
 
@@ -1171,41 +1646,41 @@ TEST_CASE("[AudioData]") {
 
     SUBCASE("conversion") {
         SUBCASE("signed single samples") {
-            REQUIRE(ScaleSampleToSignedInt<s16>(1, 16) == INT16_MAX);
-            REQUIRE(ScaleSampleToSignedInt<s16>(-1, 16) == INT16_MIN);
-            REQUIRE(ScaleSampleToSignedInt<s16>(0, 16) == 0);
-
-            REQUIRE(ScaleSampleToSignedInt<s32>(1, 32) == INT32_MAX);
-            REQUIRE(ScaleSampleToSignedInt<s32>(-1, 32) == INT32_MIN);
-            REQUIRE(ScaleSampleToSignedInt<s32>(0, 32) == 0);
-
-            REQUIRE(ScaleSampleToSignedInt<s32>(-1, 24) == -8388608);
-            REQUIRE(ScaleSampleToSignedInt<s32>(1, 24) == 8388607);
-            REQUIRE(ScaleSampleToSignedInt<s32>(0, 24) == 0);
-        }
-
-        SUBCASE("to signed buffer") {
-            SUBCASE("s32") {
-                const auto s = CreateSignedIntSamplesFromFloat<s32>({-1.0, 1.0, 0}, 32);
-                REQUIRE(s.size() == 3);
-                REQUIRE(s[0] == INT32_MIN);
-                REQUIRE(s[1] == INT32_MAX);
-                REQUIRE(s[2] == 0);
-            }
-            SUBCASE("s16") {
-                const auto s = CreateSignedIntSamplesFromFloat<s16>({-1.0, 1.0, 0}, 16);
-                REQUIRE(s.size() == 3);
-                REQUIRE(s[0] == INT16_MIN);
-                REQUIRE(s[1] == INT16_MAX);
-                REQUIRE(s[2] == 0);
-            }
+            const auto Quantise = [](double s, unsigned bits_per_sample) {
+                s32 result;
+                QuantiseSamples({&s, 1}, 1.0, bits_per_sample, &result);
+                return result;
+            };
+            REQUIRE(Quantise(1, 16) == INT16_MAX);
+            REQUIRE(Quantise(-1, 16) == INT16_MIN);
+            REQUIRE(Quantise(0, 16) == 0);
+
+            REQUIRE(Quantise(1, 32) == INT32_MAX);
+            REQUIRE(Quantise(-1, 32) == INT32_MIN);
+            REQUIRE(Quantise(0, 32) == 0);
+
+            REQUIRE(Quantise(-1, 24) == -8388608);
+            REQUIRE(Quantise(1, 24) == 8388607);
+            REQUIRE(Quantise(0, 24) == 0);
         }
 
-        SUBCASE("to unsigned buffer") {
-            const auto s = CreateUnsignedIntSamplesFromFloat<u8>({-1.0, 1.0}, 8);
-            REQUIRE(s.size() == 2);
-            REQUIRE(s[0] == 0);
-            REQUIRE(s[1] == UINT8_MAX);
+        SUBCASE("to unsigned buffer") { BufferConversionTest::Check<u8>({-1.0, 1.0}, 8, {0, UINT8_MAX}); }
+
+        SUBCASE("samples outside of the valid range scale the whole file down") {
+            BufferConversionTest::Check<s16>({-2.0, 0.5, 2.0}, 16, {INT16_MIN, 8192, INT16_MAX});
+            BufferConversionTest::Check<u8>({-1.0, 0.0, 2.0}, 24,
+                                            {0x00, 0x00, 0xc0, 0, 0, 0, 0xff, 0xff, 0x7f});
+            BufferConversionTest::Check<float>({2.0}, 32, {2.0f});
+        }
+
+        SUBCASE("files longer than a block") {
+            std::vector<double> buf;
+            std::vector<s16> expected;
+            for (usize i = 0; i < k_conversion_block_num_frames * 2 + 10; ++i) {
+                buf.push_back(std::sin((double)i * 0.01) * 0.5);
+                expected.push_back((s16)std::round(buf.back() * (buf.back() < 0 ? 32768 : 32767)));
+            }
+            BufferConversionTest::Check<s16>(buf, 16, expected);
         }
 
         SUBCASE("wave f64 to other bit depth conversion") {
@@ -1218,13 +1693,8 @@ TEST_CASE("[AudioData]") {
             }
 
             SUBCASE("to signed 24-bit data") {
-                std::vector<u8> expected_bytes;
-                for (const auto s : buf) {
-                    for (const auto byte : Convert24BitIntToBytes(ScaleSampleToSignedInt<s32>(s, 24))) {
-                        expected_bytes.push_back(byte);
-                    }
-                }
-                BufferConversionTest::Check<u8>(buf, 24, expected_bytes);
+                BufferConversionTest::Check<u8>(buf, 24,
+                                                {0x00, 0x00, 0x80, 0, 0, 0, 0xff, 0xff, 0x7f, 0, 0, 0});
             }
 
             SUBCASE("to 32-bit float data") {
@@ -1443,3 +1913,375 @@ TEST_CASE("[AudioData]") {
         }
     }
 }
+
+// Reads the samples in the way that ReadAudioFile used to: by getting dr_wav to decode the whole file to f32
+// and then converting that to double.
+static std::vector<double> ReadWavSamplesUsingDrwavF32(const fs::path &path) {
+    unsigned channels, sample_rate;
+    drwav_uint64 num_frames;
+    auto f32_buf = drwav_open_file_and_read_pcm_frames_f32(path.string().data(), &channels, &sample_rate,
+                                                           &num_frames, nullptr);
+    REQUIRE(f32_buf);
+    std::vector<double> result(f32_buf, f32_buf + num_frames * channels);
+    drwav_free(f32_buf, nullptr);
+    return result;
+}
+
+static const fs::path wav_decode_test_files[] = {
+    TEST_DATA_DIRECTORY "/test.wav",
+    TEST_DATA_DIRECTORY "/test_96khz_24bit.wav",
+    TEST_DATA_DIRECTORY "/test_192khz_24bit.wav",
+    TEST_DATA_DIRECTORY "/white-noise.wav",
+    TEST_DATA_DIRECTORY "/wav_with_bext.wav",
+};
+
+TEST_CASE("Reading WAV samples directly as double matches dr_wav") {
+    for (const auto &path : wav_decode_test_files) {
+        CAPTURE(path);
+        const auto audio = ReadAudioFile(path);
+        REQUIRE(audio);
+        const auto expected = ReadWavSamplesUsingDrwavF32(path);
+        REQUIRE(audio->interleaved_samples.size() == expected.size());
+        for (usize i = 0; i < expected.size(); ++i) {
+            // The only difference should be the precision that is lost by going through f32.
+            REQUIRE(std::abs(audio->interleaved_samples[i] - expected[i]) < 1e-7);
+        }
+    }
+}
+
+TEST_CASE("RF64 and Wave64 files") {
+    AudioData audio {};
+    audio.num_channels = 2;
+    audio.sample_rate = 44100;
+    audio.bits_per_sample = 16;
+    for (usize frame = 0; frame < 1000; ++frame) {
+        audio.interleaved_samples.push_back(std::round(std::sin((double)frame * 0.01) * 20000) / 32768);
+        audio.interleaved_samples.push_back(std::round(std::sin((double)frame * 0.02) * 10000) / 32768);
+    }
+
+    const auto ReadFourCC = [](const fs::path &path) {
+        char fourcc[4] {};
+        auto f = OpenFile(path, "rb");
+        REQUIRE(std::fread(fourcc, 1, 4, f.get()) == 4);
+        return std::string(fourcc, 4);
+    };
+
+    SUBCASE("the container is chosen from the size and the extension") {
+        drwav_data_format format {};
+        format.format = DR_WAVE_FORMAT_PCM;
+        format.channels = 2;
+        format.sampleRate = 44100;
+        format.bitsPerSample = 24;
+        CHECK(GetWaveContainer("file.wav", format, 1000, {}) == drwav_container_riff);
+        CHECK(GetWaveContainer("file.wav", format, (UINT32_MAX / 6) - 100, {}) == drwav_container_riff);
+        CHECK(GetWaveContainer("file.wav", format, (UINT32_MAX / 6) + 1, {}) == drwav_container_rf64);
+        CHECK(GetWaveContainer("file.w64", format, 1000, {}) == drwav_container_w64);
+    }
+
+    // The samples should be exactly the same as if they went through a normal WAV file.
+    REQUIRE(WriteAudioFile("container-test.wav", audio));
+    CHECK(ReadFourCC("container-test.wav") == "RIFF");
+    const auto expected = ReadAudioFile("container-test.wav");
+    REQUIRE(expected);
+
+    SUBCASE("wave64 round trip") {
+        REQUIRE(WriteAudioFile("container-test.w64", audio));
+        CHECK(ReadFourCC("container-test.w64") == "riff");
+        const auto result = ReadAudioFile("container-test.w64");
+        REQUIRE(result);
+        CHECK(result->format == AudioFileFormat::Wav);
+        CHECK(result->interleaved_samples == expected->interleaved_samples);
+    }
+
+    SUBCASE("rf64 files can be read") {
+        drwav_data_format format {};
+        format.container = drwav_container_rf64;
+        format.format = DR_WAVE_FORMAT_PCM;
+        format.channels = audio.num_channels;
+        format.sampleRate = audio.sample_rate;
+        format.bitsPerSample = audio.bits_per_sample;
+        {
+            auto f = OpenFile("container-test-rf64.wav", "wb");
+            REQUIRE(f);
+            drwav wav;
+            REQUIRE(drwav_init_write(&wav, &format, OnWrite, OnSeekFile, f.get(), nullptr));
+            std::vector<u8> samples(audio.interleaved_samples.size() * 2);
+            ConvertDoubleToPcm(PcmSampleType::SignedInt16, audio.interleaved_samples.data(),
+                               audio.interleaved_samples.size(), 1.0, samples.data());
+            REQUIRE(drwav_write_pcm_frames(&wav, audio.NumFrames(), samples.data()) == audio.NumFrames());
+            drwav_uninit(&wav);
+        }
+        CHECK(ReadFourCC("container-test-rf64.wav") == "RF64");
+        const auto result = ReadAudioFile("container-test-rf64.wav");
+        REQUIRE(result);
+        CHECK(result->interleaved_samples == expected->interleaved_samples);
+    }
+
+    SUBCASE("rf64 files larger than 4 GB") {
+        // Only the start and the end of the data chunk are written, so the file is sparse on most file
+        // systems and doesn't actually use 5 GB of disk space.
+        const fs::path path = "container-test-large-rf64.wav";
+        const u64 num_frames = 5ull * 1024 * 1024 * 1024 / 4;
+        const s16 first_frame[2] = {1000, -1000};
+        const s16 last_frame[2] = {1234, -1234};
+
+        drwav_data_format format {};
+        format.container = drwav_container_rf64;
+        format.format = DR_WAVE_FORMAT_PCM;
+        format.channels = 2;
+        format.sampleRate = 44100;
+        format.bitsPerSample = 16;
+        {
+            auto f = OpenFile(path, "wb");
+            REQUIRE(f);
+            drwav wav;
+            REQUIRE(drwav_init_write_sequential_pcm_frames(&wav, &format, num_frames, OnWrite, f.get(),
+                                                           nullptr));
+            REQUIRE(drwav_write_pcm_frames(&wav, 1, first_frame) == 1);
+            REQUIRE(SeekFile(f.get(), (s64)(wav.dataChunkDataPos + (num_frames - 1) * 4), SEEK_SET) == 0);
+            REQUIRE(std::fwrite(last_frame, sizeof(s16), 2, f.get()) == 2);
+            drwav_uninit(&wav);
+        }
+
+        const auto CheckFile = [&](drwav &wav) {
+            CHECK(wav.container == drwav_container_rf64);
+            REQUIRE(wav.totalPCMFrameCount == num_frames);
+            s16 frame[2] {};
+            REQUIRE(drwav_read_pcm_frames_s16(&wav, 1, frame) == 1);
+            CHECK(frame[0] == first_frame[0]);
+            REQUIRE(drwav_seek_to_pcm_frame(&wav, num_frames - 1));
+            REQUIRE(drwav_read_pcm_frames_s16(&wav, 1, frame) == 1);
+            CHECK(frame[1] == last_frame[1]);
+            drwav_uninit(&wav);
+        };
+
+        SUBCASE("through a FILE") {
+            auto f = OpenFile(path, "rb");
+            REQUIRE(f);
+            drwav wav;
+            REQUIRE(drwav_init_with_metadata(&wav, OnReadFile, OnSeekFile, f.get(), 0, nullptr));
+            CheckFile(wav);
+        }
+        SUBCASE("through a memory mapping") {
+            MappedFile mapped_file;
+            std::error_code ec;
+            REQUIRE(mapped_file.Map(path, ec));
+            drwav wav;
+            REQUIRE(
+                drwav_init_memory_with_metadata(&wav, mapped_file.Data(), mapped_file.Size(), 0, nullptr));
+            CheckFile(wav);
+        }
+        fs::remove(path);
+    }
+}
+
+TEST_CASE("Reading just the file info") {
+    for (const auto &entry : fs::directory_iterator(TEST_DATA_DIRECTORY)) {
+        const auto &path = entry.path();
+        if (!IsPathReadableAudioFile(path)) continue;
+        CAPTURE(path);
+
+        const auto audio = ReadAudioFile(path);
+        REQUIRE(audio);
+        const auto info = ReadAudioFileInfo(path);
+        REQUIRE(info);
+        const auto expected = GetAudioFileInfo(*audio);
+        CHECK(info->format == expected.format);
+        CHECK(info->num_channels == expected.num_channels);
+        CHECK(info->sample_rate == expected.sample_rate);
+        CHECK(info->bits_per_sample == expected.bits_per_sample);
+        CHECK(info->num_frames == expected.num_frames);
+        CHECK(info->metadata.midi_mapping.has_value() == expected.metadata.midi_mapping.has_value());
+        CHECK(info->metadata.timing_info == expected.metadata.timing_info);
+        CHECK(info->metadata.loops == expected.metadata.loops);
+        CHECK(info->metadata.markers == expected.metadata.markers);
+        CHECK(info->metadata.regions == expected.metadata.regions);
+    }
+
+    SUBCASE("signet metadata in FLAC files") {
+        auto audio = TestHelpers::CreateSineWaveAtFrequency(1, 44100, 0.1, 440);
+        audio.metadata.midi_mapping.emplace();
+        audio.metadata.midi_mapping->root_midi_note = 42;
+        REQUIRE(WriteAudioFile("file-info.flac", audio, 16));
+        const auto info = ReadAudioFileInfo("file-info.flac");
+        REQUIRE(info);
+        CHECK(info->format == AudioFileFormat::Flac);
+        CHECK(info->num_frames == audio.NumFrames());
+        REQUIRE(info->metadata.midi_mapping);
+        CHECK(info->metadata.midi_mapping->root_midi_note == 42);
+    }
+}
+
+TEST_CASE("Rewriting only the metadata") {
+    AudioData audio {};
+    audio.num_channels = 2;
+    audio.sample_rate = 44100;
+    audio.bits_per_sample = 16;
+    for (usize frame = 0; frame < 1001; ++frame) {
+        audio.interleaved_samples.push_back(std::round(std::sin((double)frame * 0.01) * 20000) / 32768);
+        audio.interleaved_samples.push_back(std::round(std::sin((double)frame * 0.02) * 10000) / 32768);
+    }
+
+    const auto ReadBytes = [](const fs::path &path) {
+        auto f = OpenFile(path, "rb");
+        REQUIRE(f);
+        std::string bytes((usize)GetFileSize(f.get()), '\0');
+        REQUIRE(std::fread(bytes.data(), 1, bytes.size(), f.get()) == bytes.size());
+        return bytes;
+    };
+    const auto SetMetadata = [](AudioData &data, int root_note, usize num_markers) {
+        data.metadata.midi_mapping.emplace();
+        data.metadata.midi_mapping->root_midi_note = root_note;
+        data.metadata.markers.clear();
+        for (usize i = 0; i < num_markers; ++i) {
+            data.metadata.markers.push_back({"marker " + std::to_string(i), i * 10});
+        }
+    };
+    const auto CheckFile = [&](const fs::path &path, const AudioData &expected, int root_note,
+                               usize num_markers) {
+        const auto result = ReadAudioFile(path);
+        REQUIRE(result);
+        CHECK(result->interleaved_samples == expected.interleaved_samples);
+        REQUIRE(result->metadata.midi_mapping);
+        CHECK(result->metadata.midi_mapping->root_midi_note == root_note);
+        CHECK(result->metadata.markers.size() == num_markers);
+        return *result;
+    };
+
+    SUBCASE("wav") {
+        const fs::path path = "metadata-rewrite.wav";
+        SetMetadata(audio, 60, 8);
+        REQUIRE(WriteAudioFile(path, audio));
+        auto original = *ReadAudioFile(path);
+        CHECK(original.metadata.markers.size() == 8);
+        const auto original_size = fs::file_size(path);
+
+        // Fewer markers so the new chunks are smaller, and the gap is filled in.
+        SetMetadata(original, 48, 2);
+        REQUIRE(RewriteAudioFileMetadata(path, original));
+        CHECK(fs::file_size(path) == original_size);
+        CHECK(ReadBytes(path).find("JUNK") != std::string::npos);
+        CheckFile(path, original, 48, 2);
+
+        // More markers than there's space for, so the data chunk has to be moved.
+        SetMetadata(original, 50, 20);
+        REQUIRE(RewriteAudioFileMetadata(path, original));
+        CHECK(fs::file_size(path) > original_size);
+        CHECK(!fs::exists("metadata-rewrite.wav.signet-temp"));
+        CheckFile(path, original, 50, 20);
+    }
+
+    SUBCASE("wav chunks that we don't read are kept") {
+        const fs::path path = "metadata-rewrite-bext.wav";
+        fs::copy_file(TEST_DATA_DIRECTORY "/wav_with_bext.wav", path, fs::copy_options::overwrite_existing);
+        auto original = ReadAudioFile(path);
+        REQUIRE(original);
+        SetMetadata(*original, 40, 1);
+        REQUIRE(RewriteAudioFileMetadata(path, *original));
+        CheckFile(path, *original, 40, 1);
+        CHECK(ReadBytes(path).find("bext") != std::string::npos);
+    }
+
+    SUBCASE("flac") {
+        const fs::path path = "metadata-rewrite.flac";
+        REQUIRE(WriteAudioFile(path, audio));
+        auto original = ReadAudioFile(path);
+        REQUIRE(original);
+
+        // The encoder doesn't write any padding, so the first time the file has to be rewritten.
+        SetMetadata(*original, 48, 2);
+        REQUIRE(RewriteAudioFileMetadata(path, *original));
+        CHECK(!fs::exists("metadata-rewrite.flac.signet-temp"));
+        const auto result = CheckFile(path, *original, 48, 2);
+        CHECK(std::any_of(result.flac_metadata.begin(), result.flac_metadata.end(),
+                          [](const auto &m) { return m->type == FLAC__METADATA_TYPE_PADDING; }));
+        const auto size_with_padding = fs::file_size(path);
+
+        // But after that there's padding that the changes can go into.
+        SetMetadata(*original, 50, 4);
+        REQUIRE(RewriteAudioFileMetadata(path, *original));
+        CHECK(fs::file_size(path) == size_with_padding);
+        CheckFile(path, *original, 50, 4);
+    }
+
+    SUBCASE("flac blocks that we don't read are kept") {
+        const fs::path path = "metadata-rewrite-comments.flac";
+        fs::copy_file(TEST_DATA_DIRECTORY "/flac_with_comments.flac", path,
+                      fs::copy_options::overwrite_existing);
+        auto original = ReadAudioFile(path);
+        REQUIRE(original);
+        SetMetadata(*original, 40, 1);
+        REQUIRE(RewriteAudioFileMetadata(path, *original));
+        const auto result = CheckFile(path, *original, 40, 1);
+        CHECK(std::any_of(result.flac_metadata.begin(), result.flac_metadata.end(),
+                          [](const auto &m) { return m->type == FLAC__METADATA_TYPE_VORBIS_COMMENT; }));
+    }
+
+    SUBCASE("other files are not rewritten") { CHECK(!RewriteAudioFileMetadata("file.w64", audio)); }
+}
+
+// Run with: tests --test-case="WAV decode benchmark" --no-skip
+TEST_CASE("WAV decode benchmark" * doctest::skip()) {
+    constexpr int num_iterations = 500;
+    const auto TimeMs = [&](const std::function<void()> &function) {
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < num_iterations; ++i) {
+            function();
+        }
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    for (const auto &path : {wav_decode_test_files[1], wav_decode_test_files[2]}) {
+        const auto messages_enabled = g_messages_enabled;
+        g_messages_enabled = false;
+        const auto via_f32_ms = TimeMs([&] { ReadWavSamplesUsingDrwavF32(path); });
+        const auto direct_ms = TimeMs([&] { ReadAudioFile(path); });
+        g_messages_enabled = messages_enabled;
+
+        MessageWithNewLine("Benchmark", path,
+                           "{} reads: via f32 {:.1f} ms, direct to double {:.1f} ms ({:.2f}x)",
+                           num_iterations, via_f32_ms, direct_ms, via_f32_ms / direct_ms);
+    }
+}
+
+// Run with: tests --test-case="FLAC decode benchmark" --no-skip
+TEST_CASE("FLAC decode benchmark" * doctest::skip()) {
+    const fs::path path = TEST_DATA_DIRECTORY "/sawtooth_unlooped.flac";
+    constexpr int num_iterations = 200;
+    const auto TimeMs = [&](const std::function<void()> &function) {
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < num_iterations; ++i) {
+            function();
+        }
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    // libFLAC decoding the file and discarding the samples, the fastest that reading could possibly be.
+    const auto raw_decode_ms = TimeMs([&] {
+        const auto file = OpenFile(path, "rb");
+        AudioData unused {};
+        FlacFileDataContext context(file.get(), unused);
+        std::unique_ptr<FLAC__StreamDecoder, decltype(&FLAC__stream_decoder_delete)> decoder(
+            FLAC__stream_decoder_new(), &FLAC__stream_decoder_delete);
+        const auto DiscardSamples = [](const FLAC__StreamDecoder *, const FLAC__Frame *,
+                                       const FLAC__int32 *const[], void *) {
+            return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+        };
+        const auto init_status = FLAC__stream_decoder_init_stream(
+            decoder.get(), FlacDecodeReadCallback, FlacDecodeSeekCallback, FlacDecodeTellCallback,
+            FlacDecodeLengthCallback, FlacDecodeIsEndOfFile, DiscardSamples, nullptr,
+            FlacStreamDecodeErrorCallback, &context);
+        REQUIRE(init_status == FLAC__STREAM_DECODER_INIT_STATUS_OK);
+        REQUIRE(FLAC__stream_decoder_process_until_end_of_stream(decoder.get()));
+        FLAC__stream_decoder_finish(decoder.get());
+    });
+
+    const auto messages_enabled = g_messages_enabled;
+    g_messages_enabled = false;
+    const auto read_ms = TimeMs([&] { ReadAudioFile(path); });
+    g_messages_enabled = messages_enabled;
+
+    MessageWithNewLine("Benchmark", path,
+                       "{} reads: libFLAC only {:.1f} ms, ReadAudioFile {:.1f} ms ({:.0f}%)", num_iterations,
+                       raw_decode_ms, read_ms, 100.0 * raw_decode_ms / read_ms);
+}
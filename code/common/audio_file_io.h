@@ -5,11 +5,29 @@
 
 #include "audio_data.h"
 
+// The parts of an audio file that are stored in its headers, so they can be read without decoding any of the
+// audio.
+struct AudioFileInfo {
+    AudioFileFormat format {};
+    unsigned num_channels {};
+    unsigned sample_rate {};
+    unsigned bits_per_sample {};
+    u64 num_frames {};
+    Metadata metadata {};
+};
+
 std::optional<AudioData> ReadAudioFile(const fs::path &filename);
+std::optional<AudioFileInfo> ReadAudioFileInfo(const fs::path &filename);
+AudioFileInfo GetAudioFileInfo(const AudioData &audio_data);
 bool WriteAudioFile(const fs::path &filename,
                     const AudioData &audio_data,
                     const std::optional<unsigned> new_bits_per_sample = {});
 
+// Writes the metadata of audio_data into an existing file without re-encoding the audio. The audio in the
+// file must be the same as the audio in audio_data. Returns false if the file could not be rewritten like
+// this, in which case it should be written with WriteAudioFile instead.
+bool RewriteAudioFileMetadata(const fs::path &filename, const AudioData &audio_data);
+
 bool CanFileBeConvertedToBitDepth(AudioFileFormat file, unsigned bit_depth);
 bool IsPathReadableAudioFile(const fs::path &path);
 std::string GetLowercaseExtension(AudioFileFormat file);
@@ -1,11 +1,14 @@
 #include "audio_files.h"
 
+#include <fstream>
+
 #include "CLI11.hpp"
 #include "doctest.hpp"
 
 #include "backup.h"
 #include "common.h"
 #include "filepath_set.h"
+#include "tests_config.h"
 
 AudioFiles::AudioFiles(const std::vector<std::string> &path_items, const bool recursive_directory_search) {
     std::string parse_error;
@@ -26,8 +29,8 @@ AudioFiles::AudioFiles(const std::vector<std::string> &path_items, const bool re
     ReadAllAudioFiles(*all_matched_filepaths);
 }
 
-AudioFiles::AudioFiles(const tcb::span<EditTrackedAudioFile> files) {
-    m_all_files.assign(files.begin(), files.end());
+AudioFiles::AudioFiles(std::vector<EditTrackedAudioFile> files) {
+    m_all_files = std::move(files);
     CreateFoldersDataStructure();
 }
 
@@ -81,6 +84,79 @@ static fs::path PathWithNewExtension(fs::path path, AudioFileFormat format) {
     return path;
 }
 
+fs::path AudioFiles::GetWrittenPath(EditTrackedAudioFile &file) {
+    if (file.FormatChanged()) return PathWithNewExtension(file.GetPath(), file.GetInfo().format);
+    if (file.AudioChanged() || file.PathChanged()) return file.GetPath();
+    return file.OriginalPath();
+}
+
+bool AudioFiles::WriteFileIfEdited(EditTrackedAudioFile &file, SignetBackup &backup, bool create_copies) {
+    const bool file_data_changed = file.AudioChanged();
+    const bool file_renamed = file.PathChanged();
+    const bool file_format_changed = file.FormatChanged();
+
+    if (file_renamed) {
+        if (!file_data_changed && !file_format_changed) {
+            // only renamed
+            if (!create_copies) {
+                if (!backup.MoveFile(file.OriginalPath(), file.GetPath())) {
+                    return false;
+                }
+            } else {
+                // The file on disk is already what we want, so it is copied as it is rather than decoded and
+                // encoded again.
+                if (!backup.CopyFile(file.OriginalPath(), file.GetPath(), true)) {
+                    return false;
+                }
+            }
+        } else if ((!file_data_changed && file_format_changed) ||
+                   (file_data_changed && file_format_changed)) {
+            // renamed and new format
+            if (!backup.CreateFile(PathWithNewExtension(file.GetPath(), file.GetAudio().format),
+                                   file.GetAudio(), true)) {
+                return false;
+            }
+            if (!create_copies && !backup.DeleteFile(file.OriginalPath())) {
+                return false;
+            }
+        } else if (file_data_changed && !file_format_changed) {
+            // renamed and new data
+            if (!backup.CreateFile(file.GetPath(), file.GetAudio(), true)) {
+                return false;
+            }
+            if (!create_copies && !backup.DeleteFile(file.OriginalPath())) {
+                return false;
+            }
+        }
+    } else {
+        REQUIRE(file.GetPath() == file.OriginalPath());
+        if ((file_format_changed && !file_data_changed) || (file_format_changed && file_data_changed)) {
+            // only new format
+            if (!backup.CreateFile(PathWithNewExtension(file.OriginalPath(), file.GetAudio().format),
+                                   file.GetAudio(), false)) {
+                return false;
+            }
+            if (!create_copies && !backup.DeleteFile(file.OriginalPath())) {
+                return false;
+            }
+        } else if (!file_format_changed && file_data_changed) {
+            // only new data
+            if (!create_copies) {
+                const bool overwritten =
+                    file.OnlyMetadataChanged()
+                        ? backup.OverwriteFileMetadata(file.OriginalPath(), file.GetAudio())
+                        : backup.OverwriteFile(file.OriginalPath(), file.GetAudio());
+                if (!overwritten) return false;
+            } else {
+                if (!backup.CreateFile(file.OriginalPath(), file.GetAudio(), true)) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
 bool AudioFiles::WriteFilesThatHaveBeenEdited(SignetBackup &backup, bool create_copies) {
     if (WouldWritingAllFilesCreateConflicts()) {
         return false;
@@ -88,74 +164,9 @@ bool AudioFiles::WriteFilesThatHaveBeenEdited(SignetBackup &backup, bool create_
 
     bool error_occurred = false;
     for (auto &file : m_all_files) {
-        const bool file_data_changed = file.AudioChanged();
-        const bool file_renamed = file.PathChanged();
-        const bool file_format_changed = file.FormatChanged();
-
-        if (file_renamed) {
-            if (!file_data_changed && !file_format_changed) {
-                // only renamed
-                if (!create_copies) {
-                    if (!backup.MoveFile(file.OriginalPath(), file.GetPath())) {
-                        error_occurred = true;
-                        break;
-                    }
-                } else {
-                    if (!backup.CreateFile(file.GetPath(), file.GetAudio(), true)) {
-                        error_occurred = true;
-                        break;
-                    }
-                }
-            } else if ((!file_data_changed && file_format_changed) ||
-                       (file_data_changed && file_format_changed)) {
-                // renamed and new format
-                if (!backup.CreateFile(PathWithNewExtension(file.GetPath(), file.GetAudio().format),
-                                       file.GetAudio(), true)) {
-                    error_occurred = true;
-                    break;
-                }
-                if (!create_copies && !backup.DeleteFile(file.OriginalPath())) {
-                    error_occurred = true;
-                    break;
-                }
-            } else if (file_data_changed && !file_format_changed) {
-                // renamed and new data
-                if (!backup.CreateFile(file.GetPath(), file.GetAudio(), true)) {
-                    error_occurred = true;
-                    break;
-                }
-                if (!create_copies && !backup.DeleteFile(file.OriginalPath())) {
-                    error_occurred = true;
-                    break;
-                }
-            }
-        } else {
-            REQUIRE(file.GetPath() == file.OriginalPath());
-            if ((file_format_changed && !file_data_changed) || (file_format_changed && file_data_changed)) {
-                // only new format
-                if (!backup.CreateFile(PathWithNewExtension(file.OriginalPath(), file.GetAudio().format),
-                                       file.GetAudio(), false)) {
-                    error_occurred = true;
-                    break;
-                }
-                if (!create_copies && !backup.DeleteFile(file.OriginalPath())) {
-                    error_occurred = true;
-                    break;
-                }
-            } else if (!file_format_changed && file_data_changed) {
-                // only new data
-                if (!create_copies) {
-                    if (!backup.OverwriteFile(file.OriginalPath(), file.GetAudio())) {
-                        error_occurred = true;
-                        break;
-                    }
-                } else {
-                    if (!backup.CreateFile(file.OriginalPath(), file.GetAudio(), true)) {
-                        error_occurred = true;
-                        break;
-                    }
-                }
-            }
+        if (!WriteFileIfEdited(file, backup, create_copies)) {
+            error_occurred = true;
+            break;
         }
     }
 
@@ -167,3 +178,24 @@ bool AudioFiles::WriteFilesThatHaveBeenEdited(SignetBackup &backup, bool create_
 
     return !error_occurred;
 }
+
+TEST_CASE("Files that are only renamed are copied as they are") {
+    const auto ReadBytes = [](const fs::path &path) {
+        std::ifstream stream(path.generic_string(), std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(stream), {});
+    };
+
+    // A full write would drop the bext chunk, so if the bytes are the same the file was copied.
+    const fs::path original = "renamed-copy-original.wav";
+    const fs::path renamed = "renamed-copy/renamed.wav";
+    fs::copy_file(TEST_DATA_DIRECTORY "/wav_with_bext.wav", original, fs::copy_options::overwrite_existing);
+    fs::remove(renamed);
+
+    EditTrackedAudioFile file(original);
+    file.SetPath(renamed);
+    CHECK(file.GetInfo().num_frames != 0);
+
+    SignetBackup backup;
+    REQUIRE(AudioFiles::WriteFileIfEdited(file, backup, true));
+    CHECK(ReadBytes(renamed) == ReadBytes(original));
+}
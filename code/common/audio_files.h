@@ -14,8 +14,8 @@ class AudioFiles {
     // Passes path_items to FilepathSet to construct the list of audio files
     AudioFiles(const std::vector<std::string> &path_items, const bool recursive_directory_search);
 
-    // Simply copies the EditTrackedAudioFile
-    AudioFiles(const tcb::span<EditTrackedAudioFile> files);
+    // Takes the EditTrackedAudioFiles; move the vector in so that their audio isn't copied
+    AudioFiles(std::vector<EditTrackedAudioFile> files);
 
     //
     // Files are typically read from the underlying vector with these methods.
@@ -39,6 +39,10 @@ class AudioFiles {
     //
     //
     bool WriteFilesThatHaveBeenEdited(SignetBackup &backup, bool create_copies);
+    static bool WriteFileIfEdited(EditTrackedAudioFile &file, SignetBackup &backup, bool create_copies);
+    // The path of the file that WriteFileIfEdited writes; the original path if the file is not written.
+    static fs::path GetWrittenPath(EditTrackedAudioFile &file);
+    bool WouldWritingAllFilesCreateConflicts();
     int GetNumFilesProcessed() const {
         int n = 0;
         for (const auto &f : m_all_files) {
@@ -51,7 +55,6 @@ class AudioFiles {
 
   private:
     void ReadAllAudioFiles(const FilepathSet &paths);
-    bool WouldWritingAllFilesCreateConflicts();
     void CreateFoldersDataStructure();
 
     std::vector<EditTrackedAudioFile> m_all_files {};
@@ -1,6 +1,6 @@
 #include "backup.h"
 
-#include <iomanip>
+#include <fstream>
 #include <iostream>
 
 #include "doctest.hpp"
@@ -10,7 +10,7 @@
 #include "test_helpers.h"
 #include "tests_config.h"
 
-static fs::path GetTempDir() {
+fs::path GetTempDir() {
     try {
         const auto temp_dir = fs::temp_directory_path();
         return temp_dir;
@@ -45,6 +45,22 @@ static bool CreateDirectoriesChecked(const fs::path &dir) {
     return true;
 }
 
+// The journal is synced to the disk after this many entries rather than after every one. Each entry is still
+// handed to the OS as soon as it is written, so entries can only be lost if the OS itself stops.
+static constexpr int k_journal_entries_per_sync = 64;
+
+// Each entry in the journal is a line of JSON that describes one change to the database.
+static void ApplyJournalEntry(nlohmann::json &database, const nlohmann::json &entry) {
+    const auto type = entry.at("type").get<std::string>();
+    if (type == "file") {
+        database["files"][entry.at("hash").get<std::string>()] = entry.at("path");
+    } else if (type == "move") {
+        database["file_moves"][entry.at("from").get<std::string>()] = entry.at("to");
+    } else if (type == "created") {
+        database["files_created"].push_back(entry.at("path"));
+    }
+}
+
 SignetBackup::SignetBackup() {
     m_backup_dir = GetTempDir() / "signet-backup";
     if (!fs::is_directory(m_backup_dir)) {
@@ -53,6 +69,7 @@ SignetBackup::SignetBackup() {
 
     m_backup_files_dir = m_backup_dir / "files";
     m_database_file = m_backup_dir / "backup.json";
+    m_journal_file = m_backup_dir / "backup-journal.jsonl";
     if (fs::is_regular_file(m_database_file)) {
         try {
             std::ifstream i(m_database_file.generic_string(), std::ofstream::in | std::ofstream::binary);
@@ -68,6 +85,21 @@ SignetBackup::SignetBackup() {
                                e.what());
         }
     }
+
+    // The journal is only still there if the last run did not finish.
+    if (fs::is_regular_file(m_journal_file)) {
+        std::ifstream i(m_journal_file.generic_string(), std::ifstream::in | std::ifstream::binary);
+        std::string line;
+        while (std::getline(i, line)) {
+            try {
+                ApplyJournalEntry(m_database, nlohmann::json::parse(line));
+                m_parsed_json = true;
+            } catch (const nlohmann::json::exception &) {
+                // The last entry is incomplete if Signet was stopped while it was being written.
+                break;
+            }
+        }
+    }
 }
 
 bool SignetBackup::LoadBackup() {
@@ -121,6 +153,11 @@ void SignetBackup::ClearBackup() {
     if (fs::is_regular_file(m_database_file)) {
         fs::remove(m_database_file);
     }
+    m_journal.reset();
+    m_num_unsynced_journal_entries = 0;
+    if (fs::is_regular_file(m_journal_file)) {
+        fs::remove(m_journal_file);
+    }
     m_database = {};
 }
 
@@ -132,14 +169,56 @@ void SignetBackup::ClearOldBackIfNeeded() {
     }
 }
 
-bool SignetBackup::WriteDatabaseFile() {
-    std::ofstream o(m_database_file.generic_string(), std::ofstream::out | std::ofstream::binary);
-    if (!o) {
-        ErrorWithNewLine("Signet", {}, "Could not write to backup database file {}", m_database_file);
+bool SignetBackup::AppendToJournal(const nlohmann::json &entry) {
+    if (!m_journal) {
+        std::error_code ec;
+        m_journal.reset(OpenFileRaw(m_journal_file, "ab", &ec));
+        if (!m_journal) {
+            ErrorWithNewLine("Signet", {}, "Could not open backup journal file {} for reason: {}",
+                             m_journal_file, ec.message());
+            return false;
+        }
+    }
+
+    const auto line = entry.dump() + '\n';
+    if (std::fwrite(line.data(), 1, line.size(), m_journal.get()) != line.size() ||
+        std::fflush(m_journal.get()) != 0) {
+        ErrorWithNewLine("Signet", {}, "Could not write to backup journal file {}", m_journal_file);
         return false;
     }
-    o << std::setw(2) << m_database << std::endl;
-    o.close();
+    // The database is only changed once the entry is in the journal, so that the two never disagree.
+    ApplyJournalEntry(m_database, entry);
+    if (++m_num_unsynced_journal_entries == k_journal_entries_per_sync) {
+        SyncFile(m_journal.get());
+        m_num_unsynced_journal_entries = 0;
+    }
+    return true;
+}
+
+bool SignetBackup::CompactJournal() {
+    if (!m_journal && !fs::is_regular_file(m_journal_file)) return true;
+    m_journal.reset();
+    m_num_unsynced_journal_entries = 0;
+
+    // The database is written to a temporary file which then replaces the old one, so if this is stopped part
+    // way through, the old database and the journal are both still there.
+    auto temp_file = m_database_file;
+    temp_file += ".tmp";
+    std::string text;
+    try {
+        text = m_database.dump(2) + '\n';
+    } catch (const nlohmann::json::exception &) {
+        return false;
+    }
+    auto file = OpenFileRaw(temp_file, "wb");
+    if (!file) return false;
+    const bool written = std::fwrite(text.data(), 1, text.size(), file) == text.size() && SyncFile(file);
+    if (std::fclose(file) != 0 || !written) return false;
+
+    std::error_code ec;
+    fs::rename(temp_file, m_database_file, ec);
+    if (ec) return false;
+    fs::remove(m_journal_file, ec);
     return true;
 }
 
@@ -153,15 +232,13 @@ bool SignetBackup::CreateBackupFilesDirIfNeeded() {
 bool SignetBackup::AddNewlyCreatedFileToBackup(const fs::path &path) {
     if (!CreateBackupFilesDirIfNeeded()) return false;
 
-    m_database["files_created"].push_back(path.generic_string());
-    return WriteDatabaseFile();
+    return AppendToJournal({{"type", "created"}, {"path", path.generic_string()}});
 }
 
 bool SignetBackup::AddMovedFileToBackup(const fs::path &from, const fs::path &to) {
     if (!CreateBackupFilesDirIfNeeded()) return false;
 
-    m_database["file_moves"][from.generic_string()] = to.generic_string();
-    return WriteDatabaseFile();
+    return AppendToJournal({{"type", "move"}, {"from", from.generic_string()}, {"to", to.generic_string()}});
 }
 
 bool SignetBackup::AddFileToBackup(const fs::path &path) {
@@ -176,8 +253,7 @@ bool SignetBackup::AddFileToBackup(const fs::path &path) {
                          e.path1(), e.path2(), e.what());
         return false;
     }
-    m_database["files"][hash_string] = path.generic_string();
-    return WriteDatabaseFile();
+    return AppendToJournal({{"type", "file"}, {"hash", hash_string}, {"path", path.generic_string()}});
 }
 
 static bool CreateParentDirectories(const fs::path &path) {
@@ -247,6 +323,30 @@ bool SignetBackup::CreateFile(const fs::path &path, const AudioData &data, bool
     return AddNewlyCreatedFileToBackup(path);
 }
 
+bool SignetBackup::CopyFile(const fs::path &from, const fs::path &to, bool create_directories) {
+    ClearOldBackIfNeeded();
+    if (!CheckForValidPath(to)) return false;
+    if (create_directories) {
+        if (!CreateParentDirectories(to)) return false;
+    }
+    const bool overwriting = fs::exists(to);
+    if (overwriting && !AddFileToBackup(to)) return false;
+
+    MessageWithNewLine("Signet", to, "Copying file from {}", from);
+    {
+        const auto in = OpenFile(from, "rb");
+        const auto out = OpenFile(to, "wb");
+        if (!in || !out) return false;
+        const auto size = GetFileSize(in.get());
+        if (size < 0 || !CopyFileBytes(in.get(), out.get(), (u64)size)) {
+            ErrorWithNewLine("Signet", to, "Could not copy the file from {}", from);
+            return false;
+        }
+    }
+    if (overwriting) return true;
+    return AddNewlyCreatedFileToBackup(to);
+}
+
 bool SignetBackup::OverwriteFile(const fs::path &path, const AudioData &data) {
     ClearOldBackIfNeeded();
     if (!AddFileToBackup(path)) return false;
@@ -254,6 +354,15 @@ bool SignetBackup::OverwriteFile(const fs::path &path, const AudioData &data) {
     return WriteFile(path, data);
 }
 
+// The file on disk must already contain the same audio as data.
+bool SignetBackup::OverwriteFileMetadata(const fs::path &path, const AudioData &data) {
+    ClearOldBackIfNeeded();
+    if (!AddFileToBackup(path)) return false;
+    MessageWithNewLine("Signet", path, "Overwriting file metadata");
+    if (RewriteAudioFileMetadata(path, data)) return true;
+    return WriteFile(path, data);
+}
+
 TEST_CASE("[SignetBackup]") {
     const std::string filename = "backup_file.wav";
 
@@ -300,3 +409,47 @@ TEST_CASE("[SignetBackup]") {
         REQUIRE(!silent);
     }
 }
+
+TEST_CASE("Backup journal") {
+    const std::string filename = "backup_journal_file.wav";
+    const auto journal_file = GetTempDir() / "signet-backup" / "backup-journal.jsonl";
+    const auto database_file = GetTempDir() / "signet-backup" / "backup.json";
+    const auto buf = TestHelpers::CreateSineWaveAtFrequency(1, 44100, 0.25, 440);
+    REQUIRE(WriteAudioFile(filename, buf));
+
+    const auto ChangeFileAndLoadBackup = [&]() {
+        REQUIRE(WriteAudioFile(filename, TestHelpers::CreateSingleOscillationSineWave(1, 44100, 100)));
+        SignetBackup b;
+        REQUIRE(b.LoadBackup());
+        const auto file_data = ReadAudioFile(filename);
+        REQUIRE(file_data);
+        CHECK(file_data->interleaved_samples.size() == buf.interleaved_samples.size());
+    };
+
+    {
+        SignetBackup b;
+        b.ClearBackup();
+        REQUIRE(b.AddFileToBackup(filename));
+        CHECK(fs::is_regular_file(journal_file));
+        CHECK(!fs::exists(database_file));
+    }
+
+    SUBCASE("the journal is replayed if it was not compacted") {
+        // An entry that was only partly written.
+        {
+            std::ofstream journal(journal_file.generic_string(), std::ofstream::app | std::ofstream::binary);
+            journal << "{\"type\":\"fi";
+        }
+        ChangeFileAndLoadBackup();
+    }
+
+    SUBCASE("compacting") {
+        {
+            SignetBackup b;
+            REQUIRE(b.CompactJournal());
+        }
+        CHECK(!fs::exists(journal_file));
+        CHECK(fs::is_regular_file(database_file));
+        ChangeFileAndLoadBackup();
+    }
+}
@@ -1,20 +1,32 @@
 #pragma once
+#include <cstdio>
+#include <memory>
 
 #include "filesystem.hpp"
 #include "json.hpp"
 
 struct AudioData;
 
+// The OS's temporary folder, or the current working directory if it cannot be found.
+fs::path GetTempDir();
+
 class SignetBackup {
   public:
     SignetBackup();
     bool LoadBackup();
     void ClearBackup();
 
+    // Each change to the backup is appended to a journal rather than rewriting the whole database. This
+    // writes the database with the journal's changes in it, and removes the journal; it should be called
+    // once the run has finished. If it is not, the journal is replayed the next time the backup is read.
+    bool CompactJournal();
+
     bool DeleteFile(const fs::path &path);
     bool MoveFile(const fs::path &from, const fs::path &to);
     bool CreateFile(const fs::path &path, const AudioData &data, bool create_directories);
+    bool CopyFile(const fs::path &from, const fs::path &to, bool create_directories);
     bool OverwriteFile(const fs::path &path, const AudioData &data);
+    bool OverwriteFileMetadata(const fs::path &path, const AudioData &data);
 
     bool AddFileToBackup(const fs::path &path);
 
@@ -22,13 +34,16 @@ class SignetBackup {
     bool AddMovedFileToBackup(const fs::path &from, const fs::path &to);
     bool AddNewlyCreatedFileToBackup(const fs::path &path);
 
-    bool WriteDatabaseFile();
+    bool AppendToJournal(const nlohmann::json &entry);
     bool CreateBackupFilesDirIfNeeded();
 
     void ClearOldBackIfNeeded();
 
     bool m_old_backup_cleared {false};
     fs::path m_database_file {};
+    fs::path m_journal_file {};
+    std::unique_ptr<FILE, void (*)(FILE *)> m_journal {nullptr, [](FILE *f) { std::fclose(f); }};
+    int m_num_unsynced_journal_entries {};
     fs::path m_backup_dir {};
     fs::path m_backup_files_dir {};
     nlohmann::json m_database {};
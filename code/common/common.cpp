@@ -1,15 +1,19 @@
 #include "common.h"
 
 #include <regex>
+#include <sys/stat.h>
 #include <system_error>
 
 #if WIN32
+#include <io.h>
 #include <windows.h>
+#else
+#include <sys/types.h>
+#include <unistd.h>
 #endif
 
 #include "doctest.hpp"
 #include "filesystem.hpp"
-#include "fmt/color.h"
 
 #include "edit_tracked_audio_file.h"
 #include "types.h"
@@ -17,86 +21,9 @@
 bool g_messages_enabled = true;
 bool g_warnings_as_errors = false;
 
-bool EnableVTMode() {
-#if WIN32
-    // Set output mode to handle virtual terminal sequences
-    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
-    if (hOut == INVALID_HANDLE_VALUE) {
-        return false;
-    }
-
-    DWORD dwMode = 0;
-    if (!GetConsoleMode(hOut, &dwMode)) {
-        return false;
-    }
-
-    dwMode |= ENABLE_VIRTUAL_TERMINAL_PROCESSING;
-    if (!SetConsoleMode(hOut, dwMode)) {
-        return false;
-    }
-#endif
-    return true;
-}
-
-void InitConsole() {
-    struct Obj {
-        Obj() { EnableVTMode(); }
-    };
-    static Obj obj;
-}
-
-void PrintFilename(const EditTrackedAudioFile &f) {
-    InitConsole();
-    fmt::print(": ");
-    fmt::print(fg(fmt::color::navajo_white), "{}", f.OriginalFilename());
-}
-void PrintFilename(const fs::path &path) {
-    InitConsole();
-    fmt::print(": ");
-    fmt::print(fg(fmt::color::navajo_white), "{}", GetJustFilenameWithNoExtension(path));
-}
-void PrintFilename(NoneType) {}
-
-void PrintErrorPrefix(std::string_view heading) {
-    InitConsole();
-    fmt::print(fmt::fg(fmt::color::red) | fmt::emphasis::bold, "[{}] ERROR", heading);
-    fmt::print(": ");
-}
-void PrintWarningPrefix(std::string_view heading) {
-    InitConsole();
-    fmt::print(fmt::fg(fmt::color::orange) | fmt::emphasis::bold, "[{}] WARNING", heading);
-    fmt::print(": ");
-}
-void PrintMessagePrefix(const std::string_view heading) {
-    InitConsole();
-    fmt::print(fmt::fg(fmt::color::cornflower_blue) | fmt::emphasis::bold, "[{}]", heading);
-    fmt::print(": ");
-}
-
-void PrintDebugPrefix() { fmt::print(fmt::emphasis::bold, "[DEBUG]: "); }
-
-void ForEachDeinterleavedChannel(
-    const std::vector<double> &interleaved_samples,
-    const unsigned num_channels,
-    std::function<void(const std::vector<double> &, unsigned channel)> callback) {
-
-    if (num_channels == 1) {
-        callback(interleaved_samples, 0);
-        return;
-    }
-
-    const auto num_frames = interleaved_samples.size() / num_channels;
-    std::vector<double> channel_buffer;
-    channel_buffer.reserve(num_frames);
-    for (unsigned chan = 0; chan < num_channels; ++chan) {
-        channel_buffer.clear();
-        for (size_t frame = 0; frame < num_frames; ++frame) {
-            channel_buffer.push_back(interleaved_samples[frame * num_channels + chan]);
-        }
-
-        callback(channel_buffer, chan);
-    }
-}
+std::string GetLogFilename(const EditTrackedAudioFile &f) { return f.OriginalFilename(); }
+std::string GetLogFilename(const fs::path &path) { return GetJustFilenameWithNoExtension(path); }
+std::string GetLogFilename(NoneType) { return {}; }
 
 double GetCentsDifference(const double pitch1_hz, const double pitch2_hz) {
     if (pitch1_hz == 0) {
@@ -162,9 +89,102 @@ std::unique_ptr<FILE, void (*)(FILE *)> OpenFile(const fs::path &path, const cha
     return {nullptr, SafeFClose};
 }
 
+#if !_WIN32
+static_assert(sizeof(off_t) >= 8, "large file support is needed for files over 2 GB");
+#endif
+
+int SeekFile(FILE *file, s64 offset, int origin) {
+#if _WIN32
+    return _fseeki64(file, offset, origin);
+#else
+    return fseeko(file, (off_t)offset, origin);
+#endif
+}
+
+s64 TellFile(FILE *file) {
+#if _WIN32
+    return _ftelli64(file);
+#else
+    return (s64)ftello(file);
+#endif
+}
+
+s64 GetFileSize(FILE *file) {
+#if _WIN32
+    struct _stat64 file_stats;
+    if (_fstat64(_fileno(file), &file_stats) != 0) return -1;
+#else
+    struct stat file_stats;
+    if (fstat(fileno(file), &file_stats) != 0) return -1;
+#endif
+    return (s64)file_stats.st_size;
+}
+
+bool SyncFile(FILE *file) {
+    if (std::fflush(file) != 0) return false;
+#if _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+bool CopyFileBytes(FILE *from, FILE *to, u64 num_bytes) {
+#if __linux__
+    // copy_file_range lets the kernel copy the bytes without them passing through this process, and on some
+    // file systems the data blocks are just shared rather than copied.
+    if (std::fflush(to) == 0) {
+        auto from_offset = (off_t)TellFile(from);
+        auto to_offset = (off_t)TellFile(to);
+        while (num_bytes) {
+            const auto copied =
+                copy_file_range(fileno(from), &from_offset, fileno(to), &to_offset, (size_t)num_bytes, 0);
+            if (copied <= 0) break;
+            num_bytes -= (u64)copied;
+        }
+        if (SeekFile(from, from_offset, SEEK_SET) != 0 || SeekFile(to, to_offset, SEEK_SET) != 0) {
+            return false;
+        }
+        if (num_bytes == 0) return true;
+    }
+#endif
+
+    std::vector<u8> buffer(std::min<u64>(num_bytes, 1024 * 1024));
+    while (num_bytes) {
+        const auto size = (size_t)std::min<u64>(num_bytes, buffer.size());
+        if (std::fread(buffer.data(), 1, size, from) != size) return false;
+        if (std::fwrite(buffer.data(), 1, size, to) != size) return false;
+        num_bytes -= size;
+    }
+    return true;
+}
+
 TEST_CASE("Common") {
     {
         REQUIRE(GetFreqWithCentDifference(100, 1200) == 200);
         REQUIRE(GetFreqWithCentDifference(100, -1200) == 50);
     }
+
+    SUBCASE("64-bit file offsets") {
+        // The file is sparse on most file systems, so this doesn't actually use 5 GB of disk space.
+        const fs::path path = "large-sparse-file.bin";
+        const s64 large_offset = 5ll * 1024 * 1024 * 1024;
+        {
+            auto f = OpenFile(path, "wb");
+            REQUIRE(f);
+            REQUIRE(SeekFile(f.get(), large_offset, SEEK_SET) == 0);
+            REQUIRE(std::fputc('x', f.get()) == 'x');
+            CHECK(TellFile(f.get()) == large_offset + 1);
+        }
+        {
+            auto f = OpenFile(path, "rb");
+            REQUIRE(f);
+            CHECK(GetFileSize(f.get()) == large_offset + 1);
+            REQUIRE(SeekFile(f.get(), large_offset, SEEK_SET) == 0);
+            CHECK(std::fgetc(f.get()) == 'x');
+            REQUIRE(SeekFile(f.get(), -1, SEEK_CUR) == 0);
+            CHECK(TellFile(f.get()) == large_offset);
+        }
+        fs::remove(path);
+    }
 }
@@ -10,6 +10,8 @@
 #include <fmt/core.h>
 
 #include "filesystem.hpp"
+#include "logging.h"
+#include "types.h"
 
 extern bool g_messages_enabled;
 extern bool g_warnings_as_errors;
@@ -26,11 +28,6 @@ struct fmt::formatter<fs::path> {
     }
 };
 
-void PrintErrorPrefix(std::string_view heading);
-void PrintWarningPrefix(std::string_view heading);
-void PrintMessagePrefix(std::string_view heading);
-void PrintDebugPrefix();
-
 struct NoneType {};
 
 struct SignetError : public std::runtime_error {
@@ -40,19 +37,17 @@ struct SignetWarning : public std::runtime_error {
     SignetWarning(const std::string &str) : std::runtime_error(str) {}
 };
 
-void PrintFilename(const EditTrackedAudioFile &f);
-void PrintFilename(fs::path &path);
-void PrintFilename(NoneType n);
+std::string GetLogFilename(const EditTrackedAudioFile &f);
+std::string GetLogFilename(const fs::path &path);
+std::string GetLogFilename(NoneType n);
 
 template <typename NameType = NoneType, typename... Args>
 void ErrorWithNewLine(std::string_view heading,
                       const NameType &f,
                       std::string_view format,
                       const Args &...args) {
-    PrintErrorPrefix(heading);
-    fmt::vprint(format, fmt::make_format_args(args...));
-    PrintFilename(f);
-    fmt::print("\n");
+    Log({LogLevel::Error, std::string(heading), GetLogFilename(f),
+         fmt::vformat(format, fmt::make_format_args(args...))});
     throw SignetError("A fatal error occurred");
 }
 
@@ -61,10 +56,8 @@ void WarningWithNewLine(std::string_view heading,
                         const NameType &f,
                         std::string_view format,
                         Args &&...args) {
-    PrintWarningPrefix(heading);
-    fmt::vprint(format, fmt::make_format_args(args...));
-    PrintFilename(f);
-    fmt::print("\n");
+    Log({LogLevel::Warning, std::string(heading), GetLogFilename(f),
+         fmt::vformat(format, fmt::make_format_args(args...))});
     if (g_warnings_as_errors)
         throw SignetWarning("A warning occurred, and warnings are set to be treated as errors");
 }
@@ -74,20 +67,17 @@ void MessageWithNewLine(std::string_view heading,
                         const NameType &f,
                         std::string_view format,
                         Args &&...args) {
+    // Nothing is formatted at all if messages are disabled.
     if (g_messages_enabled) {
-        PrintMessagePrefix(heading);
-        fmt::vprint(format, fmt::make_format_args(args...));
-        PrintFilename(f);
-        fmt::print("\n");
+        Log({LogLevel::Message, std::string(heading), GetLogFilename(f),
+             fmt::vformat(format, fmt::make_format_args(args...))});
     }
 }
 
 template <typename... Args>
 void DebugWithNewLine([[maybe_unused]] std::string_view format, [[maybe_unused]] Args &&...args) {
 #if SIGNET_DEBUG
-    PrintDebugPrefix();
-    fmt::vprint(format, fmt::make_format_args(args...));
-    fmt::print("\n");
+    Log({LogLevel::Debug, {}, {}, fmt::vformat(format, fmt::make_format_args(args...))});
 #endif
 }
 
@@ -103,12 +93,21 @@ static constexpr auto sqrt_two = 1.41421356237309504880;
 inline double DBToAmp(const double d) { return std::pow(10.0, d / 20.0); }
 inline double AmpToDB(const double a) { return 20.0 * std::log10(a); }
 
-void ForEachDeinterleavedChannel(const std::vector<double> &interleaved_samples,
-                                 const unsigned num_channels,
-                                 std::function<void(const std::vector<double> &, unsigned channel)> callback);
-
 double GetCentsDifference(double pitch1_hz, double pitch2_hz);
 double GetFreqWithCentDifference(double starting_hz, double cents);
 
 std::unique_ptr<FILE, void (*)(FILE *)> OpenFile(const fs::path &path, const char *mode);
 FILE *OpenFileRaw(const fs::path &path, const char *mode, std::error_code *ec = nullptr);
+
+// fseek and ftell with 64-bit offsets on every platform, for files that are larger than 2 GB. SeekFile
+// returns 0 on success, and TellFile and GetFileSize return -1 on failure.
+int SeekFile(FILE *file, s64 offset, int origin);
+s64 TellFile(FILE *file);
+s64 GetFileSize(FILE *file);
+
+// Flushes the file's buffer and waits until the OS has written the file to the disk.
+bool SyncFile(FILE *file);
+
+// Copies num_bytes from the current position of one file to the current position of another, leaving both
+// positioned after the copied bytes.
+bool CopyFileBytes(FILE *from, FILE *to, u64 num_bytes);
@@ -0,0 +1,148 @@
+#include "dither.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "doctest.hpp"
+
+#include "sample_kernels.h"
+
+// The dither noise is generated into a buffer of this many frames at a time.
+static constexpr usize k_dither_block_num_frames = 1024;
+
+// The noise-shaping filters are restarted every this many frames of the file. That way quantising can start
+// anywhere in a file by only quantising from the start of the segment, rather than from the start of the
+// file. The restarts are not audible; the filters only hold a couple of steps of error.
+static constexpr usize k_noise_shaping_segment_num_frames = 16384;
+
+// The quantisation error that is fed back is limited so that the filter stays stable when the samples clip.
+static constexpr double k_max_noise_shaping_error = 2;
+
+SampleQuantiser::SampleQuantiser(
+    unsigned num_channels, unsigned bits_per_sample, double gain, DitherType dither, u32 seed)
+    : m_num_channels(num_channels)
+    , m_bits_per_sample(bits_per_sample)
+    , m_gain(gain)
+    , m_dither(dither)
+    , m_seed(seed)
+    , m_errors(num_channels * 2) {}
+
+void SampleQuantiser::Quantise(tcb::span<const double> interleaved_samples,
+                               usize first_frame,
+                               usize num_frames,
+                               s32 *out) {
+    const auto block = interleaved_samples.subspan(first_frame * m_num_channels, num_frames * m_num_channels);
+    switch (m_dither) {
+        case DitherType::None: QuantiseSamples(block, m_gain, m_bits_per_sample, out); return;
+        case DitherType::Triangular: {
+            for (usize start = 0; start < block.size(); start += k_dither_block_num_frames * m_num_channels) {
+                const auto part = block.subspan(
+                    start, std::min(k_dither_block_num_frames * m_num_channels, block.size() - start));
+                m_dither_buffer.resize(part.size());
+                GenerateTriangularDither(first_frame * m_num_channels + start, m_seed, m_dither_buffer);
+                QuantiseSamplesWithDither(part, m_gain, m_bits_per_sample, m_dither_buffer.data(),
+                                          out + start);
+            }
+            return;
+        }
+        case DitherType::FirstOrderNoiseShaped:
+        case DitherType::SecondOrderNoiseShaped: {
+            if (first_frame != m_next_frame) {
+                // Bring the filters to the state that they would be in if all of the frames before this had
+                // been quantised.
+                const auto segment_start = first_frame - first_frame % k_noise_shaping_segment_num_frames;
+                std::vector<s32> discarded((first_frame - segment_start) * m_num_channels);
+                QuantiseNoiseShaped(interleaved_samples, segment_start, first_frame - segment_start,
+                                    discarded.data());
+            }
+            QuantiseNoiseShaped(interleaved_samples, first_frame, num_frames, out);
+            return;
+        }
+    }
+}
+
+// Error feedback: the quantisation errors of the previous samples are subtracted from each sample before it
+// is quantised, which filters the error - including the dither - by (1 - z^-1) or (1 - z^-1)^2. That is a
+// high-pass filter, so the noise is moved away from the frequencies that our ears are most sensitive to, at
+// the cost of more noise overall.
+void SampleQuantiser::QuantiseNoiseShaped(tcb::span<const double> interleaved_samples,
+                                          usize first_frame,
+                                          usize num_frames,
+                                          s32 *out) {
+    const auto negative_scale = std::ldexp(1.0, (int)m_bits_per_sample - 1);
+    const auto positive_scale = negative_scale - 1;
+    const bool second_order = m_dither == DitherType::SecondOrderNoiseShaped;
+    const double coefficient_1 = second_order ? 2 : 1;
+    const double coefficient_2 = second_order ? -1 : 0;
+
+    for (usize start = 0; start < num_frames; start += k_dither_block_num_frames) {
+        const auto block_num_frames = std::min(k_dither_block_num_frames, num_frames - start);
+        m_dither_buffer.resize(block_num_frames * m_num_channels);
+        GenerateTriangularDither((first_frame + start) * m_num_channels, m_seed, m_dither_buffer);
+
+        for (usize i = 0; i < block_num_frames; ++i) {
+            const auto frame = first_frame + start + i;
+            if (frame % k_noise_shaping_segment_num_frames == 0) {
+                std::fill(m_errors.begin(), m_errors.end(), 0.0);
+            }
+            for (unsigned chan = 0; chan < m_num_channels; ++chan) {
+                const auto s = interleaved_samples[frame * m_num_channels + chan] * m_gain;
+                auto &error_1 = m_errors[chan * 2];
+                auto &error_2 = m_errors[chan * 2 + 1];
+                const auto target = s * (s < 0 ? negative_scale : positive_scale) -
+                                    (coefficient_1 * error_1 + coefficient_2 * error_2);
+                const auto dithered = target + m_dither_buffer[i * m_num_channels + chan];
+                const auto quantised = std::round(std::clamp(dithered, -negative_scale, positive_scale));
+                out[(start + i) * m_num_channels + chan] = (s32)quantised;
+                error_2 = error_1;
+                error_1 =
+                    std::clamp(quantised - target, -k_max_noise_shaping_error, k_max_noise_shaping_error);
+            }
+        }
+    }
+    m_next_frame = first_frame + num_frames;
+}
+
+TEST_CASE("SampleQuantiser") {
+    const unsigned num_channels = 2;
+    const usize num_frames = k_noise_shaping_segment_num_frames * 2 + 100;
+    std::vector<double> samples;
+    for (usize frame = 0; frame < num_frames; ++frame) {
+        // A very quiet sine, only a few steps of 16-bit in size.
+        samples.push_back(std::sin((double)frame * 0.01) * 3.0 / 32768.0);
+        samples.push_back(std::sin((double)frame * 0.02) * 3.0 / 32768.0);
+    }
+
+    const auto Quantise = [&](DitherType dither, usize piece_num_frames) {
+        SampleQuantiser quantiser(num_channels, 16, 1.0, dither, 1);
+        std::vector<s32> result(samples.size());
+        for (usize start = 0; start < num_frames; start += piece_num_frames) {
+            const auto size = std::min(piece_num_frames, num_frames - start);
+            quantiser.Quantise(samples, start, size, result.data() + start * num_channels);
+        }
+        return result;
+    };
+
+    for (const auto dither : {DitherType::Triangular, DitherType::FirstOrderNoiseShaped,
+                              DitherType::SecondOrderNoiseShaped}) {
+        const auto result = Quantise(dither, num_frames);
+
+        // The dither changes the samples, but it stays within a few steps of them.
+        CHECK(result != Quantise(DitherType::None, num_frames));
+        for (usize i = 0; i < samples.size(); ++i) {
+            REQUIRE(std::abs(result[i] - samples[i] * 32767) < 8);
+        }
+
+        // Quantising in pieces gives the same result.
+        CHECK(Quantise(dither, 1000) == result);
+
+        // As does quantising the pieces out of order, with separate quantisers.
+        std::vector<s32> out_of_order(samples.size());
+        const std::pair<usize, usize> pieces[] = {{20000, num_frames - 20000}, {0, 7000}, {7000, 13000}};
+        for (const auto &[start, size] : pieces) {
+            SampleQuantiser quantiser(num_channels, 16, 1.0, dither, 1);
+            quantiser.Quantise(samples, start, size, out_of_order.data() + start * num_channels);
+        }
+        CHECK(out_of_order == result);
+    }
+}
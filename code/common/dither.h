@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+
+#include "span.hpp"
+
+#include "types.h"
+
+// What is added to samples before they are rounded to an integer bit depth. Without dither, the rounding
+// error of quiet signals follows the signal and is heard as distortion; dither turns it into a constant
+// low-level hiss.
+enum class DitherType {
+    None,
+    Triangular, // TPDF: white noise of up to 1 step
+    FirstOrderNoiseShaped, // triangular dither, with the noise pushed up to where it is less audible
+    SecondOrderNoiseShaped, // as above, but pushed further
+};
+
+// Converts samples to integers, and dithers them. The result for each sample only depends on the samples and
+// its position in the file, not on which of the samples were quantised before it, so a file can be split up
+// and quantised on multiple threads and it will give exactly the same result as quantising it in one go.
+class SampleQuantiser {
+  public:
+    // The samples are multiplied by gain before they are quantised. seed selects the dither noise, files
+    // should be given different seeds so that their noise is not correlated.
+    SampleQuantiser(unsigned num_channels,
+                    unsigned bits_per_sample,
+                    double gain,
+                    DitherType dither,
+                    u32 seed);
+
+    // Quantises num_frames frames of the file's interleaved_samples, starting at first_frame. out must have
+    // room for num_frames * num_channels samples.
+    void Quantise(tcb::span<const double> interleaved_samples, usize first_frame, usize num_frames, s32 *out);
+
+    double Gain() const { return m_gain; }
+
+  private:
+    void QuantiseNoiseShaped(tcb::span<const double> interleaved_samples,
+                             usize first_frame,
+                             usize num_frames,
+                             s32 *out);
+
+    unsigned m_num_channels;
+    unsigned m_bits_per_sample;
+    double m_gain;
+    DitherType m_dither;
+    u32 m_seed;
+
+    std::vector<double> m_dither_buffer {};
+
+    // The noise-shaping filters feed back the last 2 quantisation errors of each channel.
+    std::vector<double> m_errors {};
+    usize m_next_frame {};
+};
@@ -1,7 +1,10 @@
 #pragma once
 
+#include "analysis_index.h"
 #include "audio_file_io.h"
 #include "common.h"
+#include "packed_samples.h"
+#include "sample_kernels.h"
 #include "string_utils.h"
 
 // Changes made to the data, path or format are tracked, and the data is only loaded when it is requested
@@ -10,21 +13,122 @@ struct EditTrackedAudioFile {
 
     AudioData &GetWritableAudio() {
         ++m_file_edited;
+        m_writable_audio_requested = true;
+        m_non_metadata_edited = true;
         return const_cast<AudioData &>(GetAudio());
     }
 
+    // Use this rather than GetWritableAudio if only the metadata is going to be changed; the file can then be
+    // written without re-encoding the audio.
+    Metadata &GetWritableMetadata() {
+        ++m_file_edited;
+        return const_cast<AudioData &>(GetAudio()).metadata;
+    }
+
     const AudioData &GetAudio() {
-        if (!m_file_loaded && m_file_valid) {
-            if (const auto data = ReadAudioFile(m_original_path)) {
-                SetAudioData(*data);
+        LoadAudio();
+        if (m_packed_samples.IsPacked()) {
+            if (m_trimmed_range) {
+                m_packed_samples.Unpack(m_data.interleaved_samples,
+                                        m_trimmed_range->start_frame * m_data.num_channels,
+                                        m_trimmed_range->num_frames * m_data.num_channels);
             } else {
-                ErrorWithNewLine("Signet", m_original_path, "could not load audio");
-                m_file_valid = false;
+                m_packed_samples.Unpack(m_data.interleaved_samples);
             }
+        } else if (m_trimmed_range) {
+            auto &samples = m_data.interleaved_samples;
+            const auto num_channels = m_data.num_channels;
+            samples.resize((m_trimmed_range->start_frame + m_trimmed_range->num_frames) * num_channels);
+            samples.erase(samples.begin(), samples.begin() + m_trimmed_range->start_frame * num_channels);
         }
+        m_trimmed_range.reset();
         return m_data;
     }
 
+    // Removes frames from the start and the end of the audio, adjusting the metadata to match. The samples
+    // themselves are left where they are until the audio is next requested, packed or written, so trimming a
+    // file several times only moves the samples once. If the samples are packed, only the frames that remain
+    // are unpacked.
+    void TrimFrames(usize num_start_frames, usize num_end_frames) {
+        LoadAudio();
+        if (!m_file_valid || (!num_start_frames && !num_end_frames)) return;
+        ++m_file_edited;
+        ++m_audio_generation;
+        m_non_metadata_edited = true;
+
+        auto range = m_trimmed_range ? *m_trimmed_range : FrameRange {0, NumStoredFrames()};
+        assert(num_start_frames + num_end_frames < range.num_frames);
+        range.start_frame += num_start_frames;
+        range.num_frames -= num_start_frames + num_end_frames;
+        m_trimmed_range = range;
+
+        if (num_end_frames) m_data.FramesWereRemovedFromEnd(num_start_frames + range.num_frames);
+        if (num_start_frames) m_data.FramesWereRemovedFromStart(num_start_frames);
+        if (m_info) {
+            m_info->num_frames = range.num_frames;
+            m_info->metadata = m_data.metadata;
+        }
+    }
+
+    // The format, length and metadata of the audio. Until the audio is loaded these are read from just the
+    // file's headers, so this is much cheaper than GetAudio when the samples themselves aren't needed.
+    const AudioFileInfo &GetInfo() {
+        if (m_file_loaded && !m_audio_released && !m_packed_samples.IsPacked()) {
+            m_info = GetInfoOfLoadedAudio();
+        } else if (!m_info && m_file_valid) {
+            m_info = ReadAudioFileInfo(m_original_path);
+            if (!m_info) {
+                ErrorWithNewLine("Signet", m_original_path, "could not read the audio file's headers");
+                m_file_valid = false;
+            }
+        }
+        if (!m_info) m_info.emplace();
+        return *m_info;
+    }
+
+    // Analyses of the audio. Each is worked out the first time it is asked for, and then kept until the audio
+    // is changed, so commands that are run one after another on the same audio only do the work once. If
+    // there is an AnalysisIndex, they are looked up in it and added to it too, so audio that has not changed
+    // since a previous run of Signet is not analysed again. The audio returned by GetWritableAudio can be
+    // changed at any time until CommandFinished is called, so until then the analyses are worked out again
+    // each time they are asked for.
+    std::optional<double> GetDetectedPitch() {
+        auto &analysis = GetAnalysis();
+        if (!analysis.detected_pitch) {
+            analysis.detected_pitch = GetAudio().DetectPitch();
+            AnalysisWasUpdated();
+        }
+        return *analysis.detected_pitch;
+    }
+
+    tcb::span<const SampleStatistics> GetChannelStatistics() {
+        auto &analysis = GetAnalysis();
+        if (analysis.channel_statistics.empty()) {
+            const auto &audio = GetAudio();
+            analysis.channel_statistics.resize(audio.num_channels);
+            AddChannelStatistics(audio.interleaved_samples, audio.num_channels, analysis.channel_statistics);
+            AnalysisWasUpdated();
+        }
+        return analysis.channel_statistics;
+    }
+
+    SampleStatistics GetSampleStatistics() {
+        SampleStatistics result {};
+        for (const auto &channel : GetChannelStatistics()) {
+            result.Combine(channel);
+        }
+        return result;
+    }
+
+    SilenceBounds GetSilenceBounds(double threshold_amp) {
+        auto &analysis = GetAnalysis();
+        if (!analysis.silence_bounds || analysis.silence_bounds->threshold_amp != threshold_amp) {
+            analysis.silence_bounds = FindSilenceBounds(GetAudio(), threshold_amp);
+            AnalysisWasUpdated();
+        }
+        return *analysis.silence_bounds;
+    }
+
     const fs::path &GetPath() const { return m_path; }
 
     void SetPath(const fs::path &path) {
@@ -33,15 +137,57 @@ struct EditTrackedAudioFile {
     }
 
     bool AudioChanged() const { return m_file_edited && m_file_valid; }
+    bool OnlyMetadataChanged() const { return AudioChanged() && !m_non_metadata_edited; }
     bool PathChanged() const { return m_path_edited; }
     bool FormatChanged() const { return m_file_loaded && m_original_file_format != m_data.format; }
 
-    void SetAudioData(const AudioData &data) {
-        m_data = data;
+    void SetAudioData(const AudioData &data) { SetAudioData(AudioData(data)); }
+    void SetAudioData(AudioData &&data) {
+        ++m_audio_generation;
+        m_data = std::move(data);
         m_original_file_format = m_data.format;
         m_file_loaded = true;
     }
 
+    // Frees the memory used by the samples once the file has been written. The edit-tracking state is kept
+    // so that the file is still counted as processed, but the audio must not be requested again.
+    void ReleaseAudio() {
+        if (!m_packed_samples.IsPacked()) m_info = GetInfoOfLoadedAudio();
+        m_packed_samples.Clear();
+        m_trimmed_range.reset();
+        std::vector<double>().swap(m_data.interleaved_samples);
+        m_audio_released = true;
+    }
+
+    // Stores the samples at the precision given by GetSampleStoragePrecision, to save memory while the file
+    // is waiting to be processed again or written. They are converted back the next time they are requested.
+    // Files are packed after each command, so this also calls CommandFinished.
+    void PackAudio() {
+        CommandFinished();
+        if (!m_file_loaded || m_audio_released || m_packed_samples.IsPacked()) return;
+        if (m_data.IsEmpty()) return;
+        const auto info = GetInfoOfLoadedAudio();
+        tcb::span<const double> samples = m_data.interleaved_samples;
+        if (m_trimmed_range) {
+            samples = samples.subspan(m_trimmed_range->start_frame * m_data.num_channels,
+                                      m_trimmed_range->num_frames * m_data.num_channels);
+        }
+        if (m_packed_samples.Pack(samples, GetSampleStoragePrecision(), m_data.bits_per_sample)) {
+            m_info = info;
+            m_trimmed_range.reset();
+            std::vector<double>().swap(m_data.interleaved_samples);
+        }
+    }
+
+    // Called after each command has processed the file; the audio that the command got from
+    // GetWritableAudio is not changed after this.
+    void CommandFinished() {
+        if (m_writable_audio_requested) {
+            ++m_audio_generation;
+            m_writable_audio_requested = false;
+        }
+    }
+
     int NumTimesAudioChanged() const { return m_file_edited; }
     int NumTimesPathChanged() const { return m_path_edited; }
 
@@ -49,14 +195,75 @@ struct EditTrackedAudioFile {
     std::string OriginalFilename() const { return GetJustFilenameWithNoExtension(OriginalPath()); }
 
   private:
+    struct FrameRange {
+        usize start_frame;
+        usize num_frames;
+    };
+
+    void LoadAudio() {
+        assert(!m_audio_released);
+        if (!m_file_loaded && m_file_valid) {
+            if (auto data = ReadAudioFile(m_original_path)) {
+                SetAudioData(std::move(*data));
+            } else {
+                ErrorWithNewLine("Signet", m_original_path, "could not load audio");
+                m_file_valid = false;
+            }
+        }
+    }
+
+    usize NumStoredFrames() const {
+        if (m_packed_samples.IsPacked()) return m_packed_samples.NumSamples() / m_data.num_channels;
+        return m_data.IsEmpty() ? 0 : m_data.NumFrames();
+    }
+
+    AudioAnalysis &GetAnalysis() {
+        // Loading the audio counts as a change, so it must be done before the analysis is checked.
+        LoadAudio();
+        if (m_writable_audio_requested) ++m_audio_generation;
+        if (m_analysed_audio_generation != m_audio_generation) {
+            m_analysed_audio_generation = m_audio_generation;
+            m_analysis = {};
+            m_content_hash.reset();
+            if (auto index = GetAnalysisIndex()) {
+                m_content_hash = HashAudioContent(GetAudio());
+                m_analysis = index->Find(*m_content_hash);
+            }
+        }
+        return m_analysis;
+    }
+
+    void AnalysisWasUpdated() {
+        if (auto index = GetAnalysisIndex(); index && m_content_hash) {
+            index->Update(*m_content_hash, m_analysis);
+        }
+    }
+
+    AudioFileInfo GetInfoOfLoadedAudio() const {
+        auto info = GetAudioFileInfo(m_data);
+        if (m_trimmed_range) info.num_frames = m_trimmed_range->num_frames;
+        return info;
+    }
+
     AudioFileFormat m_original_file_format {};
     fs::path m_path {};
     AudioData m_data {};
+    std::optional<AudioFileInfo> m_info {};
+    PackedSamples m_packed_samples {};
+    std::optional<FrameRange> m_trimmed_range {};
     bool m_file_loaded = false;
     bool m_file_valid = true;
+    bool m_audio_released = false;
 
     int m_file_edited = 0;
+    bool m_non_metadata_edited = false;
     int m_path_edited = 0;
 
+    int m_audio_generation = 0; // incremented whenever the samples might have changed
+    int m_analysed_audio_generation = -1;
+    bool m_writable_audio_requested = false; // the samples can be changed through the returned reference
+    AudioAnalysis m_analysis {};
+    std::optional<u64> m_content_hash {}; // only worked out when there is an AnalysisIndex
+
     fs::path m_original_path;
 };
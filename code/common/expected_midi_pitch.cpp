@@ -31,7 +31,7 @@ void ExpectedMidiPitch::AddCli(CLI::App &command, bool accept_any_octave) {
 }
 
 std::optional<MIDIPitch> ExpectedMidiPitch::GetExpectedMidiPitch(const std::string &command_name,
-                                                                 EditTrackedAudioFile &f) {
+                                                                 EditTrackedAudioFile &f) const {
     std::optional<MIDIPitch> expected_midi_pitch {};
     if (m_expected_note_capture) {
         const auto filename = GetJustFilenameWithNoExtension(f.GetPath());
@@ -11,7 +11,8 @@ struct EditTrackedAudioFile;
 class ExpectedMidiPitch {
   public:
     void AddCli(CLI::App &command, bool accept_any_octave);
-    std::optional<MIDIPitch> GetExpectedMidiPitch(const std::string &command_name, EditTrackedAudioFile &f);
+    std::optional<MIDIPitch> GetExpectedMidiPitch(const std::string &command_name,
+                                                  EditTrackedAudioFile &f) const;
 
   private:
     std::optional<std::string> m_expected_note_capture {};
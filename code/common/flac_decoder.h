@@ -1,18 +1,42 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <cstdio>
 #include <memory>
 
 #include "FLAC/stream_decoder.h"
 #include "audio_data.h"
 #include "common.h"
+#include "pcm_conversion.h"
 
 struct FlacFileDataContext {
     FlacFileDataContext(FILE *f, AudioData &a) : file(f), data(a) {}
     FILE *file;
     AudioData &data;
+    usize num_samples_written {};
 };
 
+// Returns false if the block isn't the APPLICATION block that contains our JSON metadata.
+bool ReadSignetFlacMetadataBlock(const FLAC__StreamMetadata *metadata, Metadata &out) {
+    if (metadata->type != FLAC__METADATA_TYPE_APPLICATION ||
+        memcmp(metadata->data.application.id, flac_custom_signet_application_id, 4) != 0) {
+        return false;
+    }
+    const auto id_bytes = (FLAC__STREAM_METADATA_APPLICATION_ID_LEN / 8);
+    if (metadata->length > id_bytes) {
+        std::string data {(char *)metadata->data.application.data, metadata->length - id_bytes};
+        std::stringstream ss(data);
+        try {
+            cereal::JSONInputArchive archive(ss);
+            archive(cereal::make_nvp(signet_root_json_object_name, out));
+        } catch (const std::exception &e) {
+            ErrorWithNewLine("Flac", {}, "Error parsing FLAC signet metadata: {}", e.what());
+        }
+    }
+    return true;
+}
+
 FLAC__StreamDecoderReadStatus
 FlacDecodeReadCallback(const FLAC__StreamDecoder *, FLAC__byte buffer[], size_t *bytes, void *client_data) {
     auto &context = *((FlacFileDataContext *)client_data);
@@ -33,8 +57,7 @@ FLAC__StreamDecoderSeekStatus
 FlacDecodeSeekCallback(const FLAC__StreamDecoder *, FLAC__uint64 absolute_byte_offset, void *client_data) {
     auto &context = *((FlacFileDataContext *)client_data);
 
-    // TODO use fseeko to get 64 bit offset
-    if (std::fseek(context.file, (long)absolute_byte_offset, SEEK_SET) < 0)
+    if (SeekFile(context.file, (s64)absolute_byte_offset, SEEK_SET) < 0)
         return FLAC__STREAM_DECODER_SEEK_STATUS_ERROR;
     else
         return FLAC__STREAM_DECODER_SEEK_STATUS_OK;
@@ -44,8 +67,8 @@ FLAC__StreamDecoderTellStatus
 FlacDecodeTellCallback(const FLAC__StreamDecoder *, FLAC__uint64 *absolute_byte_offset, void *client_data) {
     auto &context = *((FlacFileDataContext *)client_data);
 
-    off_t pos;
-    if ((pos = std::ftell(context.file)) < 0)
+    s64 pos;
+    if ((pos = TellFile(context.file)) < 0)
         return FLAC__STREAM_DECODER_TELL_STATUS_ERROR;
     else {
         *absolute_byte_offset = (FLAC__uint64)pos;
@@ -57,15 +80,11 @@ FLAC__StreamDecoderLengthStatus
 FlacDecodeLengthCallback(const FLAC__StreamDecoder *, FLAC__uint64 *stream_length, void *client_data) {
     auto &context = *((FlacFileDataContext *)client_data);
 
-    struct stat filestats;
-#if _WIN32
-    if (fstat(_fileno(context.file), &filestats) != 0)
-#else
-    if (fstat(fileno(context.file), &filestats) != 0)
-#endif
+    s64 size;
+    if ((size = GetFileSize(context.file)) < 0)
         return FLAC__STREAM_DECODER_LENGTH_STATUS_ERROR;
     else {
-        *stream_length = (FLAC__uint64)filestats.st_size;
+        *stream_length = (FLAC__uint64)size;
         return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
     }
 }
@@ -84,25 +103,23 @@ FLAC__StreamDecoderWriteStatus FlacDecoderWriteCallback(const FLAC__StreamDecode
     context.data.num_channels = flac_frame->header.channels;
     context.data.bits_per_sample = flac_frame->header.bits_per_sample;
 
-    double divisor;
-    switch (flac_frame->header.bits_per_sample) {
-        case 8: divisor = std::pow(2, 7); break;
-        case 16:
-            divisor = 32768.0; // 2^15
-            break;
-        case 20: divisor = std::pow(2, 19); break;
-        case 24:
-            divisor = 8388608.0; // 2^23
-            break;
-        default: divisor = 9999999.0; assert(false);
+    const auto num_channels = flac_frame->header.channels;
+    const auto num_frames = flac_frame->header.blocksize;
+    auto &samples = context.data.interleaved_samples;
+
+    // The buffer is normally sized exactly from the STREAMINFO block, but not every stream states its length
+    // so it has to be able to grow. It is trimmed to the decoded length once decoding has finished.
+    const auto num_samples_needed = context.num_samples_written + (usize)num_frames * num_channels;
+    if (num_samples_needed > samples.size()) {
+        samples.resize(std::max(num_samples_needed, samples.size() + samples.size() / 2));
     }
 
-    for (unsigned int frame = 0; frame < flac_frame->header.blocksize; ++frame) {
-        for (unsigned int chan = 0; chan < flac_frame->header.channels; ++chan) {
-            const auto val = buffer[chan][frame] / divisor;
-            context.data.interleaved_samples.push_back(val);
-        }
+    const auto scale = std::ldexp(1.0, -(int)(flac_frame->header.bits_per_sample - 1));
+    for (unsigned chan = 0; chan < num_channels; ++chan) {
+        ConvertInt32ToDouble(buffer[chan], num_frames, scale,
+                             samples.data() + context.num_samples_written + chan, num_channels);
     }
+    context.num_samples_written = num_samples_needed;
 
     return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
 }
@@ -114,27 +131,16 @@ void FlacDecoderMetadataCallback(const FLAC__StreamDecoder *,
 
     switch (metadata->type) {
         case FLAC__METADATA_TYPE_APPLICATION: {
-            if (memcmp(metadata->data.application.id, flac_custom_signet_application_id, 4) == 0) {
-                const auto id_bytes = (FLAC__STREAM_METADATA_APPLICATION_ID_LEN / 8);
-                if (metadata->length > id_bytes) {
-                    std::string data {(char *)metadata->data.application.data, metadata->length - id_bytes};
-                    std::stringstream ss(data);
-                    try {
-                        cereal::JSONInputArchive archive(ss);
-                        archive(cereal::make_nvp(signet_root_json_object_name, context.data.metadata));
-                    } catch (const std::exception &e) {
-                        ErrorWithNewLine("Flac", {}, "Error parsing FLAC signet metadata: {}", e.what());
-                    }
-                }
-                return;
-            }
+            if (ReadSignetFlacMetadataBlock(metadata, context.data.metadata)) return;
             break;
         }
         case FLAC__METADATA_TYPE_STREAMINFO: {
             context.data.num_channels = metadata->data.stream_info.channels;
             context.data.bits_per_sample = metadata->data.stream_info.bits_per_sample;
             context.data.sample_rate = metadata->data.stream_info.sample_rate;
-            context.data.interleaved_samples.reserve(metadata->data.stream_info.total_samples);
+            // total_samples is actually the number of frames, and it is 0 if the length is unknown.
+            context.data.interleaved_samples.resize(metadata->data.stream_info.total_samples *
+                                                    metadata->data.stream_info.channels);
             return;
         }
         case FLAC__METADATA_TYPE_CUESHEET:
@@ -189,5 +195,6 @@ bool DecodeFlacFile(FILE *file, AudioData &output) {
     }
 
     FLAC__stream_decoder_finish(decoder.get());
+    output.interleaved_samples.resize(context.num_samples_written);
     return process_success;
 }
@@ -0,0 +1,485 @@
+#include "flac_encoder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <memory>
+
+extern "C" {
+#include "private/crc.h"
+#include "private/md5.h"
+}
+
+#include "doctest.hpp"
+
+#include "audio_file_io.h"
+#include "common.h"
+#include "tests_config.h"
+#include "thread_pool.h"
+
+// Each thread is given a number of chunks so that the threads stay busy even if some chunks encode faster
+// than others. Chunks are kept large enough that the extra setup of each encoder is negligible.
+static constexpr unsigned k_chunks_per_thread = 4;
+static constexpr u64 k_min_blocks_per_chunk = 32;
+
+// The samples are quantised this many frames at a time as they are passed to the encoders.
+static constexpr usize k_quantise_block_num_frames = 4096;
+
+// The maximum LPC order of each of libFLAC's compression presets. The presets without LPC use a smaller block
+// size.
+static constexpr unsigned k_preset_max_lpc_orders[FlacEncodingSettings::k_max_compression_level + 1] = {
+    0, 0, 0, 6, 8, 8, 8, 12, 12};
+
+// FLAC's streamable subset, which libFLAC keeps to unless told otherwise, limits the block size of files with
+// these sample rates.
+static constexpr unsigned k_subset_max_sample_rate_for_small_blocks = 48000;
+static constexpr unsigned k_subset_max_small_block_size = 4608;
+
+unsigned GetFlacBlockSize(const FlacEncodingSettings &settings) {
+    if (settings.block_size) return *settings.block_size;
+    // This is what libFLAC picks when it is left to choose, but it is set explicitly so that the chunks can
+    // be split on block boundaries.
+    const auto level = std::min(settings.compression_level, FlacEncodingSettings::k_max_compression_level);
+    const auto max_lpc_order =
+        settings.max_lpc_order ? *settings.max_lpc_order : k_preset_max_lpc_orders[level];
+    return max_lpc_order == 0 ? 1152 : 4096;
+}
+
+void ConfigureFlacEncoder(FLAC__StreamEncoder *encoder,
+                          const FlacEncodingSettings &settings,
+                          unsigned num_channels,
+                          unsigned bits_per_sample,
+                          unsigned sample_rate,
+                          u64 num_frames) {
+    FLAC__stream_encoder_set_channels(encoder, num_channels);
+    FLAC__stream_encoder_set_bits_per_sample(encoder, bits_per_sample);
+    FLAC__stream_encoder_set_sample_rate(encoder, sample_rate);
+    FLAC__stream_encoder_set_total_samples_estimate(encoder, num_frames);
+
+    // The preset has to be applied first because it overwrites the individual settings.
+    FLAC__stream_encoder_set_compression_level(encoder, settings.compression_level);
+    if (settings.max_lpc_order) FLAC__stream_encoder_set_max_lpc_order(encoder, *settings.max_lpc_order);
+    const auto block_size = GetFlacBlockSize(settings);
+    FLAC__stream_encoder_set_blocksize(encoder, block_size);
+
+    // A larger block is still valid FLAC, but libFLAC refuses to encode it unless the subset is turned off.
+    if (sample_rate <= k_subset_max_sample_rate_for_small_blocks &&
+        block_size > k_subset_max_small_block_size) {
+        FLAC__stream_encoder_set_streamable_subset(encoder, false);
+    }
+}
+
+bool ShouldEncodeFlacInParallel(const FlacEncodingSettings &settings, u64 num_frames) {
+    return CanRunInParallel() && num_frames >= 2 * k_min_blocks_per_chunk * GetFlacBlockSize(settings);
+}
+
+// The frame number in a FLAC frame header is stored using the same variable-length scheme as UTF-8.
+static std::vector<u8> EncodeFlacFrameNumber(u32 value) {
+    if (value < 0x80) return {(u8)value};
+
+    // An n-byte encoding can store 5n + 1 bits.
+    usize num_bytes = 2;
+    while (num_bytes < 6 && value >= (1u << (5 * num_bytes + 1))) {
+        ++num_bytes;
+    }
+    std::vector<u8> result(num_bytes);
+    for (usize i = num_bytes - 1; i != 0; --i) {
+        result[i] = (u8)(0x80 | (value & 0x3f));
+        value >>= 6;
+    }
+    result[0] = (u8)((0xff << (8 - num_bytes)) | value);
+    return result;
+}
+
+static usize FlacFrameNumberSize(u8 first_byte) {
+    usize num_bytes = 0;
+    while (num_bytes < 8 && (first_byte & (0x80 >> num_bytes))) {
+        ++num_bytes;
+    }
+    return num_bytes == 0 ? 1 : num_bytes;
+}
+
+// Every chunk is encoded as if it were the start of a stream, so its frames are numbered from 0. This
+// rewrites the frame number in the header, and then recalculates the header's CRC-8 and the whole frame's
+// CRC-16.
+static void SetFlacFrameNumber(std::vector<u8> &frame, u32 frame_number) {
+    constexpr usize frame_number_offset = 4;
+    const auto encoded_number = EncodeFlacFrameNumber(frame_number);
+    const auto old_size = FlacFrameNumberSize(frame[frame_number_offset]);
+    frame.erase(frame.begin() + frame_number_offset, frame.begin() + frame_number_offset + old_size);
+    frame.insert(frame.begin() + frame_number_offset, encoded_number.begin(), encoded_number.end());
+
+    // The header optionally has the block size and sample rate after the frame number, depending on the codes
+    // in byte 2.
+    auto crc8_offset = frame_number_offset + encoded_number.size();
+    const auto block_size_code = frame[2] >> 4;
+    const auto sample_rate_code = frame[2] & 0xf;
+    if (block_size_code == 6) crc8_offset += 1;
+    if (block_size_code == 7) crc8_offset += 2;
+    if (sample_rate_code == 12) crc8_offset += 1;
+    if (sample_rate_code == 13 || sample_rate_code == 14) crc8_offset += 2;
+
+    frame[crc8_offset] = FLAC__crc8(frame.data(), (unsigned)crc8_offset);
+    const auto crc16 = FLAC__crc16(frame.data(), (unsigned)frame.size() - 2);
+    frame[frame.size() - 2] = (u8)(crc16 >> 8);
+    frame[frame.size() - 1] = (u8)(crc16 & 0xff);
+}
+
+// Calls callback with each block of the given frames quantised to the bit depth, and the number of frames in
+// it. Stops and returns false if the callback returns false. The quantiser is copied because it holds the
+// state of the dither.
+template <typename Callback>
+static bool ForEachQuantisedBlock(tcb::span<const double> interleaved_samples,
+                                  unsigned num_channels,
+                                  usize first_frame,
+                                  usize num_frames,
+                                  SampleQuantiser quantiser,
+                                  Callback callback) {
+    std::vector<s32> block;
+    for (usize start = 0; start < num_frames; start += k_quantise_block_num_frames) {
+        const auto block_num_frames = std::min(k_quantise_block_num_frames, num_frames - start);
+        block.resize(block_num_frames * num_channels);
+        quantiser.Quantise(interleaved_samples, first_frame + start, block_num_frames, block.data());
+        if (!callback(block.data(), block_num_frames)) return false;
+    }
+    return true;
+}
+
+static void CalculateFlacMd5(tcb::span<const double> interleaved_samples,
+                             unsigned num_channels,
+                             unsigned bits_per_sample,
+                             const SampleQuantiser &quantiser,
+                             FLAC__byte digest[16]) {
+    FLAC__MD5Context context;
+    FLAC__MD5Init(&context);
+
+    // FLAC__MD5Accumulate takes separate channels, so deinterleave a block at a time.
+    std::vector<std::vector<FLAC__int32>> channels(num_channels,
+                                                   std::vector<FLAC__int32>(k_quantise_block_num_frames));
+    std::vector<const FLAC__int32 *> channel_pointers;
+    for (const auto &c : channels) {
+        channel_pointers.push_back(c.data());
+    }
+
+    const auto accumulate_block = [&](const s32 *block, usize size) {
+        for (usize frame = 0; frame < size; ++frame) {
+            for (unsigned chan = 0; chan < num_channels; ++chan) {
+                channels[chan][frame] = block[frame * num_channels + chan];
+            }
+        }
+        return FLAC__MD5Accumulate(&context, channel_pointers.data(), num_channels, (unsigned)size,
+                                   (bits_per_sample + 7) / 8) != 0;
+    };
+    ForEachQuantisedBlock(interleaved_samples, num_channels, 0, interleaved_samples.size() / num_channels,
+                          quantiser, accumulate_block);
+    FLAC__MD5Final(digest, &context);
+}
+
+namespace {
+
+struct EncodedChunk {
+    std::vector<u8> metadata {};
+    std::vector<std::vector<u8>> frames {};
+    bool succeeded {};
+};
+
+} // namespace
+
+static FLAC__StreamEncoderWriteStatus WriteToEncodedChunk(const FLAC__StreamEncoder *,
+                                                          const FLAC__byte buffer[],
+                                                          size_t bytes,
+                                                          unsigned samples,
+                                                          unsigned,
+                                                          void *client_data) {
+    auto &chunk = *(EncodedChunk *)client_data;
+    // libFLAC passes each frame in a single call, with the number of samples that it contains. Metadata is
+    // written with 0 samples.
+    if (samples == 0) {
+        chunk.metadata.insert(chunk.metadata.end(), buffer, buffer + bytes);
+    } else {
+        chunk.frames.emplace_back(buffer, buffer + bytes);
+    }
+    return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+}
+
+static void EncodeChunk(EncodedChunk &chunk,
+                        const FlacEncodingSettings &settings,
+                        unsigned num_channels,
+                        unsigned bits_per_sample,
+                        unsigned sample_rate,
+                        std::vector<FLAC__StreamMetadata *> *metadata,
+                        tcb::span<const double> interleaved_samples,
+                        const SampleQuantiser &quantiser,
+                        usize first_frame,
+                        usize num_frames) {
+    std::unique_ptr<FLAC__StreamEncoder, decltype(&FLAC__stream_encoder_delete)> encoder {
+        FLAC__stream_encoder_new(), &FLAC__stream_encoder_delete};
+    if (!encoder) return;
+
+    ConfigureFlacEncoder(encoder.get(), settings, num_channels, bits_per_sample, sample_rate, num_frames);
+    if (metadata && metadata->size()) {
+        FLAC__stream_encoder_set_metadata(encoder.get(), metadata->data(), (unsigned)metadata->size());
+    }
+
+    // Without seek or tell callbacks, the encoder does not try to go back and rewrite the STREAMINFO.
+    if (FLAC__stream_encoder_init_stream(encoder.get(), WriteToEncodedChunk, nullptr, nullptr, nullptr,
+                                         &chunk) != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+        return;
+    }
+    const auto encode_block = [&](const s32 *block, usize size) {
+        return FLAC__stream_encoder_process_interleaved(encoder.get(), block, (unsigned)size) != 0;
+    };
+    if (!ForEachQuantisedBlock(interleaved_samples, num_channels, first_frame, num_frames, quantiser,
+                               encode_block)) {
+        FLAC__stream_encoder_finish(encoder.get());
+        return;
+    }
+    chunk.succeeded = FLAC__stream_encoder_finish(encoder.get());
+}
+
+// STREAMINFO is always the first metadata block, directly after the "fLaC" marker and the block's header.
+static void
+SetFlacStreamInfo(std::vector<u8> &metadata, u32 min_frame_size, u32 max_frame_size, u64 num_frames) {
+    constexpr usize stream_info_offset = 8;
+    const auto WriteBigEndian24 = [&](usize offset, u32 value) {
+        metadata[offset + 0] = (u8)(value >> 16);
+        metadata[offset + 1] = (u8)(value >> 8);
+        metadata[offset + 2] = (u8)value;
+    };
+    WriteBigEndian24(stream_info_offset + 4, min_frame_size);
+    WriteBigEndian24(stream_info_offset + 7, max_frame_size);
+
+    // The total number of samples is 36 bits, it shares its first byte with the bits per sample.
+    constexpr usize total_samples_offset = stream_info_offset + 13;
+    metadata[total_samples_offset] =
+        (u8)((metadata[total_samples_offset] & 0xf0) | ((num_frames >> 32) & 0xf));
+    for (usize i = 0; i < 4; ++i) {
+        metadata[total_samples_offset + 1 + i] = (u8)(num_frames >> (8 * (3 - i)));
+    }
+}
+
+bool WriteFlacFileInParallel(FILE *file,
+                             const FlacEncodingSettings &settings,
+                             unsigned num_channels,
+                             unsigned bits_per_sample,
+                             unsigned sample_rate,
+                             std::vector<FLAC__StreamMetadata *> &metadata,
+                             tcb::span<const double> interleaved_samples,
+                             const SampleQuantiser &quantiser) {
+    const u64 num_frames = interleaved_samples.size() / num_channels;
+    const u64 block_size = GetFlacBlockSize(settings);
+
+    const u64 num_blocks = (num_frames + block_size - 1) / block_size;
+    const u64 blocks_per_chunk =
+        std::max(k_min_blocks_per_chunk,
+                 (num_blocks + GetNumParallelJobs() * k_chunks_per_thread - 1) /
+                     (GetNumParallelJobs() * k_chunks_per_thread));
+    const auto num_chunks = (usize)((num_blocks + blocks_per_chunk - 1) / blocks_per_chunk);
+
+    // The chunks are encoded at the same time as the MD5 of the whole signal is calculated.
+    std::vector<EncodedChunk> chunks(num_chunks);
+    FLAC__byte md5[16];
+    ParallelFor(num_chunks + 1, [&](usize task_index) {
+        if (task_index == num_chunks) {
+            CalculateFlacMd5(interleaved_samples, num_channels, bits_per_sample, quantiser, md5);
+            return;
+        }
+        const auto first_frame = task_index * blocks_per_chunk * block_size;
+        const auto chunk_num_frames = std::min(blocks_per_chunk * block_size, num_frames - first_frame);
+        EncodeChunk(chunks[task_index], settings, num_channels, bits_per_sample, sample_rate,
+                    task_index == 0 ? &metadata : nullptr, interleaved_samples, quantiser, first_frame,
+                    chunk_num_frames);
+    });
+
+    u32 frame_number = 0;
+    u32 min_frame_size = UINT32_MAX;
+    u32 max_frame_size = 0;
+    for (usize chunk_index = 0; chunk_index < num_chunks; ++chunk_index) {
+        auto &chunk = chunks[chunk_index];
+        if (!chunk.succeeded) return false;
+        for (auto &frame : chunk.frames) {
+            // The first chunk's frames are already numbered correctly.
+            if (chunk_index != 0) SetFlacFrameNumber(frame, frame_number);
+            min_frame_size = std::min(min_frame_size, (u32)frame.size());
+            max_frame_size = std::max(max_frame_size, (u32)frame.size());
+            ++frame_number;
+        }
+    }
+
+    auto &header = chunks[0].metadata;
+    SetFlacStreamInfo(header, min_frame_size, max_frame_size, num_frames);
+    std::memcpy(header.data() + 8 + 18, md5, sizeof(md5));
+
+    if (std::fwrite(header.data(), 1, header.size(), file) != header.size()) return false;
+    for (const auto &chunk : chunks) {
+        for (const auto &frame : chunk.frames) {
+            if (std::fwrite(frame.data(), 1, frame.size(), file) != frame.size()) return false;
+        }
+    }
+    return true;
+}
+
+TEST_CASE("FLAC frame numbers") {
+    CHECK(EncodeFlacFrameNumber(0) == std::vector<u8> {0x00});
+    CHECK(EncodeFlacFrameNumber(0x7f) == std::vector<u8> {0x7f});
+    CHECK(EncodeFlacFrameNumber(0x80) == std::vector<u8> {0xc2, 0x80});
+    CHECK(EncodeFlacFrameNumber(0x7ff) == std::vector<u8> {0xdf, 0xbf});
+    CHECK(EncodeFlacFrameNumber(0x800) == std::vector<u8> {0xe0, 0xa0, 0x80});
+    CHECK(EncodeFlacFrameNumber(0x10000) == std::vector<u8> {0xf0, 0x90, 0x80, 0x80});
+
+    for (const u32 n : {0u, 0x7fu, 0x80u, 0x800u, 0x10000u, 0x200000u, 0x4000000u}) {
+        CHECK(FlacFrameNumberSize(EncodeFlacFrameNumber(n)[0]) == EncodeFlacFrameNumber(n).size());
+    }
+}
+
+TEST_CASE("FLAC parallel encoding gives the same file as a single encoder") {
+    AudioData audio {};
+    audio.num_channels = 2;
+    audio.sample_rate = 44100;
+    audio.bits_per_sample = 24;
+    audio.format = AudioFileFormat::Flac;
+    const usize num_frames = 44100 * 10 + 123;
+    u32 random = 1;
+    for (usize frame = 0; frame < num_frames; ++frame) {
+        random = random * 1664525u + 1013904223u;
+        const auto noise = ((double)(random >> 8) / (double)(1 << 24)) * 0.1 - 0.05;
+        audio.interleaved_samples.push_back(std::sin((double)frame * 0.01) * 0.8 + noise);
+        audio.interleaved_samples.push_back(std::sin((double)frame * 0.013) * 0.5);
+    }
+    audio.metadata.midi_mapping.emplace();
+    audio.metadata.midi_mapping->root_midi_note = 60;
+
+    const auto ReadBytes = [](const fs::path &path) {
+        std::vector<u8> result(fs::file_size(path));
+        auto f = OpenFile(path, "rb");
+        REQUIRE(std::fread(result.data(), 1, result.size(), f.get()) == result.size());
+        return result;
+    };
+
+    SetNumParallelJobs(1);
+    REQUIRE(WriteAudioFile("flac-single-encoder.flac", audio, 24));
+    SetNumParallelJobs(4);
+    REQUIRE(ShouldEncodeFlacInParallel(audio.flac_encoding_settings, num_frames));
+    REQUIRE(WriteAudioFile("flac-parallel-encoder.flac", audio, 24));
+    SetNumParallelJobs(1);
+
+    CHECK(ReadBytes("flac-single-encoder.flac") == ReadBytes("flac-parallel-encoder.flac"));
+
+    // The dither should not depend on how the file was split up either.
+    audio.dither = DitherType::SecondOrderNoiseShaped;
+    REQUIRE(WriteAudioFile("flac-single-encoder-dithered.flac", audio, 16));
+    SetNumParallelJobs(4);
+    REQUIRE(WriteAudioFile("flac-parallel-encoder-dithered.flac", audio, 16));
+    SetNumParallelJobs(1);
+    CHECK(ReadBytes("flac-single-encoder-dithered.flac") == ReadBytes("flac-parallel-encoder-dithered.flac"));
+
+    const auto single = ReadAudioFile("flac-single-encoder.flac");
+    const auto parallel = ReadAudioFile("flac-parallel-encoder.flac");
+    REQUIRE(single);
+    REQUIRE(parallel);
+    CHECK(parallel->interleaved_samples == single->interleaved_samples);
+    REQUIRE(parallel->metadata.midi_mapping);
+    CHECK(parallel->metadata.midi_mapping->root_midi_note == 60);
+}
+
+TEST_CASE("FLAC compression settings") {
+    FlacEncodingSettings settings {};
+    CHECK(GetFlacBlockSize(settings) == 4096);
+    settings.compression_level = 0;
+    CHECK(GetFlacBlockSize(settings) == 1152);
+    settings.max_lpc_order = 8;
+    CHECK(GetFlacBlockSize(settings) == 4096);
+    settings.block_size = 2048;
+    CHECK(GetFlacBlockSize(settings) == 2048);
+
+    AudioData audio {};
+    audio.num_channels = 1;
+    audio.sample_rate = 44100;
+    audio.bits_per_sample = 16;
+    audio.format = AudioFileFormat::Flac;
+    for (usize frame = 0; frame < 44100; ++frame) {
+        audio.interleaved_samples.push_back(std::sin((double)frame * 0.01) * 0.6);
+    }
+
+    // The level only changes how the samples are compressed, they should always decode to the same values.
+    const auto WriteAndRead = [&](unsigned level, const fs::path &path) {
+        audio.flac_encoding_settings = {};
+        audio.flac_encoding_settings.compression_level = level;
+        REQUIRE(WriteAudioFile(path, audio));
+        auto result = ReadAudioFile(path);
+        REQUIRE(result);
+        return result->interleaved_samples;
+    };
+    const auto fastest = WriteAndRead(0, "flac-compression-level-0.flac");
+    const auto smallest = WriteAndRead(8, "flac-compression-level-8.flac");
+    CHECK(fastest == smallest);
+    CHECK(fs::file_size("flac-compression-level-8.flac") < fs::file_size("flac-compression-level-0.flac"));
+
+    SUBCASE("a block size outside of the streamable subset") {
+        audio.flac_encoding_settings = {};
+        audio.flac_encoding_settings.block_size = 16384;
+        REQUIRE(WriteAudioFile("flac-large-block-size.flac", audio));
+        const auto result = ReadAudioFile("flac-large-block-size.flac");
+        REQUIRE(result);
+        CHECK(result->interleaved_samples == fastest);
+    }
+}
+
+// Run with: tests --test-case="FLAC encode benchmark" --no-skip
+TEST_CASE("FLAC encode benchmark" * doctest::skip()) {
+    std::vector<AudioData> test_data_corpus;
+    for (const auto &entry : fs::directory_iterator(TEST_DATA_DIRECTORY)) {
+        if (!IsPathReadableAudioFile(entry.path())) continue;
+        auto audio = ReadAudioFile(entry.path());
+        if (audio && CanFileBeConvertedToBitDepth(AudioFileFormat::Flac, audio->bits_per_sample)) {
+            test_data_corpus.push_back(std::move(*audio));
+        }
+    }
+
+    // A long file of the kind that is slow to encode: a couple of tones with some noise over them.
+    std::vector<AudioData> large_file_corpus(1);
+    {
+        auto &audio = large_file_corpus[0];
+        audio.num_channels = 2;
+        audio.sample_rate = 48000;
+        audio.bits_per_sample = 24;
+        const usize num_frames = 48000 * 60;
+        u32 random = 1;
+        for (usize frame = 0; frame < num_frames; ++frame) {
+            random = random * 1664525u + 1013904223u;
+            const auto noise = ((double)(random >> 8) / (double)(1 << 24)) * 0.02 - 0.01;
+            audio.interleaved_samples.push_back(std::sin((double)frame * 0.01) * 0.8 + noise);
+            audio.interleaved_samples.push_back(std::sin((double)frame * 0.013) * 0.5 + noise);
+        }
+    }
+
+    const fs::path output_path = "flac-encode-benchmark.flac";
+    const auto Benchmark = [&](std::string_view corpus_name, std::vector<AudioData> &corpus) {
+        for (unsigned level = 0; level <= FlacEncodingSettings::k_max_compression_level; ++level) {
+            double seconds = 0;
+            u64 num_pcm_bytes = 0;
+            u64 num_flac_bytes = 0;
+            for (auto &audio : corpus) {
+                audio.format = AudioFileFormat::Flac;
+                audio.flac_encoding_settings = {};
+                audio.flac_encoding_settings.compression_level = level;
+
+                const auto start = std::chrono::steady_clock::now();
+                REQUIRE(WriteAudioFile(output_path, audio));
+                seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                num_pcm_bytes += audio.interleaved_samples.size() * ((audio.bits_per_sample + 7) / 8);
+                num_flac_bytes += fs::file_size(output_path);
+            }
+            MessageWithNewLine("Benchmark", {}, "{} level {}: {:.1f} MB/s, {:.1f}% of the PCM size",
+                               corpus_name, level, (double)num_pcm_bytes / (1024.0 * 1024.0) / seconds,
+                               100.0 * (double)num_flac_bytes / (double)num_pcm_bytes);
+        }
+    };
+
+    // The thread pool is not used so that the levels are compared on equal terms.
+    SetNumParallelJobs(1);
+    Benchmark("test_data", test_data_corpus);
+    Benchmark("large file", large_file_corpus);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdio>
+#include <optional>
+#include <vector>
+
+#include "FLAC/stream_encoder.h"
+#include "span.hpp"
+
+#include "dither.h"
+#include "types.h"
+
+// How hard the FLAC encoder should work to make the file smaller. The compression level is one of libFLAC's
+// presets, from 0 (fastest) to 8 (smallest). The block size and maximum LPC order override the preset's
+// values.
+struct FlacEncodingSettings {
+    static constexpr unsigned k_default_compression_level = 5;
+    static constexpr unsigned k_max_compression_level = 8;
+
+    unsigned compression_level = k_default_compression_level;
+    std::optional<unsigned> block_size {};
+    std::optional<unsigned> max_lpc_order {};
+};
+
+// The number of frames in each FLAC block; when it is not given explicitly it is the block size that libFLAC
+// would choose for the preset.
+unsigned GetFlacBlockSize(const FlacEncodingSettings &settings);
+
+// Applies the settings that every FLAC encoder that Signet creates should have, so that files are encoded in
+// the same way regardless of whether they are encoded in parallel or not.
+void ConfigureFlacEncoder(FLAC__StreamEncoder *encoder,
+                          const FlacEncodingSettings &settings,
+                          unsigned num_channels,
+                          unsigned bits_per_sample,
+                          unsigned sample_rate,
+                          u64 num_frames);
+
+// Whether it is worth splitting the file up and encoding it on multiple threads.
+bool ShouldEncodeFlacInParallel(const FlacEncodingSettings &settings, u64 num_frames);
+
+// Encodes the samples on the threads of the ParallelFor thread pool, and writes a complete FLAC stream to the
+// file. The signal is split into chunks of whole FLAC blocks which are encoded independently, and then the
+// frames are stitched together - renumbered and with their CRCs recalculated. The STREAMINFO block is filled
+// in with the values that a single encoder would have given it, including the MD5 of the whole signal. The
+// output is identical to encoding the whole file with a single encoder, except with the presets that use
+// loose mid-side stereo, where the chunks may choose different stereo modes near their boundaries. The
+// samples are quantised by copies of quantiser a block at a time as they are encoded. Returns false if
+// encoding failed.
+bool WriteFlacFileInParallel(FILE *file,
+                             const FlacEncodingSettings &settings,
+                             unsigned num_channels,
+                             unsigned bits_per_sample,
+                             unsigned sample_rate,
+                             std::vector<FLAC__StreamMetadata *> &metadata,
+                             tcb::span<const double> interleaved_samples,
+                             const SampleQuantiser &quantiser);
@@ -22,23 +22,10 @@ void NormaliseToTarget(std::vector<double> &samples, const double target_amp) {
 
 double GetRMS(const tcb::span<const double> samples) {
     if (!samples.size()) return 0;
-    double result = 0;
-    for (const auto s : samples) {
-        result += s * s;
-    }
-    result /= samples.size();
-    REQUIRE(result >= 0);
-    return std::sqrt(result);
+    return std::sqrt(GetSumOfSquares(samples) / (double)samples.size());
 }
 
-double GetPeak(const tcb::span<const double> samples) {
-    if (!samples.size()) return 0;
-    double result = 0;
-    for (const auto s : samples) {
-        result = std::max(result, std::abs(s));
-    }
-    return result;
-}
+double GetPeak(const tcb::span<const double> samples) { return GetPeakMagnitude(samples); }
 
 TEST_CASE_TEMPLATE("[NormaliseCommand] gain calcs", T, RMSGainCalculator, PeakGainCalculator) {
     T calc;
@@ -8,11 +8,20 @@
 
 #include "audio_data.h"
 #include "common.h"
+#include "sample_kernels.h"
 
 class NormalisationGainCalculator {
   public:
     virtual ~NormalisationGainCalculator() {}
-    virtual bool RegisterBufferMagnitudes(const AudioData &audio, std::optional<unsigned> channel) = 0;
+    bool RegisterBufferMagnitudes(const AudioData &audio, std::optional<unsigned> channel) {
+        std::vector<SampleStatistics> stats(audio.num_channels);
+        AddChannelStatistics(audio.interleaved_samples, audio.num_channels, stats);
+        return RegisterChannelStatistics(stats, channel);
+    }
+    // The same as RegisterBufferMagnitudes, but for audio whose statistics have already been worked out,
+    // one for each channel.
+    virtual bool RegisterChannelStatistics(tcb::span<const SampleStatistics> stats,
+                                           std::optional<unsigned> channel) = 0;
     virtual double GetGain(double target_amp) const = 0;
     virtual const char *GetName() const = 0;
     virtual double GetLargestRegisteredMagnitude() const = 0;
@@ -21,27 +30,22 @@ class NormalisationGainCalculator {
 
 class RMSGainCalculator : public NormalisationGainCalculator {
   public:
-    bool RegisterBufferMagnitudes(const AudioData &audio, std::optional<unsigned> channel) override {
+    bool RegisterChannelStatistics(tcb::span<const SampleStatistics> stats,
+                                   std::optional<unsigned> channel) override {
         if (!m_sum_of_squares_channels.size()) {
-            m_sum_of_squares_channels.resize(audio.num_channels);
+            m_sum_of_squares_channels.resize(stats.size());
         }
-        if (m_sum_of_squares_channels.size() != audio.num_channels) {
+        if (m_sum_of_squares_channels.size() != stats.size()) {
             ErrorWithNewLine(
                 "Norm", {},
                 "Audio file has a different number of channels to a previous one - for RMS normalisation, all files must have the same number of channels");
             return false;
         }
-        for (size_t frame = 0; frame < audio.NumFrames(); ++frame) {
-            if (channel) {
-                m_sum_of_squares_channels[*channel] += std::pow(audio.GetSample(*channel, frame), 2.0);
-            } else {
-                for (unsigned chan = 0; chan < audio.num_channels; ++chan) {
-                    const auto sample_index = frame * audio.num_channels + chan;
-                    m_sum_of_squares_channels[chan] += std::pow(audio.interleaved_samples[sample_index], 2.0);
-                }
-            }
+        for (unsigned chan = 0; chan < stats.size(); ++chan) {
+            if (channel && *channel != chan) continue;
+            m_sum_of_squares_channels[chan] += stats[chan].sum_of_squares;
         }
-        m_num_frames += audio.NumFrames();
+        if (stats.size()) m_num_frames += stats[0].num_samples;
         return true;
     }
 
@@ -84,17 +88,12 @@ class RMSGainCalculator : public NormalisationGainCalculator {
 
 class PeakGainCalculator : public NormalisationGainCalculator {
   public:
-    bool RegisterBufferMagnitudes(const AudioData &audio, std::optional<unsigned> channel) override {
+    bool RegisterChannelStatistics(tcb::span<const SampleStatistics> stats,
+                                   std::optional<unsigned> channel) override {
         double max_magnitude = 0;
-
-        for (size_t frame = 0; frame < audio.NumFrames(); ++frame) {
-            if (channel) {
-                max_magnitude = std::max(max_magnitude, std::abs(audio.GetSample(*channel, frame)));
-            } else {
-                for (unsigned chan = 0; chan < audio.num_channels; ++chan) {
-                    max_magnitude = std::max(max_magnitude, std::abs(audio.GetSample(chan, frame)));
-                }
-            }
+        for (unsigned chan = 0; chan < stats.size(); ++chan) {
+            if (channel && *channel != chan) continue;
+            max_magnitude = std::max(max_magnitude, stats[chan].peak);
         }
         m_max_magnitude = std::max(m_max_magnitude, max_magnitude);
         REQUIRE(m_max_magnitude >= 0);
@@ -4,6 +4,8 @@
 
 #include "CLI11.hpp"
 
+#include "thread_pool.h"
+
 void IdenticalProcessingSet::AddCli(CLI::App &command) {
     command
         .add_option(
@@ -67,9 +69,9 @@ void IdenticalProcessingSet::ProcessSets(
 
     std::unordered_map<std::string, std::vector<EditTrackedAudioFile *>> sets;
 
-    std::smatch match;
     for (auto &f : files) {
         const auto filename = GetJustFilenameWithNoExtension(f.GetPath());
+        std::smatch match;
 
         std::string replaced = filename;
         if (std::regex_match(filename, match, re)) {
@@ -84,9 +86,17 @@ void IdenticalProcessingSet::ProcessSets(
         arr.push_back(&f);
     }
 
+    // Each set contains different files so they can be processed in parallel
+    std::vector<decltype(sets)::value_type *> sets_list;
     for (auto &set : sets) {
+        sets_list.push_back(&set);
+    }
+
+    ParallelFor(sets_list.size(), [&](usize set_index) {
+        const auto &set = *sets_list[set_index];
         const auto human_set_name = GetJustFilenameWithNoExtension(set.first);
 
+        std::smatch match;
         EditTrackedAudioFile *authority_file = nullptr;
         for (auto &f : set.second) {
             const auto filename = GetJustFilenameWithNoExtension(f->GetPath());
@@ -116,11 +126,11 @@ void IdenticalProcessingSet::ProcessSets(
                 "Failed to process sample-set because the authority file could not be identified\nSet: \"{}\"\nAuthority: \"{}\"",
                 human_set_name, authority_matcher);
         }
-    }
+    });
 }
 
 bool IdenticalProcessingSet::AllHaveSameNumFrames(const std::vector<EditTrackedAudioFile *> &set) {
     return std::all_of(set.begin(), set.end(), [&set](EditTrackedAudioFile *f) {
-        return f->GetAudio().NumFrames() == set.front()->GetAudio().NumFrames();
+        return f->GetInfo().num_frames == set.front()->GetInfo().num_frames;
     });
 }
@@ -0,0 +1,242 @@
+#include "incremental_manifest.h"
+
+#include <fstream>
+#include <vector>
+
+#include "doctest.hpp"
+#include "json.hpp"
+
+#include "common.h"
+#include "sample_kernels.h"
+
+static constexpr int k_manifest_version = 1;
+
+// Files are hashed in blocks of this many bytes, so that a whole file does not have to be in memory.
+static constexpr usize k_hash_block_size = 1 << 20;
+
+static std::optional<u64> HashFileContent(const fs::path &path) {
+    std::ifstream stream(path.generic_string(), std::ifstream::in | std::ifstream::binary);
+    if (!stream) return {};
+
+    // The bytes are hashed with the same function as samples are; it only looks at the bits of each value.
+    std::vector<double> block(k_hash_block_size / sizeof(double));
+    u64 hash = 0;
+    while (stream) {
+        std::fill(block.begin(), block.end(), 0.0);
+        stream.read(reinterpret_cast<char *>(block.data()), k_hash_block_size);
+        const auto num_bytes = (usize)stream.gcount();
+        if (!num_bytes) break;
+        const auto num_values = (num_bytes + sizeof(double) - 1) / sizeof(double);
+        hash = HashSamples({block.data(), num_values}, hash ^ num_bytes);
+    }
+    if (stream.bad()) return {};
+    return hash;
+}
+
+static bool ReadSizeAndModificationTime(const fs::path &path, FileState &state) {
+    std::error_code ec;
+    const auto size = fs::file_size(path, ec);
+    if (ec) return false;
+    const auto modification_time = fs::last_write_time(path, ec);
+    if (ec) return false;
+    state.size = (u64)size;
+    state.modification_time = (s64)modification_time.time_since_epoch().count();
+    return true;
+}
+
+std::optional<FileState> ReadFileState(const fs::path &path) {
+    FileState state {};
+    if (!ReadSizeAndModificationTime(path, state)) return {};
+    const auto hash = HashFileContent(path);
+    if (!hash) return {};
+    state.content_hash = *hash;
+    return state;
+}
+
+// The same file can be given to Signet by different paths, so it is identified by its canonical path.
+static std::string CanonicalPathString(const fs::path &path) {
+    std::error_code ec;
+    const auto canonical = fs::canonical(path, ec);
+    if (ec) return fs::absolute(path).lexically_normal().generic_string();
+    return canonical.generic_string();
+}
+
+static nlohmann::json FileStateToJson(const FileState &state) {
+    return {{"size", state.size},
+            {"modification_time", state.modification_time},
+            {"content_hash", state.content_hash}};
+}
+
+static FileState FileStateFromJson(const nlohmann::json &json) {
+    return {json.at("size").get<u64>(), json.at("modification_time").get<s64>(),
+            json.at("content_hash").get<u64>()};
+}
+
+IncrementalManifest::IncrementalManifest(const fs::path &path, std::string command_chain)
+    : m_path(path)
+    , m_command_chain(std::move(command_chain)) {
+    if (!fs::is_regular_file(m_path)) return;
+
+    try {
+        std::ifstream i(m_path.generic_string(), std::ifstream::in | std::ifstream::binary);
+        if (!i) {
+            ErrorWithNewLine("Incremental", {}, "Could not open the manifest file {}", m_path);
+            return;
+        }
+        nlohmann::json manifest;
+        i >> manifest;
+        if (manifest.at("version").get<int>() != k_manifest_version) {
+            MessageWithNewLine(
+                "Incremental", {},
+                "The manifest file {} is from another version of Signet, all files will be processed", m_path);
+            return;
+        }
+        for (const auto &[input_path, entry] : manifest.at("entries").items()) {
+            m_entries[input_path] = {entry.at("command_chain").get<std::string>(),
+                                     FileStateFromJson(entry.at("input")),
+                                     entry.at("output_path").get<std::string>(),
+                                     FileStateFromJson(entry.at("output"))};
+        }
+    } catch (const nlohmann::json::exception &e) {
+        m_entries.clear();
+        WarningWithNewLine("Incremental", {}, "Could not parse the manifest file {}: {}", m_path, e.what());
+    }
+}
+
+bool IncrementalManifest::FileIsUnchanged(const fs::path &path, FileState &state) {
+    FileState current {};
+    if (!ReadSizeAndModificationTime(path, current)) return false;
+    if (current.size != state.size) return false;
+    if (current.modification_time == state.modification_time) return true;
+
+    const auto hash = HashFileContent(path);
+    if (!hash || *hash != state.content_hash) return false;
+    // The content is the same, so remember the new time so that the file does not have to be read next time.
+    state.modification_time = current.modification_time;
+    m_changed = true;
+    return true;
+}
+
+bool IncrementalManifest::IsUpToDate(const fs::path &input_path) {
+    const auto input = CanonicalPathString(input_path);
+    const auto it = m_entries.find(input);
+    if (it == m_entries.end()) return false;
+    auto &entry = it->second;
+    if (entry.command_chain != m_command_chain) return false;
+    if (!FileIsUnchanged(entry.output_path, entry.output)) return false;
+
+    // When the file was processed in place, what was written replaced the input, so the output is all that
+    // there is to check.
+    if (entry.output_path == input) return true;
+    return FileIsUnchanged(input, entry.input);
+}
+
+void IncrementalManifest::FileWasProcessed(const fs::path &input_path, const fs::path &output_path) {
+    const auto input = CanonicalPathString(input_path);
+    const auto output = CanonicalPathString(output_path);
+    const auto output_state = ReadFileState(output);
+    if (!output_state) {
+        m_entries.erase(input);
+        m_changed = true;
+        return;
+    }
+
+    std::optional<FileState> input_state = output_state;
+    if (input != output) input_state = ReadFileState(input);
+    if (!input_state) {
+        m_entries.erase(input);
+        m_changed = true;
+        return;
+    }
+
+    m_entries[input] = {m_command_chain, *input_state, output, *output_state};
+    m_changed = true;
+}
+
+bool IncrementalManifest::Save() {
+    if (!m_changed) return true;
+
+    nlohmann::json entries = nlohmann::json::object();
+    for (const auto &[input_path, entry] : m_entries) {
+        entries[input_path] = {{"command_chain", entry.command_chain},
+                               {"input", FileStateToJson(entry.input)},
+                               {"output_path", entry.output_path},
+                               {"output", FileStateToJson(entry.output)}};
+    }
+    const nlohmann::json manifest = {{"version", k_manifest_version}, {"entries", entries}};
+
+    std::ofstream o(m_path.generic_string(), std::ofstream::out | std::ofstream::binary);
+    if (!o) {
+        ErrorWithNewLine("Incremental", {}, "Could not write to the manifest file {}", m_path);
+        return false;
+    }
+    o << manifest.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace) << std::endl;
+    if (!o) {
+        ErrorWithNewLine("Incremental", {}, "Could not write to the manifest file {}", m_path);
+        return false;
+    }
+    m_changed = false;
+    return true;
+}
+
+TEST_CASE("IncrementalManifest") {
+    const fs::path manifest_path = "incremental-manifest-test.json";
+    const fs::path input = "incremental-manifest-test-input.bin";
+    const fs::path output = "incremental-manifest-test-output.bin";
+    const auto WriteFile = [](const fs::path &path, const std::string &content) {
+        std::ofstream o(path.generic_string(), std::ofstream::out | std::ofstream::binary);
+        o << content;
+    };
+    std::error_code ec;
+    fs::remove(manifest_path, ec);
+    WriteFile(input, "input");
+    WriteFile(output, "output");
+
+    {
+        IncrementalManifest manifest {manifest_path, "gain 50%"};
+        CHECK(!manifest.IsUpToDate(input));
+        manifest.FileWasProcessed(input, output);
+        CHECK(manifest.IsUpToDate(input));
+        REQUIRE(manifest.Save());
+    }
+
+    SUBCASE("the manifest is kept between runs") {
+        IncrementalManifest manifest {manifest_path, "gain 50%"};
+        CHECK(manifest.IsUpToDate(input));
+    }
+
+    SUBCASE("a different command chain") {
+        IncrementalManifest manifest {manifest_path, "gain 40%"};
+        CHECK(!manifest.IsUpToDate(input));
+    }
+
+    SUBCASE("a touched file that is the same") {
+        fs::last_write_time(input, fs::last_write_time(input) + std::chrono::seconds(10));
+        IncrementalManifest manifest {manifest_path, "gain 50%"};
+        CHECK(manifest.IsUpToDate(input));
+    }
+
+    SUBCASE("a changed input") {
+        WriteFile(input, "INPUT");
+        fs::last_write_time(input, fs::last_write_time(input) + std::chrono::seconds(10));
+        IncrementalManifest manifest {manifest_path, "gain 50%"};
+        CHECK(!manifest.IsUpToDate(input));
+    }
+
+    SUBCASE("a changed output") {
+        WriteFile(output, "out");
+        IncrementalManifest manifest {manifest_path, "gain 50%"};
+        CHECK(!manifest.IsUpToDate(input));
+    }
+
+    SUBCASE("a file processed in place is up-to-date with what was written") {
+        IncrementalManifest manifest {manifest_path, "gain 50%"};
+        WriteFile(input, "processed input");
+        manifest.FileWasProcessed(input, input);
+        CHECK(manifest.IsUpToDate(input));
+    }
+
+    fs::remove(manifest_path, ec);
+    fs::remove(input, ec);
+    fs::remove(output, ec);
+}
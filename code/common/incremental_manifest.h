@@ -0,0 +1,55 @@
+#pragma once
+#include <map>
+#include <optional>
+#include <string>
+
+#include "filesystem.hpp"
+
+#include "types.h"
+
+// The state of a file on disk, for telling whether it has changed since it was last seen. The content hash
+// is only compared when the modification time differs, so a file that has been touched or copied, but not
+// changed, still counts as the same.
+struct FileState {
+    u64 size {};
+    s64 modification_time {};
+    u64 content_hash {};
+};
+
+// Returns nullopt if the file cannot be read.
+std::optional<FileState> ReadFileState(const fs::path &path);
+
+// A record of the files that were processed by previous runs of Signet, for skipping the files that would
+// be processed in the same way again. Each input file is recorded with the command chain that processed it
+// and the file that was written for it. The command chain is any text that identifies the processing, such
+// as the canonicalised command line and the version of Signet.
+class IncrementalManifest {
+  public:
+    IncrementalManifest(const fs::path &path, std::string command_chain);
+
+    // True if the file was processed with the same command chain by a previous run, and neither it nor the
+    // file that was written for it have changed since. The file is not read unless its modification time has
+    // changed.
+    bool IsUpToDate(const fs::path &input_path);
+
+    // Records that input_path has been processed and written to output_path, which can be the same path.
+    void FileWasProcessed(const fs::path &input_path, const fs::path &output_path);
+
+    // Writes the file, if anything has changed.
+    bool Save();
+
+  private:
+    struct Entry {
+        std::string command_chain;
+        FileState input;
+        std::string output_path;
+        FileState output;
+    };
+
+    bool FileIsUnchanged(const fs::path &path, FileState &state);
+
+    fs::path m_path;
+    std::string m_command_chain;
+    std::map<std::string, Entry> m_entries {};
+    bool m_changed {};
+};
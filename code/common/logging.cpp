@@ -0,0 +1,306 @@
+#include "logging.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#if WIN32
+#include <windows.h>
+#endif
+
+#include "doctest.hpp"
+#include "fmt/color.h"
+#include "json.hpp"
+
+#include "types.h"
+
+static bool EnableVTMode() {
+#if WIN32
+    // Set output mode to handle virtual terminal sequences
+    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (hOut == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    DWORD dwMode = 0;
+    if (!GetConsoleMode(hOut, &dwMode)) {
+        return false;
+    }
+
+    dwMode |= ENABLE_VIRTUAL_TERMINAL_PROCESSING;
+    if (!SetConsoleMode(hOut, dwMode)) {
+        return false;
+    }
+#endif
+    return true;
+}
+
+// A multiple-producer, single-consumer queue that producers can push to without taking a lock. Producers
+// atomically swap their node in as the new head, and then link the previous head to it. The consumer follows
+// the links from the tail. A node only becomes visible to the consumer once it has been linked, so the
+// records of each push are always popped whole and in the order that they were linked.
+class LogQueue {
+  public:
+    LogQueue() : m_head(&m_stub), m_tail(&m_stub) {}
+    ~LogQueue() {
+        std::vector<LogRecord> records;
+        while (Pop(records)) {
+        }
+        if (m_tail != &m_stub) delete m_tail;
+    }
+
+    void Push(std::vector<LogRecord> records) {
+        auto node = new Node {{nullptr}, std::move(records)};
+        auto previous_head = m_head.exchange(node);
+        previous_head->next.store(node);
+    }
+
+    // Only the consumer thread may call this.
+    bool Pop(std::vector<LogRecord> &records) {
+        auto tail = m_tail;
+        auto next = tail->next.load();
+        if (!next) return false;
+        records = std::move(next->records);
+        m_tail = next;
+        if (tail != &m_stub) delete tail;
+        return true;
+    }
+
+    // Only the consumer thread may call this.
+    bool Empty() const { return m_tail->next.load() == nullptr; }
+
+  private:
+    struct Node {
+        std::atomic<Node *> next;
+        std::vector<LogRecord> records;
+    };
+
+    Node m_stub {{nullptr}, {}};
+    std::atomic<Node *> m_head;
+    Node *m_tail;
+};
+
+static std::atomic<LogFormat> g_log_format {LogFormat::Text};
+
+class LogWriter {
+  public:
+    LogWriter() : m_thread([this] { Run(); }) {}
+    ~LogWriter() {
+        {
+            std::scoped_lock lock {m_mutex};
+            m_quit = true;
+        }
+        m_wake.notify_one();
+        m_thread.join();
+    }
+
+    void Submit(std::vector<LogRecord> records) {
+        ++m_num_submitted;
+        m_queue.Push(std::move(records));
+        // Only take the lock if the writer thread could be asleep; most of the time it isn't.
+        if (m_writer_waiting.load()) {
+            std::scoped_lock lock {m_mutex};
+            m_wake.notify_one();
+        }
+    }
+
+    void Flush() {
+        const auto target = m_num_submitted.load();
+        std::unique_lock lock {m_mutex};
+        m_written.wait(lock, [&] { return m_num_written >= target; });
+    }
+
+  private:
+    void Run() {
+        EnableVTMode();
+
+        std::string buffer;
+        u64 num_buffered = 0;
+        const auto WriteBuffer = [&]() {
+            std::fwrite(buffer.data(), 1, buffer.size(), stdout);
+            std::fflush(stdout);
+            buffer.clear();
+            {
+                std::scoped_lock lock {m_mutex};
+                m_num_written += num_buffered;
+            }
+            num_buffered = 0;
+            m_written.notify_all();
+        };
+
+        std::vector<LogRecord> records;
+        while (true) {
+            // Batch up as much as is available so that the terminal is written to as few times as possible.
+            while (m_queue.Pop(records)) {
+                const auto format = g_log_format.load();
+                for (const auto &r : records) {
+                    buffer += FormatLogRecord(r, format);
+                }
+                ++num_buffered;
+                if (buffer.size() >= 64 * 1024) WriteBuffer();
+            }
+            if (num_buffered) WriteBuffer();
+
+            std::unique_lock lock {m_mutex};
+            m_writer_waiting = true;
+            m_wake.wait(lock, [&] { return m_quit || !m_queue.Empty(); });
+            m_writer_waiting = false;
+            if (m_quit && m_queue.Empty()) return;
+        }
+    }
+
+    LogQueue m_queue {};
+    std::atomic<u64> m_num_submitted {};
+    std::atomic<bool> m_writer_waiting {};
+
+    std::mutex m_mutex {};
+    std::condition_variable m_wake {};
+    std::condition_variable m_written {};
+    u64 m_num_written {};
+    bool m_quit {};
+
+    std::thread m_thread; // must be last so that everything else is initialised before the thread starts
+};
+
+static LogWriter &GetLogWriter() {
+    static LogWriter writer;
+    return writer;
+}
+
+void SetLogFormat(LogFormat format) { g_log_format = format; }
+LogFormat GetLogFormat() { return g_log_format; }
+
+static thread_local std::vector<LogRecord> *g_log_capture_buffer = nullptr;
+
+std::vector<LogRecord> *GetLogCaptureBuffer() { return g_log_capture_buffer; }
+std::vector<LogRecord> *SetLogCaptureBuffer(std::vector<LogRecord> *buffer) {
+    return std::exchange(g_log_capture_buffer, buffer);
+}
+
+void Log(LogRecord record) {
+    if (g_log_capture_buffer) {
+        g_log_capture_buffer->push_back(std::move(record));
+        return;
+    }
+    std::vector<LogRecord> records;
+    records.push_back(std::move(record));
+    GetLogWriter().Submit(std::move(records));
+}
+
+void Log(std::vector<LogRecord> records) {
+    if (records.empty()) return;
+    if (g_log_capture_buffer) {
+        g_log_capture_buffer->insert(g_log_capture_buffer->end(), std::make_move_iterator(records.begin()),
+                                     std::make_move_iterator(records.end()));
+        return;
+    }
+    GetLogWriter().Submit(std::move(records));
+}
+
+void WriteOutput(std::string_view str) { Log({LogLevel::Output, {}, {}, std::string(str)}); }
+
+void FlushLog() { GetLogWriter().Flush(); }
+
+static std::string_view LogLevelName(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug: return "debug";
+        case LogLevel::Message: return "message";
+        case LogLevel::Warning: return "warning";
+        case LogLevel::Error: return "error";
+        case LogLevel::Output: return "output";
+        case LogLevel::Success: return "success";
+        case LogLevel::Failure: return "failure";
+    }
+    return "";
+}
+
+std::string FormatLogRecord(const LogRecord &r, LogFormat format) {
+    if (format == LogFormat::JsonLines) {
+        auto text = std::string_view(r.text);
+        if (r.level == LogLevel::Output && text.size() && text.back() == '\n') text.remove_suffix(1);
+
+        nlohmann::ordered_json json;
+        json["level"] = LogLevelName(r.level);
+        if (r.heading.size()) json["heading"] = r.heading;
+        if (r.filename.size()) json["file"] = r.filename;
+        json["text"] = std::string(text);
+        return json.dump(-1, ' ', false, nlohmann::ordered_json::error_handler_t::replace) + "\n";
+    }
+
+    std::string result;
+    switch (r.level) {
+        case LogLevel::Debug: result = fmt::format(fmt::emphasis::bold, "[DEBUG]"); break;
+        case LogLevel::Message:
+            result = fmt::format(fmt::fg(fmt::color::cornflower_blue) | fmt::emphasis::bold, "[{}]", r.heading);
+            break;
+        case LogLevel::Warning:
+            result = fmt::format(fmt::fg(fmt::color::orange) | fmt::emphasis::bold, "[{}] WARNING", r.heading);
+            break;
+        case LogLevel::Error:
+            result = fmt::format(fmt::fg(fmt::color::red) | fmt::emphasis::bold, "[{}] ERROR", r.heading);
+            break;
+        case LogLevel::Output: return r.text;
+        case LogLevel::Success: return fmt::format(fmt::fg(fmt::terminal_color::green), "{}\n", r.text);
+        case LogLevel::Failure:
+            return fmt::format(fmt::fg(fmt::color::red) | fmt::emphasis::bold, "{}\n", r.text);
+    }
+    result += ": ";
+    result += r.text;
+    if (r.filename.size()) {
+        result += ": ";
+        result += fmt::format(fmt::fg(fmt::color::navajo_white), "{}", r.filename);
+    }
+    result += "\n";
+    return result;
+}
+
+TEST_CASE("Logging") {
+    SUBCASE("json lines") {
+        CHECK(FormatLogRecord({LogLevel::Warning, "Gain", "file", "quiet \"sample\""}, LogFormat::JsonLines) ==
+              "{\"level\":\"warning\",\"heading\":\"Gain\",\"file\":\"file\",\"text\":\"quiet \\\"sample\\\"\"}\n");
+        CHECK(FormatLogRecord({LogLevel::Output, {}, {}, "1,2,3\n"}, LogFormat::JsonLines) ==
+              "{\"level\":\"output\",\"text\":\"1,2,3\"}\n");
+    }
+
+    SUBCASE("text") {
+        CHECK(FormatLogRecord({LogLevel::Output, {}, {}, "1,2,3\n"}, LogFormat::Text) == "1,2,3\n");
+        const auto message = FormatLogRecord({LogLevel::Message, "Gain", "file", "hello"}, LogFormat::Text);
+        CHECK(message.find("Gain") != std::string::npos);
+        CHECK(message.find("hello") != std::string::npos);
+        CHECK(message.find("file") != std::string::npos);
+        CHECK(message.back() == '\n');
+    }
+
+    SUBCASE("capture buffer") {
+        std::vector<LogRecord> captured;
+        const auto previous_buffer = SetLogCaptureBuffer(&captured);
+        Log({LogLevel::Message, "A", {}, "1"});
+        Log(std::vector<LogRecord> {{LogLevel::Message, "B", {}, "2"}, {LogLevel::Message, "C", {}, "3"}});
+        WriteOutput("4");
+        SetLogCaptureBuffer(previous_buffer);
+
+        REQUIRE(captured.size() == 4);
+        CHECK(captured[0].heading == "A");
+        CHECK(captured[2].text == "3");
+        CHECK(captured[3].level == LogLevel::Output);
+    }
+
+    SUBCASE("many threads") {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads.emplace_back([] {
+                for (int j = 0; j < 100; ++j) {
+                    Log({LogLevel::Output, {}, {}, {}});
+                }
+            });
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+        FlushLog();
+    }
+}
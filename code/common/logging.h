@@ -0,0 +1,46 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Everything that Signet prints goes through this logging system. Messages are turned into records on the
+// thread that produces them, and then handed over to a single writer thread via a lock-free queue. The writer
+// thread is the only thing that formats and prints records, so a slow terminal never holds up processing, and
+// lines from different threads can never be interleaved.
+
+enum class LogLevel { Debug, Message, Warning, Error, Output, Success, Failure };
+
+enum class LogFormat {
+    Text, // Coloured, human-readable text
+    JsonLines, // One JSON object per line
+};
+
+struct LogRecord {
+    LogLevel level {};
+    std::string heading {};
+    std::string filename {};
+    std::string text {};
+};
+
+void SetLogFormat(LogFormat format);
+LogFormat GetLogFormat();
+
+// When the calling thread has a capture buffer set, records are appended to it instead of being sent to the
+// writer thread. This allows the messages for each file that is processed in parallel to be collected and then
+// logged in a consistent order.
+std::vector<LogRecord> *GetLogCaptureBuffer();
+std::vector<LogRecord> *SetLogCaptureBuffer(std::vector<LogRecord> *buffer); // returns the previous buffer
+
+void Log(LogRecord record);
+
+// The records are guaranteed to be printed together without anything else in-between them.
+void Log(std::vector<LogRecord> records);
+
+// Prints text as-is; used for output that isn't a message, such as CSV data.
+void WriteOutput(std::string_view str);
+
+// Blocks until everything that has been logged so far has been printed. This must be called before printing
+// directly to stdout.
+void FlushLog();
+
+std::string FormatLogRecord(const LogRecord &record, LogFormat format);
@@ -0,0 +1,109 @@
+#include "mapped_file.h"
+
+#if _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "doctest.hpp"
+
+#include "tests_config.h"
+
+bool MappedFile::Map(const fs::path &path, std::error_code &ec) {
+    Unmap();
+    ec = {};
+
+#if _WIN32
+    const auto file = CreateFileW(path.wstring().data(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        ec = {(int)GetLastError(), std::system_category()};
+        return false;
+    }
+
+    LARGE_INTEGER size {};
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        ec = size.QuadPart == 0 ? std::make_error_code(std::errc::invalid_argument)
+                                : std::error_code {(int)GetLastError(), std::system_category()};
+        CloseHandle(file);
+        return false;
+    }
+
+    const auto mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping) {
+        ec = {(int)GetLastError(), std::system_category()};
+        return false;
+    }
+
+    // The view keeps the mapping alive, so the handle is not needed after this.
+    const auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!view) {
+        ec = {(int)GetLastError(), std::system_category()};
+        return false;
+    }
+
+    m_data = (const u8 *)view;
+    m_size = (usize)size.QuadPart;
+#else
+    const auto fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        ec = {errno, std::generic_category()};
+        return false;
+    }
+
+    struct stat info {};
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ec = info.st_size == 0 ? std::make_error_code(std::errc::invalid_argument)
+                               : std::error_code {errno, std::generic_category()};
+        close(fd);
+        return false;
+    }
+
+    // The mapping stays valid after the file descriptor is closed.
+    const auto data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        ec = {errno, std::generic_category()};
+        return false;
+    }
+    // Audio files are almost always read from start to end, let the OS read ahead aggressively.
+    madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+    m_data = (const u8 *)data;
+    m_size = (usize)info.st_size;
+#endif
+    return true;
+}
+
+void MappedFile::Unmap() {
+    if (!m_data) return;
+#if _WIN32
+    UnmapViewOfFile(m_data);
+#else
+    munmap((void *)m_data, m_size);
+#endif
+    m_data = nullptr;
+    m_size = 0;
+}
+
+TEST_CASE("MappedFile") {
+    const fs::path path = TEST_DATA_DIRECTORY "/white-noise.wav";
+    MappedFile file;
+    std::error_code ec;
+    REQUIRE(file.Map(path, ec));
+    REQUIRE(file.IsMapped());
+    REQUIRE(file.Size() == fs::file_size(path));
+    CHECK(std::string_view((const char *)file.Data(), 4) == "RIFF");
+
+    file.Unmap();
+    CHECK(!file.IsMapped());
+
+    CHECK(!file.Map("file-that-does-not-exist.wav", ec));
+    CHECK(ec);
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <system_error>
+
+#include "filesystem.hpp"
+
+#include "types.h"
+
+// A read-only view of a whole file's contents, mapped into memory by the OS. The bytes are read straight from
+// the page cache when they are accessed, so there is no need to copy the file into a buffer first.
+class MappedFile {
+  public:
+    MappedFile() {}
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile() { Unmap(); }
+
+    // Returns false and sets ec if the file could not be mapped, which includes when the file is empty.
+    bool Map(const fs::path &path, std::error_code &ec);
+    void Unmap();
+
+    bool IsMapped() const { return m_data != nullptr; }
+    const u8 *Data() const { return m_data; }
+    usize Size() const { return m_size; }
+
+  private:
+    const u8 *m_data {};
+    usize m_size {};
+};
@@ -0,0 +1,227 @@
+#include "packed_samples.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+
+#include "doctest.hpp"
+
+#include "common.h"
+
+static std::atomic<SamplePrecision> g_sample_storage_precision {SamplePrecision::F64};
+
+void SetSampleStoragePrecision(SamplePrecision precision) { g_sample_storage_precision = precision; }
+SamplePrecision GetSampleStoragePrecision() { return g_sample_storage_precision; }
+
+// Integers are scaled in the same way that the decoders scale them, so the samples of a file that has not
+// been processed come back exactly as they were read. Returns false if any of the samples are not exactly
+// one of the integer values, such as after a gain change, so the samples are never rounded.
+template <typename IntType>
+static bool PackToInt(tcb::span<const double> samples, double scale, std::vector<IntType> &out) {
+    const auto min = -scale;
+    const auto max = scale - 1;
+    out.resize(samples.size());
+    for (usize i = 0; i < samples.size(); ++i) {
+        const auto s = samples[i] * scale;
+        if (s != std::round(s) || s < min || s > max) return false;
+        out[i] = (IntType)s;
+    }
+    return true;
+}
+
+// Returns false if any of the samples would be changed by converting them to float.
+static bool PackToFloatExactly(tcb::span<const double> samples, std::vector<float> &out) {
+    out.resize(samples.size());
+    for (usize i = 0; i < samples.size(); ++i) {
+        out[i] = (float)samples[i];
+        if ((double)out[i] != samples[i]) return false;
+    }
+    return true;
+}
+
+template <typename Type>
+static void UnpackToDouble(tcb::span<const Type> in, double scale, std::vector<double> &out) {
+    out.resize(in.size());
+    for (usize i = 0; i < in.size(); ++i) {
+        out[i] = (double)in[i] * scale;
+    }
+}
+
+bool PackedSamples::Pack(tcb::span<const double> samples,
+                         SamplePrecision precision,
+                         unsigned bits_per_sample) {
+    m_samples = {};
+    m_scale = 1;
+    if (precision == SamplePrecision::F64) return false;
+
+    // 32 and 64-bit files are always written as floating point.
+    if (precision == SamplePrecision::Native && bits_per_sample <= 24) {
+        const auto scale = std::ldexp(1.0, (int)bits_per_sample - 1);
+        const auto TryPackToInt = [&](auto int_vector) {
+            if (!PackToInt(samples, scale, int_vector)) return false;
+            m_samples = std::move(int_vector);
+            m_scale = 1.0 / scale;
+            return true;
+        };
+        if (bits_per_sample <= 8 && TryPackToInt(std::vector<s8> {})) return true;
+        if (bits_per_sample > 8 && bits_per_sample <= 16 && TryPackToInt(std::vector<s16> {})) return true;
+        if (bits_per_sample > 16 && TryPackToInt(std::vector<s32> {})) return true;
+    } else if (precision == SamplePrecision::Native && bits_per_sample == 64) {
+        return false;
+    }
+
+    if (precision == SamplePrecision::Native) {
+        // Native never changes the samples, so if float cannot hold them exactly they are not packed at all.
+        std::vector<float> float_samples;
+        if (!PackToFloatExactly(samples, float_samples)) return false;
+        m_samples = std::move(float_samples);
+        return true;
+    }
+
+    m_samples = std::vector<float>(samples.begin(), samples.end());
+    return true;
+}
+
+void PackedSamples::Unpack(std::vector<double> &samples) { Unpack(samples, 0, NumSamples()); }
+
+void PackedSamples::Unpack(std::vector<double> &samples, usize first_sample, usize num_samples) {
+    assert(first_sample + num_samples <= NumSamples());
+    std::visit(
+        [&](const auto &packed) {
+            using Type = typename std::decay_t<decltype(packed)>;
+            if constexpr (!std::is_same_v<Type, std::monostate>) {
+                UnpackToDouble(tcb::span<const typename Type::value_type>(packed).subspan(first_sample,
+                                                                                          num_samples),
+                               m_scale, samples);
+            }
+        },
+        m_samples);
+    Clear();
+}
+
+usize PackedSamples::NumSamples() const {
+    return std::visit(
+        [](const auto &packed) -> usize {
+            if constexpr (std::is_same_v<std::decay_t<decltype(packed)>, std::monostate>) {
+                return 0;
+            } else {
+                return packed.size();
+            }
+        },
+        m_samples);
+}
+
+usize PackedSamples::NumBytes() const {
+    return std::visit(
+        [](const auto &packed) -> usize {
+            if constexpr (std::is_same_v<std::decay_t<decltype(packed)>, std::monostate>) {
+                return 0;
+            } else {
+                return packed.size() * sizeof(packed[0]);
+            }
+        },
+        m_samples);
+}
+
+TEST_CASE("PackedSamples") {
+    std::vector<double> samples;
+    for (int i = -32768; i < 32768; i += 7) {
+        samples.push_back(i / 32768.0);
+    }
+
+    PackedSamples packed;
+    std::vector<double> unpacked;
+
+    SUBCASE("f64 is not packed") {
+        CHECK(!packed.Pack(samples, SamplePrecision::F64, 16));
+        CHECK(!packed.IsPacked());
+    }
+
+    SUBCASE("native 16-bit is exact and uses a quarter of the memory") {
+        REQUIRE(packed.Pack(samples, SamplePrecision::Native, 16));
+        CHECK(packed.NumBytes() == samples.size() * sizeof(s16));
+        packed.Unpack(unpacked);
+        CHECK(unpacked == samples);
+        CHECK(!packed.IsPacked());
+    }
+
+    SUBCASE("native 24-bit is exact") {
+        for (auto &s : samples) {
+            s += 3.0 / 8388608.0;
+        }
+        REQUIRE(packed.Pack(samples, SamplePrecision::Native, 24));
+        CHECK(packed.NumBytes() == samples.size() * sizeof(s32));
+        packed.Unpack(unpacked);
+        CHECK(unpacked == samples);
+    }
+
+    SUBCASE("native falls back to f32 rather than clipping") {
+        samples.push_back(1.5);
+        REQUIRE(packed.Pack(samples, SamplePrecision::Native, 16));
+        CHECK(packed.NumBytes() == samples.size() * sizeof(float));
+        packed.Unpack(unpacked);
+        CHECK(unpacked.back() == 1.5);
+    }
+
+    SUBCASE("native falls back to f32 rather than rounding") {
+        samples.push_back(0.5 / 32768.0);
+        REQUIRE(packed.Pack(samples, SamplePrecision::Native, 16));
+        CHECK(packed.NumBytes() == samples.size() * sizeof(float));
+        packed.Unpack(unpacked);
+        CHECK(unpacked == samples);
+    }
+
+    SUBCASE("native does not pack samples that f32 cannot hold exactly") {
+        samples.push_back(0.1);
+        CHECK(!packed.Pack(samples, SamplePrecision::Native, 16));
+        CHECK(!packed.IsPacked());
+    }
+
+    SUBCASE("unpacking a range") {
+        REQUIRE(packed.Pack(samples, SamplePrecision::Native, 16));
+        packed.Unpack(unpacked, 10, 20);
+        CHECK(unpacked == std::vector<double>(samples.begin() + 10, samples.begin() + 30));
+        CHECK(!packed.IsPacked());
+    }
+
+    SUBCASE("f32") {
+        samples.push_back(0.1);
+        REQUIRE(packed.Pack(samples, SamplePrecision::F32, 24));
+        CHECK(packed.NumBytes() == samples.size() * sizeof(float));
+        packed.Unpack(unpacked);
+        REQUIRE(unpacked.size() == samples.size());
+        for (usize i = 0; i < samples.size(); ++i) {
+            REQUIRE(unpacked[i] == doctest::Approx(samples[i]).epsilon(1e-7));
+        }
+    }
+}
+
+// Run with: tests --test-case="PackedSamples benchmark" --no-skip
+TEST_CASE("PackedSamples benchmark" * doctest::skip()) {
+    // 60 seconds of 16-bit stereo at 48 kHz
+    std::vector<double> samples(48000 * 60 * 2);
+    for (usize i = 0; i < samples.size(); ++i) {
+        samples[i] = std::round(std::sin((double)i * 0.001) * 30000) / 32768.0;
+    }
+    const auto num_mb = (double)(samples.size() * sizeof(double)) / (1024.0 * 1024.0);
+
+    for (const auto precision : {SamplePrecision::F32, SamplePrecision::Native}) {
+        PackedSamples packed;
+        std::vector<double> unpacked;
+        const auto start = std::chrono::steady_clock::now();
+        REQUIRE(packed.Pack(samples, precision, 16));
+        const auto packed_bytes = packed.NumBytes();
+        const auto middle = std::chrono::steady_clock::now();
+        packed.Unpack(unpacked);
+        const auto end = std::chrono::steady_clock::now();
+
+        MessageWithNewLine("Benchmark", {},
+                           "{}: {:.1f} MB stored as {:.1f} MB, packing {:.0f} MB/s, unpacking {:.0f} MB/s",
+                           precision == SamplePrecision::F32 ? "f32" : "native", num_mb,
+                           (double)packed_bytes / (1024.0 * 1024.0),
+                           num_mb / std::chrono::duration<double>(middle - start).count(),
+                           num_mb / std::chrono::duration<double>(end - middle).count());
+    }
+}
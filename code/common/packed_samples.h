@@ -0,0 +1,45 @@
+#pragma once
+#include <variant>
+#include <vector>
+
+#include "span.hpp"
+
+#include "types.h"
+
+// The precision that the samples of a file are stored at while the file is waiting to be processed or
+// written. Commands always process 64-bit floating point samples; the samples are converted back to that
+// when a command requests them.
+enum class SamplePrecision {
+    F64, // the samples are not converted
+    F32, // half the memory, with 24 bits of precision
+    Native, // the file's own bit depth, so a 16-bit file uses a quarter of the memory
+};
+
+void SetSampleStoragePrecision(SamplePrecision precision);
+SamplePrecision GetSampleStoragePrecision();
+
+// A compact copy of a buffer of interleaved samples.
+class PackedSamples {
+  public:
+    // Returns false if the samples were not packed because there's nothing to gain; when the precision is
+    // F64, or the precision is Native and the file is 64-bit. Native never changes the samples: samples that
+    // are no longer exactly at the file's bit depth - because a gain was applied, for example - are stored as
+    // F32 instead, and if F32 cannot hold them exactly either, they are not packed.
+    bool Pack(tcb::span<const double> samples, SamplePrecision precision, unsigned bits_per_sample);
+
+    // Converts the samples back to doubles and frees the packed copy.
+    void Unpack(std::vector<double> &samples);
+
+    // Like Unpack, but only the given range of the packed samples is converted; the rest are discarded.
+    void Unpack(std::vector<double> &samples, usize first_sample, usize num_samples);
+
+    void Clear() { m_samples = {}; }
+    bool IsPacked() const { return m_samples.index() != 0; }
+    usize NumSamples() const;
+    usize NumBytes() const;
+
+  private:
+    std::variant<std::monostate, std::vector<float>, std::vector<s8>, std::vector<s16>, std::vector<s32>>
+        m_samples {};
+    double m_scale {1};
+};
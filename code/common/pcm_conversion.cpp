@@ -0,0 +1,219 @@
+#include "pcm_conversion.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+#include "doctest.hpp"
+
+#include "sample_kernels.h"
+
+std::optional<PcmSampleType> GetPcmSampleType(bool is_float, unsigned bits_per_sample) {
+    if (is_float) {
+        switch (bits_per_sample) {
+            case 32: return PcmSampleType::Float32;
+            case 64: return PcmSampleType::Float64;
+        }
+    } else {
+        switch (bits_per_sample) {
+            case 8: return PcmSampleType::UnsignedInt8;
+            case 16: return PcmSampleType::SignedInt16;
+            case 24: return PcmSampleType::SignedInt24;
+            case 32: return PcmSampleType::SignedInt32;
+        }
+    }
+    return {};
+}
+
+unsigned BytesPerPcmSample(PcmSampleType type) {
+    switch (type) {
+        case PcmSampleType::UnsignedInt8: return 1;
+        case PcmSampleType::SignedInt16: return 2;
+        case PcmSampleType::SignedInt24: return 3;
+        case PcmSampleType::SignedInt32: return 4;
+        case PcmSampleType::Float32: return 4;
+        case PcmSampleType::Float64: return 8;
+    }
+    return 0;
+}
+
+// memcpy is used to load the values because the input is not necessarily aligned; compilers turn it into a
+// plain (vectorisable) load.
+template <typename Type>
+static void ConvertToDouble(const u8 *in, usize num_samples, double *out, double scale) {
+    for (usize i = 0; i < num_samples; ++i) {
+        Type value;
+        std::memcpy(&value, in + i * sizeof(Type), sizeof(Type));
+        out[i] = (double)value * scale;
+    }
+}
+
+static void ConvertUnsignedInt8ToDouble(const u8 *in, usize num_samples, double *out) {
+    for (usize i = 0; i < num_samples; ++i) {
+        out[i] = (double)in[i] * (2.0 / 255.0) - 1.0;
+    }
+}
+
+static void ConvertSignedInt24ToDouble(const u8 *in, usize num_samples, double *out) {
+    for (usize i = 0; i < num_samples; ++i) {
+        const auto b = in + i * 3;
+        // Build the sample in the top 3 bytes of a 32-bit int so that the shift sign-extends it.
+        const auto value = (s32)(((u32)b[0] << 8) | ((u32)b[1] << 16) | ((u32)b[2] << 24)) >> 8;
+        out[i] = (double)value * (1.0 / 8388608.0);
+    }
+}
+
+void ConvertPcmToDouble(PcmSampleType type, const u8 *in, usize num_samples, double *out) {
+    switch (type) {
+        case PcmSampleType::UnsignedInt8: ConvertUnsignedInt8ToDouble(in, num_samples, out); break;
+        case PcmSampleType::SignedInt16: ConvertToDouble<s16>(in, num_samples, out, 1.0 / 32768.0); break;
+        case PcmSampleType::SignedInt24: ConvertSignedInt24ToDouble(in, num_samples, out); break;
+        case PcmSampleType::SignedInt32: ConvertToDouble<s32>(in, num_samples, out, 1.0 / 2147483648.0); break;
+        case PcmSampleType::Float32: ConvertToDouble<float>(in, num_samples, out, 1.0); break;
+        case PcmSampleType::Float64: std::memcpy(out, in, num_samples * sizeof(double)); break;
+    }
+}
+
+static void ConvertDoubleToUnsignedInt8(const double *in, usize num_samples, double gain, u8 *out) {
+    for (usize i = 0; i < num_samples; ++i) {
+        out[i] = (u8)std::clamp((in[i] * gain + 1.0) * 0.5 * 255.0, 0.0, 255.0);
+    }
+}
+
+void ConvertInt32ToPcm(PcmSampleType type, const s32 *in, usize num_samples, u8 *out) {
+    switch (type) {
+        case PcmSampleType::SignedInt16:
+            for (usize i = 0; i < num_samples; ++i) {
+                const auto sample = (s16)in[i];
+                std::memcpy(out + i * 2, &sample, 2);
+            }
+            break;
+        case PcmSampleType::SignedInt24:
+            for (usize i = 0; i < num_samples; ++i) {
+                out[i * 3 + 0] = (u8)in[i];
+                out[i * 3 + 1] = (u8)(in[i] >> 8);
+                out[i * 3 + 2] = (u8)(in[i] >> 16);
+            }
+            break;
+        case PcmSampleType::SignedInt32: std::memcpy(out, in, num_samples * sizeof(s32)); break;
+        default: assert(false); break;
+    }
+}
+
+// The samples are quantised into a small buffer on the stack and then packed into the output, so no memory is
+// allocated however many samples there are.
+static void
+ConvertDoubleToSignedInt(PcmSampleType type, const double *in, usize num_samples, double gain, u8 *out) {
+    constexpr usize k_chunk_size = 512;
+    s32 quantised[k_chunk_size];
+    const auto bytes_per_sample = BytesPerPcmSample(type);
+    for (usize start = 0; start < num_samples; start += k_chunk_size) {
+        const auto size = std::min(k_chunk_size, num_samples - start);
+        QuantiseSamples({in + start, size}, gain, bytes_per_sample * 8, quantised);
+        ConvertInt32ToPcm(type, quantised, size, out + start * bytes_per_sample);
+    }
+}
+
+template <typename Type>
+static void ConvertFromDouble(const double *in, usize num_samples, double gain, u8 *out) {
+    for (usize i = 0; i < num_samples; ++i) {
+        const auto value = (Type)(in[i] * gain);
+        std::memcpy(out + i * sizeof(Type), &value, sizeof(Type));
+    }
+}
+
+void ConvertDoubleToPcm(PcmSampleType type, const double *in, usize num_samples, double gain, u8 *out) {
+    switch (type) {
+        case PcmSampleType::UnsignedInt8: ConvertDoubleToUnsignedInt8(in, num_samples, gain, out); break;
+        case PcmSampleType::SignedInt16:
+        case PcmSampleType::SignedInt24:
+        case PcmSampleType::SignedInt32: ConvertDoubleToSignedInt(type, in, num_samples, gain, out); break;
+        case PcmSampleType::Float32: ConvertFromDouble<float>(in, num_samples, gain, out); break;
+        case PcmSampleType::Float64: ConvertFromDouble<double>(in, num_samples, gain, out); break;
+    }
+}
+
+void ConvertInt32ToDouble(const s32 *in, usize num_samples, double scale, double *out, unsigned out_stride) {
+    // Separate loops so that the common cases have a constant stride, which the compiler can vectorise.
+    switch (out_stride) {
+        case 1:
+            for (usize i = 0; i < num_samples; ++i) {
+                out[i] = (double)in[i] * scale;
+            }
+            break;
+        case 2:
+            for (usize i = 0; i < num_samples; ++i) {
+                out[i * 2] = (double)in[i] * scale;
+            }
+            break;
+        default:
+            for (usize i = 0; i < num_samples; ++i) {
+                out[i * out_stride] = (double)in[i] * scale;
+            }
+            break;
+    }
+}
+
+TEST_CASE("PCM to double conversion") {
+    const auto Convert = [](PcmSampleType type, std::vector<u8> bytes) {
+        const auto num_samples = bytes.size() / BytesPerPcmSample(type);
+        std::vector<double> result(num_samples);
+        ConvertPcmToDouble(type, bytes.data(), num_samples, result.data());
+        return result;
+    };
+
+    CHECK(Convert(PcmSampleType::UnsignedInt8, {0, 255}) == std::vector<double> {-1.0, 1.0});
+    CHECK(Convert(PcmSampleType::SignedInt16, {0x00, 0x80, 0x00, 0x40}) == std::vector<double> {-1.0, 0.5});
+    CHECK(Convert(PcmSampleType::SignedInt24, {0x00, 0x00, 0x80, 0xff, 0xff, 0xff, 0x00, 0x00, 0x40}) ==
+          std::vector<double> {-1.0, -1.0 / 8388608.0, 0.5});
+    CHECK(Convert(PcmSampleType::SignedInt32, {0x01, 0x00, 0x00, 0x00}) ==
+          std::vector<double> {1.0 / 2147483648.0});
+
+    std::vector<u8> float_bytes(sizeof(float));
+    const float f = 0.25f;
+    std::memcpy(float_bytes.data(), &f, sizeof(f));
+    CHECK(Convert(PcmSampleType::Float32, float_bytes) == std::vector<double> {0.25});
+
+    {
+        const s32 left[] = {-128, 64};
+        const s32 right[] = {127, 0};
+        std::vector<double> interleaved(4);
+        ConvertInt32ToDouble(left, 2, 1.0 / 128.0, interleaved.data(), 2);
+        ConvertInt32ToDouble(right, 2, 1.0 / 128.0, interleaved.data() + 1, 2);
+        CHECK(interleaved == std::vector<double> {-1.0, 127.0 / 128.0, 0.5, 0.0});
+    }
+
+    CHECK(GetPcmSampleType(false, 24) == PcmSampleType::SignedInt24);
+    CHECK(GetPcmSampleType(true, 64) == PcmSampleType::Float64);
+    CHECK(!GetPcmSampleType(false, 12));
+}
+
+TEST_CASE("Double to PCM conversion") {
+    const auto Convert = [](PcmSampleType type, std::vector<double> samples, double gain = 1.0) {
+        std::vector<u8> result(samples.size() * BytesPerPcmSample(type));
+        ConvertDoubleToPcm(type, samples.data(), samples.size(), gain, result.data());
+        return result;
+    };
+
+    CHECK(Convert(PcmSampleType::UnsignedInt8, {-1.0, 0.0, 1.0}) == std::vector<u8> {0, 127, 255});
+    CHECK(Convert(PcmSampleType::SignedInt16, {-1.0, 1.0}) == std::vector<u8> {0x00, 0x80, 0xff, 0x7f});
+    CHECK(Convert(PcmSampleType::SignedInt16, {-2.0, 2.0}, 0.5) == std::vector<u8> {0x00, 0x80, 0xff, 0x7f});
+    CHECK(Convert(PcmSampleType::SignedInt24, {-1.0, -1.0 / 8388608.0, 1.0}) ==
+          std::vector<u8> {0x00, 0x00, 0x80, 0xff, 0xff, 0xff, 0xff, 0xff, 0x7f});
+    CHECK(Convert(PcmSampleType::SignedInt32, {-1.0}) == std::vector<u8> {0x00, 0x00, 0x00, 0x80});
+
+    CHECK(Convert(PcmSampleType::Float32, {0.5, -2.0}) == Convert(PcmSampleType::Float32, {1.0, -4.0}, 0.5));
+
+    // Floating point samples come back unchanged when they are converted to double and back again.
+    for (const auto type : {PcmSampleType::Float32, PcmSampleType::Float64}) {
+        std::vector<double> samples;
+        for (int i = -1000; i < 1000; ++i) {
+            samples.push_back(i / 1000.0);
+        }
+        const auto bytes = Convert(type, samples);
+        std::vector<double> round_trip(samples.size());
+        ConvertPcmToDouble(type, bytes.data(), samples.size(), round_trip.data());
+        CHECK(Convert(type, round_trip) == bytes);
+    }
+}
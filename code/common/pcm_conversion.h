@@ -0,0 +1,29 @@
+#pragma once
+#include <optional>
+
+#include "types.h"
+
+// The sample encodings that can be converted straight to double without going through dr_wav's f32 decoding.
+enum class PcmSampleType { UnsignedInt8, SignedInt16, SignedInt24, SignedInt32, Float32, Float64 };
+
+std::optional<PcmSampleType> GetPcmSampleType(bool is_float, unsigned bits_per_sample);
+unsigned BytesPerPcmSample(PcmSampleType type);
+
+// Converts little-endian sample data into doubles. Integers are scaled to the range [-1, 1) in the same way
+// that dr_wav scales them, but without the loss of precision that converting to f32 would cause for 24 and
+// 32-bit samples. The loops are written so that the compiler can vectorise them.
+void ConvertPcmToDouble(PcmSampleType type, const u8 *in, usize num_samples, double *out);
+
+// The inverse of ConvertPcmToDouble: multiplies each sample by gain and writes it as little-endian sample
+// data. Integers are rounded to the nearest value and clamped to the range of the type, except for 8-bit
+// samples which are truncated as they always have been. out must have room for
+// num_samples * BytesPerPcmSample(type) bytes.
+void ConvertDoubleToPcm(PcmSampleType type, const double *in, usize num_samples, double gain, u8 *out);
+
+// Writes integers that have already been quantised to the bit depth of a signed integer type as
+// little-endian sample data.
+void ConvertInt32ToPcm(PcmSampleType type, const s32 *in, usize num_samples, u8 *out);
+
+// Converts a single channel of integer samples to double, multiplying each by scale. The results are written
+// to every out_stride-th element of out so that channels can be interleaved.
+void ConvertInt32ToDouble(const s32 *in, usize num_samples, double scale, double *out, unsigned out_stride);
@@ -0,0 +1,267 @@
+#include "pitch_detector.h"
+
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include "doctest.hpp"
+#include "dywapitchtrack/dywapitchtrack.h"
+
+#include "audio_data.h"
+#include "common.h"
+#include "gain_calculators.h"
+#include "resampling.h"
+#include "test_helpers.h"
+
+// The pitch detection algorithm that we are using can get it wrong sometimes when the audio is very high
+// pitch or very low pitch. To help with this, we detect the pitch with the signal shifted by these numbers of
+// octaves and then work out which one is giving us the best results.
+static constexpr int k_octave_shifts[] = {-2, -1, 0, 1};
+
+// Each octave of the signal is split into chunks of this length, and the pitch of each chunk is detected.
+static constexpr double k_chunk_seconds = 0.1;
+
+// Detecting the pitch of a chunk is the slow part, and a long signal has thousands of them; all of them are
+// not needed to find the pitch that the chunks agree on. So if there are more chunks than this, only this
+// many evenly spaced ones are used, and only those parts of the signal are pitch-shifted.
+static constexpr usize k_max_chunks_per_octave = 128;
+
+// The number of samples either side of the position that the pitch-shifting filter uses, when it is not
+// reducing the bandwidth.
+static constexpr int k_shift_filter_half_width = 16;
+
+// The signal with its pitch shifted by a number of octaves, at the same sample rate. Any part of it can be
+// read without shifting the rest. It is made with a windowed-sinc filter: for pitch detection there is no
+// need for the quality, or the cost, of the resampler.
+class OctaveShiftedSignal {
+  public:
+    OctaveShiftedSignal(tcb::span<const double> signal, int octaves) : m_signal(signal) {
+        if (octaves == 0) return;
+
+        // Shifting up an octave takes every other sample of the signal, once it has been low-pass filtered
+        // to stop aliasing. Shifting down an octave puts a new sample between each, so there are 2 phases of
+        // the filter: the original samples, and the halfway points.
+        const auto cutoff = octaves > 0 ? std::ldexp(1.0, -octaves) : 1.0;
+        m_input_step = octaves > 0 ? (usize)1 << octaves : 0;
+        m_num_phases = octaves < 0 ? (usize)1 << -octaves : 1;
+        m_half_width = (int)(k_shift_filter_half_width / cutoff);
+        m_size = (usize)ResampledNumFrames(signal.size(), 1, std::ldexp(1.0, -octaves));
+
+        const auto kernel_size = (usize)m_half_width * 2 + 1;
+        m_kernels.resize(m_num_phases * kernel_size);
+        for (usize phase = 0; phase < m_num_phases; ++phase) {
+            for (usize i = 0; i < kernel_size; ++i) {
+                // The distance from the position being read to the sample that this coefficient is for.
+                const auto distance = (double)phase / (double)m_num_phases + m_half_width - (double)i;
+                const auto x = cutoff * distance;
+                const auto sinc = x == 0 ? 1.0 : std::sin(pi * x) / (pi * x);
+                const auto w = distance / (m_half_width + 1);
+                const auto blackman_window = 0.42 + 0.5 * std::cos(pi * w) + 0.08 * std::cos(2 * pi * w);
+                m_kernels[phase * kernel_size + i] = cutoff * sinc * blackman_window;
+            }
+        }
+    }
+
+    usize Size() const { return m_kernels.size() ? m_size : m_signal.size(); }
+
+    void Read(usize first, usize count, std::vector<double> &out) const {
+        out.resize(count);
+        if (m_kernels.empty()) {
+            std::copy_n(m_signal.begin() + first, count, out.begin());
+            return;
+        }
+
+        const auto kernel_size = (usize)m_half_width * 2 + 1;
+        for (usize i = 0; i < count; ++i) {
+            const auto pos = first + i;
+            const auto phase = pos % m_num_phases;
+            const auto centre = m_input_step ? pos * m_input_step : pos / m_num_phases;
+            const auto *kernel = m_kernels.data() + phase * kernel_size;
+
+            double sum = 0;
+            if (centre >= (usize)m_half_width && centre + m_half_width < m_signal.size()) {
+                const auto *samples = m_signal.data() + centre - m_half_width;
+                for (usize k = 0; k < kernel_size; ++k) {
+                    sum += samples[k] * kernel[k];
+                }
+            } else {
+                // Near the ends, the signal is taken to be silent outside of it.
+                for (usize k = 0; k < kernel_size; ++k) {
+                    const auto index = (s64)centre - m_half_width + (s64)k;
+                    if (index >= 0 && index < (s64)m_signal.size()) sum += m_signal[(usize)index] * kernel[k];
+                }
+            }
+            out[i] = sum;
+        }
+    }
+
+  private:
+    tcb::span<const double> m_signal;
+    usize m_size {};
+    usize m_input_step {}; // when shifting up, the number of input samples per output sample
+    usize m_num_phases {}; // when shifting down, the number of output samples per input sample
+    int m_half_width {};
+    std::vector<double> m_kernels {}; // one for each phase; empty when not shifting
+};
+
+static std::optional<double> DetectSinglePitch(const OctaveShiftedSignal &signal, unsigned sample_rate) {
+    struct ChunkData {
+        double detected_pitch {};
+        double rms {};
+        double suitability {};
+    };
+
+    std::vector<ChunkData> chunks;
+    const auto chunk_frames = (usize)(k_chunk_seconds * sample_rate);
+    const auto num_chunks = (signal.Size() + chunk_frames - 1) / chunk_frames;
+    const auto num_chunks_used = std::min(num_chunks, k_max_chunks_per_octave);
+    std::vector<double> chunk_signal;
+    for (usize i = 0; i < num_chunks_used; ++i) {
+        const auto frame = (i * num_chunks / num_chunks_used) * chunk_frames;
+        const auto chunk_size = std::min(chunk_frames, signal.Size() - frame);
+        signal.Read(frame, chunk_size, chunk_signal);
+
+        dywapitchtracker pitch_tracker;
+        dywapitch_inittracking(&pitch_tracker);
+        auto detected_pitch =
+            dywapitch_computepitch(&pitch_tracker, chunk_signal.data(), 0, (int)chunk_signal.size());
+        if (sample_rate != 44100) {
+            detected_pitch *= static_cast<double>(sample_rate) / 44100.0;
+        }
+        chunks.push_back({detected_pitch, GetRMS(chunk_signal), 0});
+    }
+    if (chunks.empty()) return std::nullopt;
+
+    for (auto &chunk : chunks) {
+        const auto p1 = chunk.detected_pitch;
+
+        for (const auto &other_c : chunks) {
+            const auto p2 = other_c.detected_pitch;
+            if (p2 == 0) continue;
+
+            const auto GaussianFunction = [](const auto x) {
+                constexpr auto height = 10;
+                constexpr auto peak_centre = 0;
+                constexpr auto width = 0.9;
+                return height * std::exp(-(std::pow(x - peak_centre, 2) / (2 * std::pow(width, 2))));
+            };
+
+            const auto pitch_delta = p2 - p1;
+            chunk.suitability += GaussianFunction(pitch_delta);
+        }
+    }
+
+    // Make chunks that contain louder audio a little bit more important
+    {
+        double max_rms = 0;
+        double min_rms = DBL_MAX;
+        for (auto &chunk : chunks) {
+            REQUIRE(chunk.rms >= 0);
+            if (chunk.rms < min_rms) min_rms = chunk.rms;
+            if (chunk.rms > max_rms) max_rms = chunk.rms;
+        }
+
+        for (auto &chunk : chunks) {
+            if ((max_rms - min_rms) == 0) continue;
+            const auto rms_relative = (chunk.rms - min_rms) / (max_rms - min_rms);
+            REQUIRE(rms_relative >= 0);
+            REQUIRE(rms_relative <= 1);
+            constexpr auto multiplier_for_loudest_chunk = 1.5;
+            chunk.suitability *=
+                1 + (std::cos(half_pi - (rms_relative * half_pi)) * multiplier_for_loudest_chunk);
+        }
+    }
+
+    const ChunkData *most_suitable_chunk = &chunks[0];
+    for (const auto &c : chunks) {
+        if (c.suitability > most_suitable_chunk->suitability) {
+            most_suitable_chunk = &c;
+        }
+    }
+
+    if (most_suitable_chunk->detected_pitch != 0.0) {
+        return most_suitable_chunk->detected_pitch;
+    }
+    return std::nullopt;
+}
+
+std::optional<double> DetectPitchOfMonoSignal(tcb::span<const double> mono_signal, unsigned sample_rate) {
+    struct PitchedData {
+        std::optional<double> detected_pitch {};
+        double cents {};
+        double suitability {};
+    };
+
+    std::vector<PitchedData> pitches;
+    for (const auto octaves : k_octave_shifts) {
+        const OctaveShiftedSignal signal {mono_signal, octaves};
+        pitches.push_back({DetectSinglePitch(signal, sample_rate), octaves * 1200.0});
+    }
+
+    for (auto &p : pitches) {
+        if (!p.detected_pitch) continue;
+        for (const auto &p2 : pitches) {
+            if (!p2.detected_pitch) continue;
+            const auto delta_cents = p2.cents - p.cents;
+            const auto expected_hz = GetFreqWithCentDifference(*p.detected_pitch, delta_cents);
+            if (ApproxEqual(expected_hz, *p2.detected_pitch, 3)) {
+                p.suitability += 1;
+            }
+        }
+    }
+
+    const PitchedData *most_suitable = &pitches[0];
+    for (const auto &p : pitches) {
+        if (p.suitability > most_suitable->suitability) {
+            most_suitable = &p;
+        }
+    }
+
+    if (!most_suitable->detected_pitch) {
+        return {};
+    }
+
+    return GetFreqWithCentDifference(*most_suitable->detected_pitch, -most_suitable->cents);
+}
+
+TEST_CASE("Pitch detection") {
+    for (const unsigned sample_rate : {44100u, 48000u, 96000u}) {
+        for (const double frequency : {40.0, 65.0, 110.0, 220.0, 261.63, 440.0, 1000.0, 2093.0, 3500.0}) {
+            CAPTURE(sample_rate);
+            CAPTURE(frequency);
+            const auto sine = TestHelpers::CreateSineWaveAtFrequency(1, sample_rate, 1, frequency);
+            const auto detected = DetectPitchOfMonoSignal(sine.interleaved_samples, sample_rate);
+            REQUIRE(detected);
+            CHECK(*detected == doctest::Approx(frequency).epsilon(0.01));
+
+            const auto square = TestHelpers::CreateSquareWaveAtFrequency(1, sample_rate, 1, frequency);
+            const auto detected_square = DetectPitchOfMonoSignal(square.interleaved_samples, sample_rate);
+            REQUIRE(detected_square);
+            CHECK(*detected_square == doctest::Approx(frequency).epsilon(0.01));
+        }
+    }
+
+    SUBCASE("a long signal, of which only some chunks are used") {
+        const auto sine = TestHelpers::CreateSineWaveAtFrequency(1, 44100, 30, 330);
+        const auto detected = DetectPitchOfMonoSignal(sine.interleaved_samples, 44100);
+        REQUIRE(detected);
+        CHECK(*detected == doctest::Approx(330).epsilon(0.01));
+    }
+
+    SUBCASE("silence") { CHECK(!DetectPitchOfMonoSignal(std::vector<double>(44100), 44100)); }
+}
+
+// Run with: tests --test-case="Pitch detection benchmark" --no-skip
+TEST_CASE("Pitch detection benchmark" * doctest::skip()) {
+    // A long sample: a minute of stereo.
+    const auto sine = TestHelpers::CreateSineWaveAtFrequency(2, 44100, 60, 220);
+    constexpr int num_detections = 5;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < num_detections; ++i) {
+        REQUIRE(sine.DetectPitch());
+    }
+    const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    MessageWithNewLine("Benchmark", {}, "{:.3f} s per detection", seconds / num_detections);
+}
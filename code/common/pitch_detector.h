@@ -0,0 +1,7 @@
+#pragma once
+#include <optional>
+
+#include "span.hpp"
+
+// Detects the pitch of a mono signal, in Hz. Returns nullopt if no pitch can be found.
+std::optional<double> DetectPitchOfMonoSignal(tcb::span<const double> mono_signal, unsigned sample_rate);
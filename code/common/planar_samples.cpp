@@ -0,0 +1,59 @@
+#include "planar_samples.h"
+
+#include "doctest.hpp"
+
+void PlanarSamples::Resize(unsigned num_channels, usize num_frames) {
+    m_num_channels = num_channels;
+    m_num_frames = num_frames;
+    m_samples.resize(num_channels * num_frames);
+}
+
+void PlanarSamples::Deinterleave(const std::vector<double> &interleaved_samples, unsigned num_channels) {
+    Resize(num_channels, num_channels ? interleaved_samples.size() / num_channels : 0);
+    for (unsigned chan = 0; chan < m_num_channels; ++chan) {
+        auto *channel = m_samples.data() + chan * m_num_frames;
+        const auto *in = interleaved_samples.data() + chan;
+        for (usize frame = 0; frame < m_num_frames; ++frame) {
+            channel[frame] = in[frame * m_num_channels];
+        }
+    }
+}
+
+void PlanarSamples::Interleave(std::vector<double> &interleaved_samples) const {
+    interleaved_samples.resize(m_num_channels * m_num_frames);
+    for (unsigned chan = 0; chan < m_num_channels; ++chan) {
+        const auto *channel = m_samples.data() + chan * m_num_frames;
+        auto *out = interleaved_samples.data() + chan;
+        for (usize frame = 0; frame < m_num_frames; ++frame) {
+            out[frame * m_num_channels] = channel[frame];
+        }
+    }
+}
+
+TEST_CASE("PlanarSamples") {
+    const std::vector<double> interleaved {1, 10, 2, 20, 3, 30};
+
+    PlanarSamples planar;
+    planar.Deinterleave(interleaved, 2);
+    REQUIRE(planar.NumChannels() == 2);
+    REQUIRE(planar.NumFrames() == 3);
+    CHECK(std::vector<double>(planar.Channel(0).begin(), planar.Channel(0).end()) ==
+          std::vector<double> {1, 2, 3});
+    CHECK(std::vector<double>(planar.Channel(1).begin(), planar.Channel(1).end()) ==
+          std::vector<double> {10, 20, 30});
+
+    for (auto &s : planar.Channel(1)) {
+        s *= 2;
+    }
+    std::vector<double> out;
+    planar.Interleave(out);
+    CHECK(out == std::vector<double> {1, 20, 2, 40, 3, 60});
+
+    SUBCASE("reusing the buffer for a different shape") {
+        planar.Deinterleave({1, 2, 3, 4}, 1);
+        REQUIRE(planar.NumChannels() == 1);
+        REQUIRE(planar.NumFrames() == 4);
+        planar.Interleave(out);
+        CHECK(out == std::vector<double> {1, 2, 3, 4});
+    }
+}
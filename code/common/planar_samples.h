@@ -0,0 +1,35 @@
+#pragma once
+#include <vector>
+
+#include "span.hpp"
+
+#include "types.h"
+
+// Samples stored one channel after another rather than interleaved. Each channel is contiguous in memory,
+// which suits the algorithms that process one channel at a time, such as resampling and filtering. All of
+// the channels share a single allocation which is reused when the buffer is filled again.
+class PlanarSamples {
+  public:
+    // Resizes to the given dimensions; the contents of the samples are unspecified afterwards.
+    void Resize(unsigned num_channels, usize num_frames);
+
+    void Deinterleave(const std::vector<double> &interleaved_samples, unsigned num_channels);
+
+    // Overwrites the given buffer, resizing it if needed.
+    void Interleave(std::vector<double> &interleaved_samples) const;
+
+    tcb::span<double> Channel(unsigned channel) {
+        return {m_samples.data() + channel * m_num_frames, m_num_frames};
+    }
+    tcb::span<const double> Channel(unsigned channel) const {
+        return {m_samples.data() + channel * m_num_frames, m_num_frames};
+    }
+
+    unsigned NumChannels() const { return m_num_channels; }
+    usize NumFrames() const { return m_num_frames; }
+
+  private:
+    std::vector<double> m_samples {};
+    unsigned m_num_channels {};
+    usize m_num_frames {};
+};
@@ -0,0 +1,216 @@
+#include "resampling.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "doctest.hpp"
+#include "r8brain-resampler/CDSPResampler.h"
+
+#include "thread_pool.h"
+
+// The input is given to r8brain in blocks of at most this many frames, so the size of a resampler does not
+// depend on the length of the audio.
+static constexpr usize k_block_num_frames = 16384;
+
+// r8brain caches the designs of its filters, but each resampler still has to set up its convolvers and
+// their buffers, which can take longer than resampling a short file. So resamplers are not destroyed when
+// they are finished with; they are kept by the thread, and reused for the next audio with the same pair of
+// sample rates. All resamplers are 24-bit quality, so the sample rates are all that is needed to identify
+// one.
+// Pitch changes use arbitrary sample rates, so the least recently used ones are discarded rather than
+// letting the pool grow.
+static constexpr usize k_max_pooled_resamplers_per_thread = 8;
+
+struct PooledResampler {
+    double sample_rate;
+    double new_sample_rate;
+    std::unique_ptr<r8b::CDSPResampler24> resampler;
+};
+
+// The most recently used are at the back.
+static thread_local std::vector<PooledResampler> g_resampler_pool;
+
+static std::unique_ptr<r8b::CDSPResampler24> AcquireResampler(double sample_rate, double new_sample_rate) {
+    for (auto it = g_resampler_pool.rbegin(); it != g_resampler_pool.rend(); ++it) {
+        if (it->sample_rate == sample_rate && it->new_sample_rate == new_sample_rate) {
+            auto result = std::move(it->resampler);
+            g_resampler_pool.erase(std::next(it).base());
+            return result;
+        }
+    }
+    return std::make_unique<r8b::CDSPResampler24>(sample_rate, new_sample_rate, (int)k_block_num_frames);
+}
+
+static void ReleaseResampler(double sample_rate,
+                             double new_sample_rate,
+                             std::unique_ptr<r8b::CDSPResampler24> resampler) {
+    resampler->clear();
+    if (g_resampler_pool.size() == k_max_pooled_resamplers_per_thread) {
+        g_resampler_pool.erase(g_resampler_pool.begin());
+    }
+    g_resampler_pool.push_back({sample_rate, new_sample_rate, std::move(resampler)});
+}
+
+u64 ResampledNumFrames(u64 num_frames, double sample_rate, double new_sample_rate) {
+    return (u64)((double)num_frames * (new_sample_rate / sample_rate));
+}
+
+StreamingResampler::StreamingResampler(unsigned num_channels, double sample_rate, double new_sample_rate)
+    : m_num_channels(num_channels)
+    , m_sample_rate(sample_rate)
+    , m_new_sample_rate(new_sample_rate) {
+    for (unsigned chan = 0; chan < num_channels; ++chan) {
+        m_resamplers.push_back(AcquireResampler(sample_rate, new_sample_rate));
+    }
+}
+
+StreamingResampler::~StreamingResampler() {
+    for (auto &resampler : m_resamplers) {
+        ReleaseResampler(m_sample_rate, m_new_sample_rate, std::move(resampler));
+    }
+}
+
+void StreamingResampler::Process(tcb::span<const double> interleaved_frames, const Sink &sink) {
+    const auto num_frames = interleaved_frames.size() / m_num_channels;
+    for (usize start = 0; start < num_frames; start += k_block_num_frames) {
+        const auto size = std::min(k_block_num_frames, num_frames - start);
+        ProcessBlock(interleaved_frames.data() + start * m_num_channels, size, sink);
+    }
+    m_num_input_frames += num_frames;
+}
+
+void StreamingResampler::Finish(const Sink &sink) {
+    // The filters hold back the last of the output until more input arrives, so feed them silence until all
+    // of the output has come out. This is what r8brain's oneshot does too.
+    const auto total_output_frames = ResampledNumFrames(m_num_input_frames, m_sample_rate, m_new_sample_rate);
+    while (m_num_output_frames < total_output_frames) {
+        const auto num_frames_needed = (usize)(total_output_frames - m_num_output_frames);
+        ProcessBlock(nullptr, k_block_num_frames, [&](tcb::span<const double> frames) {
+            sink(frames.first(std::min(frames.size(), num_frames_needed * m_num_channels)));
+        });
+    }
+}
+
+// A null interleaved_frames means silence.
+void StreamingResampler::ProcessBlock(const double *interleaved_frames, usize num_frames, const Sink &sink) {
+    m_channel_block.resize(num_frames);
+    usize num_output_frames = 0;
+    for (unsigned chan = 0; chan < m_num_channels; ++chan) {
+        if (interleaved_frames) {
+            for (usize frame = 0; frame < num_frames; ++frame) {
+                m_channel_block[frame] = interleaved_frames[frame * m_num_channels + chan];
+            }
+        } else {
+            std::fill(m_channel_block.begin(), m_channel_block.end(), 0.0);
+        }
+
+        double *output;
+        const auto size = (usize)m_resamplers[chan]->process(m_channel_block.data(), (int)num_frames, output);
+        // Every channel's resampler has been given the same number of frames, so they all give back the same
+        // number.
+        if (chan == 0) {
+            num_output_frames = size;
+            m_output_block.resize(num_output_frames * m_num_channels);
+        }
+        assert(size == num_output_frames);
+        for (usize frame = 0; frame < num_output_frames; ++frame) {
+            m_output_block[frame * m_num_channels + chan] = output[frame];
+        }
+    }
+
+    if (num_output_frames) {
+        m_num_output_frames += num_output_frames;
+        sink(m_output_block);
+    }
+}
+
+void ResampleInterleaved(const std::vector<double> &in,
+                         unsigned num_channels,
+                         double sample_rate,
+                         double new_sample_rate,
+                         std::vector<double> &out) {
+    const auto num_frames = in.size() / num_channels;
+    // in and out may be the same, so the result is built separately.
+    std::vector<double> result(ResampledNumFrames(num_frames, sample_rate, new_sample_rate) * num_channels);
+
+    ParallelFor(num_channels, [&](usize chan) {
+        StreamingResampler resampler(1, sample_rate, new_sample_rate);
+        usize num_frames_written = 0;
+        const auto write_to_result = [&](tcb::span<const double> frames) {
+            for (usize frame = 0; frame < frames.size(); ++frame) {
+                result[(num_frames_written + frame) * num_channels + chan] = frames[frame];
+            }
+            num_frames_written += frames.size();
+        };
+
+        if (num_channels == 1) {
+            resampler.Process(in, write_to_result);
+        } else {
+            std::vector<double> channel_block;
+            for (usize start = 0; start < num_frames; start += k_block_num_frames) {
+                channel_block.resize(std::min(k_block_num_frames, num_frames - start));
+                for (usize frame = 0; frame < channel_block.size(); ++frame) {
+                    channel_block[frame] = in[(start + frame) * num_channels + chan];
+                }
+                resampler.Process(channel_block, write_to_result);
+            }
+        }
+        resampler.Finish(write_to_result);
+    });
+
+    out = std::move(result);
+}
+
+TEST_CASE("StreamingResampler") {
+    const unsigned num_channels = 2;
+    const double sample_rate = 44100;
+    std::vector<double> input;
+    for (usize frame = 0; frame < 50000; ++frame) {
+        input.push_back(std::sin((double)frame * 0.05) * 0.5);
+        input.push_back(std::sin((double)frame * 0.001) * 0.8);
+    }
+    const auto num_frames = input.size() / num_channels;
+
+    for (const double new_sample_rate : {48000.0, 22050.0, 96000.0, 44100.0 * 1.0123}) {
+        CAPTURE(new_sample_rate);
+        const auto expected_num_frames = ResampledNumFrames(num_frames, sample_rate, new_sample_rate);
+
+        // What r8brain gives if it is given all of the input in one go.
+        std::vector<std::vector<double>> expected(num_channels);
+        for (unsigned chan = 0; chan < num_channels; ++chan) {
+            std::vector<double> channel;
+            for (usize frame = 0; frame < num_frames; ++frame) {
+                channel.push_back(input[frame * num_channels + chan]);
+            }
+            expected[chan].resize(expected_num_frames);
+            r8b::CDSPResampler24 resampler(sample_rate, new_sample_rate, (int)num_frames);
+            resampler.oneshot(channel.data(), (int)channel.size(), expected[chan].data(),
+                              (int)expected_num_frames);
+        }
+
+        // Blocks of awkward sizes, some of them bigger than the resampler's own blocks.
+        std::vector<double> output;
+        {
+            StreamingResampler resampler(num_channels, sample_rate, new_sample_rate);
+            const auto sink = [&](tcb::span<const double> frames) {
+                output.insert(output.end(), frames.begin(), frames.end());
+            };
+            usize frame = 0;
+            for (const usize block_size : {usize(1), usize(100), usize(17000), usize(3), usize(40000)}) {
+                const auto size = std::min(block_size, num_frames - frame);
+                resampler.Process({input.data() + frame * num_channels, size * num_channels}, sink);
+                frame += size;
+            }
+            REQUIRE(frame == num_frames);
+            resampler.Finish(sink);
+        }
+
+        REQUIRE(output.size() == expected_num_frames * num_channels);
+        for (usize frame = 0; frame < expected_num_frames; ++frame) {
+            for (unsigned chan = 0; chan < num_channels; ++chan) {
+                REQUIRE(std::abs(output[frame * num_channels + chan] - expected[chan][frame]) < 1e-12);
+            }
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "span.hpp"
+
+#include "types.h"
+
+namespace r8b {
+class CDSPResampler24;
+}
+
+// The number of frames that resampling num_frames frames gives.
+u64 ResampledNumFrames(u64 num_frames, double sample_rate, double new_sample_rate);
+
+// Resamples interleaved audio a block at a time, so audio of any length can be resampled with a fixed amount
+// of memory. The input can be given in blocks of any size. The result matches resampling all of the audio in
+// one go with r8brain's oneshot to within rounding error - an absolute difference of less than 1e-12.
+class StreamingResampler {
+  public:
+    // Receives the interleaved frames of output as they become ready.
+    using Sink = std::function<void(tcb::span<const double> interleaved_frames)>;
+
+    StreamingResampler(unsigned num_channels, double sample_rate, double new_sample_rate);
+    ~StreamingResampler();
+    StreamingResampler(const StreamingResampler &) = delete;
+    StreamingResampler &operator=(const StreamingResampler &) = delete;
+
+    // Resamples the next frames of the input. Any output that is ready is passed to sink. The output lags
+    // behind the input by the latency of the resampler's filters.
+    void Process(tcb::span<const double> interleaved_frames, const Sink &sink);
+
+    // Call once all of the input has been processed. Flushes the output that is still in the filters, so that
+    // sink will have been given ResampledNumFrames of the total input frames in all.
+    void Finish(const Sink &sink);
+
+  private:
+    void ProcessBlock(const double *interleaved_frames, usize num_frames, const Sink &sink);
+
+    unsigned m_num_channels;
+    double m_sample_rate;
+    double m_new_sample_rate;
+    std::vector<std::unique_ptr<r8b::CDSPResampler24>> m_resamplers {}; // one for each channel
+    std::vector<double> m_channel_block {};
+    std::vector<double> m_output_block {};
+    u64 m_num_input_frames {};
+    u64 m_num_output_frames {};
+};
+
+// Resamples each channel of the interleaved samples into out. in and out may be the same buffer. The
+// channels are resampled in parallel, and they are streamed straight from in to out, so no other copies of
+// the samples are made.
+void ResampleInterleaved(const std::vector<double> &in,
+                         unsigned num_channels,
+                         double sample_rate,
+                         double new_sample_rate,
+                         std::vector<double> &out);
@@ -0,0 +1,512 @@
+#include "sample_kernels.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "doctest.hpp"
+
+#include "common.h"
+
+// Functions with this attribute are compiled once for each of the instruction sets, and the dynamic linker
+// picks the version to use based on the CPU. This relies on GNU indirect functions, so it is Linux-only.
+#if defined(__x86_64__) && defined(__linux__) && defined(__has_attribute)
+#if __has_attribute(target_clones)
+#define SAMPLE_KERNEL __attribute__((target_clones("default", "avx2", "avx512f")))
+#endif
+#endif
+#ifndef SAMPLE_KERNEL
+#define SAMPLE_KERNEL
+#endif
+
+// The reductions are split into this many independent lanes, which the compiler can map onto vector
+// registers. Lane i accumulates the samples whose index modulo k_num_lanes is i.
+static constexpr usize k_num_lanes = 8;
+
+struct LaneStatistics {
+    double peak[k_num_lanes] {};
+    double sum_of_squares[k_num_lanes] {};
+    double sum[k_num_lanes] {};
+};
+
+SAMPLE_KERNEL static void AccumulateLanes(const double *samples, usize num_samples, LaneStatistics &lanes) {
+    usize i = 0;
+    for (; i + k_num_lanes <= num_samples; i += k_num_lanes) {
+        for (usize lane = 0; lane < k_num_lanes; ++lane) {
+            const auto s = samples[i + lane];
+            const auto magnitude = std::abs(s);
+            lanes.peak[lane] = magnitude > lanes.peak[lane] ? magnitude : lanes.peak[lane];
+            lanes.sum_of_squares[lane] += s * s;
+            lanes.sum[lane] += s;
+        }
+    }
+    for (usize lane = 0; i < num_samples; ++i, ++lane) {
+        const auto s = samples[i];
+        lanes.peak[lane] = std::max(lanes.peak[lane], std::abs(s));
+        lanes.sum_of_squares[lane] += s * s;
+        lanes.sum[lane] += s;
+    }
+}
+
+void SampleStatistics::Combine(const SampleStatistics &other) {
+    peak = std::max(peak, other.peak);
+    sum_of_squares += other.sum_of_squares;
+    sum += other.sum;
+    num_samples += other.num_samples;
+}
+
+double SampleStatistics::RMS() const {
+    if (!num_samples) return 0;
+    return std::sqrt(sum_of_squares / (double)num_samples);
+}
+
+double SampleStatistics::DCOffset() const {
+    if (!num_samples) return 0;
+    return sum / (double)num_samples;
+}
+
+SAMPLE_KERNEL void MultiplySamples(tcb::span<double> samples, double amount) {
+    auto *data = samples.data();
+    for (usize i = 0; i < samples.size(); ++i) {
+        data[i] *= amount;
+    }
+}
+
+SAMPLE_KERNEL void AddSamples(tcb::span<double> samples, tcb::span<const double> samples_to_add) {
+    auto *data = samples.data();
+    const auto *to_add = samples_to_add.data();
+    const auto size = std::min(samples.size(), samples_to_add.size());
+    for (usize i = 0; i < size; ++i) {
+        data[i] += to_add[i];
+    }
+}
+
+SAMPLE_KERNEL bool AllSamplesAreZero(tcb::span<const double> samples) {
+    // Checked in blocks so that the inner loop has no early exit and can be vectorised.
+    constexpr usize block_size = 64;
+    const auto *data = samples.data();
+    usize i = 0;
+    for (; i + block_size <= samples.size(); i += block_size) {
+        bool non_zero = false;
+        for (usize j = 0; j < block_size; ++j) {
+            non_zero |= data[i + j] != 0.0;
+        }
+        if (non_zero) return false;
+    }
+    for (; i < samples.size(); ++i) {
+        if (data[i] != 0.0) return false;
+    }
+    return true;
+}
+
+SAMPLE_KERNEL double GetPeakMagnitude(tcb::span<const double> samples) {
+    double lanes[k_num_lanes] {};
+    const auto *data = samples.data();
+    usize i = 0;
+    for (; i + k_num_lanes <= samples.size(); i += k_num_lanes) {
+        for (usize lane = 0; lane < k_num_lanes; ++lane) {
+            const auto magnitude = std::abs(data[i + lane]);
+            lanes[lane] = magnitude > lanes[lane] ? magnitude : lanes[lane];
+        }
+    }
+    double result = 0;
+    for (; i < samples.size(); ++i) {
+        result = std::max(result, std::abs(data[i]));
+    }
+    for (const auto lane : lanes) {
+        result = std::max(result, lane);
+    }
+    return result;
+}
+
+SAMPLE_KERNEL double GetSumOfSquares(tcb::span<const double> samples) {
+    double lanes[k_num_lanes] {};
+    const auto *data = samples.data();
+    usize i = 0;
+    for (; i + k_num_lanes <= samples.size(); i += k_num_lanes) {
+        for (usize lane = 0; lane < k_num_lanes; ++lane) {
+            lanes[lane] += data[i + lane] * data[i + lane];
+        }
+    }
+    for (usize lane = 0; i < samples.size(); ++i, ++lane) {
+        lanes[lane] += data[i] * data[i];
+    }
+    double result = 0;
+    for (const auto lane : lanes) {
+        result += lane;
+    }
+    return result;
+}
+
+SampleStatistics GetSampleStatistics(tcb::span<const double> samples) {
+    SampleStatistics result {};
+    AddChannelStatistics(samples, 1, {&result, 1});
+    return result;
+}
+
+void AddChannelStatistics(tcb::span<const double> interleaved_samples,
+                          unsigned num_channels,
+                          tcb::span<SampleStatistics> out) {
+    assert(out.size() == num_channels);
+    if (!num_channels) return;
+    const auto num_frames = interleaved_samples.size() / num_channels;
+
+    if (k_num_lanes % num_channels == 0) {
+        // Every lane only ever sees samples from one channel.
+        LaneStatistics lanes {};
+        AccumulateLanes(interleaved_samples.data(), interleaved_samples.size(), lanes);
+        for (unsigned chan = 0; chan < num_channels; ++chan) {
+            SampleStatistics channel {};
+            channel.num_samples = num_frames;
+            for (usize lane = chan; lane < k_num_lanes; lane += num_channels) {
+                channel.peak = std::max(channel.peak, lanes.peak[lane]);
+                channel.sum_of_squares += lanes.sum_of_squares[lane];
+                channel.sum += lanes.sum[lane];
+            }
+            out[chan].Combine(channel);
+        }
+        return;
+    }
+
+    for (unsigned chan = 0; chan < num_channels; ++chan) {
+        SampleStatistics channel {};
+        channel.num_samples = num_frames;
+        for (usize frame = 0; frame < num_frames; ++frame) {
+            const auto s = interleaved_samples[frame * num_channels + chan];
+            channel.peak = std::max(channel.peak, std::abs(s));
+            channel.sum_of_squares += s * s;
+            channel.sum += s;
+        }
+        out[chan].Combine(channel);
+    }
+}
+
+// v is clamped to the range [-negative_scale, positive_scale] and rounded. std::round is a library call, so
+// round by hand: truncate, then step away from zero if the part that was cut off was at least a half.
+static inline s32 RoundAndClamp(double v, double negative_scale, double positive_scale) {
+    v = std::min(std::max(v, -negative_scale), positive_scale);
+    const auto truncated = (s32)v;
+    const auto fraction = v - (double)truncated;
+    return truncated + (s32)(fraction >= 0.5) - (s32)(fraction <= -0.5);
+}
+
+SAMPLE_KERNEL void
+QuantiseSamples(tcb::span<const double> samples, double gain, unsigned bits_per_sample, s32 *out) {
+    assert(bits_per_sample >= 8 && bits_per_sample <= 32);
+    const auto negative_scale = std::ldexp(1.0, (int)bits_per_sample - 1);
+    const auto positive_scale = negative_scale - 1;
+    const auto *data = samples.data();
+    for (usize i = 0; i < samples.size(); ++i) {
+        const auto s = data[i] * gain;
+        const auto scale = s < 0 ? negative_scale : positive_scale;
+        out[i] = RoundAndClamp(s * scale, negative_scale, positive_scale);
+    }
+}
+
+SAMPLE_KERNEL void QuantiseSamplesWithDither(tcb::span<const double> samples,
+                                             double gain,
+                                             unsigned bits_per_sample,
+                                             const double *dither,
+                                             s32 *out) {
+    assert(bits_per_sample >= 8 && bits_per_sample <= 32);
+    const auto negative_scale = std::ldexp(1.0, (int)bits_per_sample - 1);
+    const auto positive_scale = negative_scale - 1;
+    const auto *data = samples.data();
+    for (usize i = 0; i < samples.size(); ++i) {
+        const auto s = data[i] * gain;
+        const auto scale = s < 0 ? negative_scale : positive_scale;
+        out[i] = RoundAndClamp(s * scale + dither[i], negative_scale, positive_scale);
+    }
+}
+
+// lowbias32 by Chris Wellons: a cheap integer hash that is a bijection and that mixes every bit of the input
+// into every bit of the output. It only needs 32-bit multiplies, which vectorise on every instruction set.
+static inline u32 HashU32(u32 x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+SAMPLE_KERNEL void GenerateTriangularDither(u64 first_sample_index, u32 seed, tcb::span<double> out) {
+    // The random numbers are hashes of the sample index, keyed by the seed - like the Philox generator, but
+    // with a much cheaper hash. The top half of the index is folded into the keys so that the numbers do not
+    // repeat in long files.
+    const auto key_a = HashU32(seed ^ HashU32((u32)(first_sample_index >> 32)));
+    const auto key_b = HashU32(key_a + 0x9e3779b9u);
+    const auto first = (u32)first_sample_index;
+    auto *data = out.data();
+    for (usize i = 0; i < out.size(); ++i) {
+        const auto index = first + (u32)i;
+        // The sum of two uniform random numbers in [-0.5, 0.5) has a triangular distribution in [-1, 1).
+        // The conversion goes via s32 because converting signed integers to double is a single instruction.
+        const auto a = (double)(s32)HashU32(index ^ key_a);
+        const auto b = (double)(s32)HashU32(index ^ key_b);
+        data[i] = (a + b) * (1.0 / 4294967296.0);
+    }
+}
+
+// The hash is split into this many lanes of 32-bit words, in the same way as xxHash32 but with more lanes, so
+// that it vectorises using 32-bit multiplies. The lanes are combined with a 64-bit mix at the end.
+static constexpr usize k_num_hash_lanes = 16;
+static constexpr u32 k_hash_prime_1 = 0x9e3779b1u;
+static constexpr u32 k_hash_prime_2 = 0x85ebca77u;
+
+// The finaliser of MurmurHash3.
+static inline u64 MixU64(u64 x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+SAMPLE_KERNEL u64 HashSamples(tcb::span<const double> samples, u64 seed) {
+    u32 lanes[k_num_hash_lanes];
+    for (usize lane = 0; lane < k_num_hash_lanes; ++lane) {
+        lanes[lane] = (u32)seed + (u32)lane * k_hash_prime_1;
+    }
+
+    const auto *bytes = reinterpret_cast<const u8 *>(samples.data());
+    const auto num_bytes = samples.size() * sizeof(double);
+    constexpr usize block_size = k_num_hash_lanes * sizeof(u32);
+    usize pos = 0;
+    for (; pos + block_size <= num_bytes; pos += block_size) {
+        u32 words[k_num_hash_lanes];
+        std::memcpy(words, bytes + pos, block_size);
+        for (usize lane = 0; lane < k_num_hash_lanes; ++lane) {
+            auto acc = lanes[lane] + words[lane] * k_hash_prime_2;
+            acc = (acc << 13) | (acc >> 19);
+            lanes[lane] = acc * k_hash_prime_1;
+        }
+    }
+
+    auto result = MixU64(seed ^ (u64)num_bytes);
+    for (usize lane = 0; lane < k_num_hash_lanes; ++lane) {
+        result = MixU64(result ^ lanes[lane]);
+    }
+    for (; pos < num_bytes; pos += sizeof(u64)) {
+        u64 word;
+        std::memcpy(&word, bytes + pos, sizeof(word));
+        result = MixU64(result ^ word);
+    }
+    return result;
+}
+
+SAMPLE_KERNEL void
+MixChannelsDown(tcb::span<const double> interleaved_samples, unsigned num_channels, tcb::span<double> out) {
+    const auto *in = interleaved_samples.data();
+    auto *mono = out.data();
+    const auto num_frames = out.size();
+    assert(interleaved_samples.size() == num_frames * num_channels);
+
+    if (num_channels == 2) {
+        for (usize frame = 0; frame < num_frames; ++frame) {
+            mono[frame] = in[frame * 2] + in[frame * 2 + 1];
+        }
+    } else {
+        for (usize frame = 0; frame < num_frames; ++frame) {
+            double v = 0;
+            for (unsigned chan = 0; chan < num_channels; ++chan) {
+                v += in[frame * num_channels + chan];
+            }
+            mono[frame] = v;
+        }
+    }
+}
+
+TEST_CASE("Sample kernels") {
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+
+    // Sizes either side of the lane and block sizes, so that the leftover samples are tested too.
+    for (const usize num_frames : {0, 1, 7, 8, 9, 63, 64, 65, 1000}) {
+        for (const unsigned num_channels : {1u, 2u, 3u, 4u, 6u, 8u}) {
+            CAPTURE(num_frames);
+            CAPTURE(num_channels);
+            std::vector<double> samples(num_frames * num_channels);
+            for (auto &s : samples) {
+                s = dist(gen);
+            }
+
+            double peak = 0, sum_of_squares = 0;
+            for (const auto s : samples) {
+                peak = std::max(peak, std::abs(s));
+                sum_of_squares += s * s;
+            }
+            CHECK(GetPeakMagnitude(samples) == peak);
+            CHECK(GetSumOfSquares(samples) == doctest::Approx(sum_of_squares).epsilon(1e-12));
+            const auto stats = GetSampleStatistics(samples);
+            CHECK(stats.peak == peak);
+            CHECK(stats.sum_of_squares == doctest::Approx(sum_of_squares).epsilon(1e-12));
+            CHECK(stats.num_samples == samples.size());
+
+            std::vector<SampleStatistics> channels(num_channels);
+            AddChannelStatistics(samples, num_channels, channels);
+            std::vector<double> mono(num_frames);
+            MixChannelsDown(samples, num_channels, mono);
+            for (unsigned chan = 0; chan < num_channels; ++chan) {
+                double channel_peak = 0, channel_sum_of_squares = 0, channel_sum = 0;
+                for (usize frame = 0; frame < num_frames; ++frame) {
+                    const auto s = samples[frame * num_channels + chan];
+                    channel_peak = std::max(channel_peak, std::abs(s));
+                    channel_sum_of_squares += s * s;
+                    channel_sum += s;
+                }
+                CHECK(channels[chan].peak == channel_peak);
+                CHECK(channels[chan].sum_of_squares ==
+                      doctest::Approx(channel_sum_of_squares).epsilon(1e-12));
+                CHECK(channels[chan].sum == doctest::Approx(channel_sum).epsilon(1e-12));
+                CHECK(channels[chan].num_samples == num_frames);
+            }
+            for (usize frame = 0; frame < num_frames; ++frame) {
+                double v = 0;
+                for (unsigned chan = 0; chan < num_channels; ++chan) {
+                    v += samples[frame * num_channels + chan];
+                }
+                REQUIRE(mono[frame] == v);
+            }
+
+            // Changing the seed or the smallest amount of any one sample changes the hash.
+            const auto hash = HashSamples(samples, 0);
+            CHECK(HashSamples(samples, 1) != hash);
+            if (!samples.empty()) {
+                auto changed = samples;
+                auto &s = changed[changed.size() / 2];
+                s = std::nextafter(s, 2.0);
+                CHECK(HashSamples(changed, 0) != hash);
+            }
+
+            auto doubled = samples;
+            MultiplySamples(doubled, 2);
+            AddSamples(doubled, samples);
+            for (usize i = 0; i < samples.size(); ++i) {
+                REQUIRE(doubled[i] == samples[i] * 2 + samples[i]);
+            }
+
+            CHECK(AllSamplesAreZero(samples) == samples.empty());
+            std::fill(samples.begin(), samples.end(), 0.0);
+            CHECK(AllSamplesAreZero(samples));
+            if (!samples.empty()) {
+                samples.back() = 1e-300;
+                CHECK(!AllSamplesAreZero(samples));
+            }
+        }
+    }
+}
+
+TEST_CASE("Triangular dither") {
+    std::vector<double> dither(100000);
+    GenerateTriangularDither(0, 1, dither);
+
+    SampleStatistics stats = GetSampleStatistics(dither);
+    CHECK(stats.peak < 1);
+    CHECK(std::abs(stats.DCOffset()) < 0.01);
+    // The variance of triangular noise with a width of 2 is 1/6.
+    CHECK(stats.sum_of_squares / (double)dither.size() == doctest::Approx(1.0 / 6.0).epsilon(0.02));
+
+    // Each number only depends on its index, so the noise can be generated in pieces.
+    std::vector<double> second_half(dither.size() / 2);
+    GenerateTriangularDither(dither.size() / 2, 1, second_half);
+    CHECK(std::equal(second_half.begin(), second_half.end(), dither.begin() + dither.size() / 2));
+
+    std::vector<double> other_seed(dither.size());
+    GenerateTriangularDither(0, 2, other_seed);
+    CHECK(other_seed != dither);
+
+    // Dither of less than half a step does not change samples that are already on a step.
+    std::vector<double> samples {-1.0, 0.0, 0.5, 1.0};
+    std::vector<s32> quantised(samples.size());
+    const double small_dither[] = {0.4, -0.4, 0.4, -0.4};
+    QuantiseSamplesWithDither(samples, 1.0, 8, small_dither, quantised.data());
+    CHECK(quantised == std::vector<s32> {-128, 0, 64, 127});
+}
+
+TEST_CASE("Quantising samples") {
+    std::mt19937 gen(2);
+    std::uniform_real_distribution<double> dist(-1.2, 1.2);
+    std::vector<double> samples {-1.0, 1.0, 0.0, -0.0, 0.5 / 32767, -0.5 / 32768, 1.5 / 32767, -2.5 / 32768};
+    for (int i = 0; i < 1000; ++i) {
+        samples.push_back(dist(gen));
+    }
+
+    for (const unsigned bits : {8u, 16u, 24u, 32u}) {
+        CAPTURE(bits);
+        const auto negative_scale = std::ldexp(1.0, (int)bits - 1);
+        const auto positive_scale = negative_scale - 1;
+        for (const double gain : {1.0, 0.8}) {
+            std::vector<s32> result(samples.size());
+            QuantiseSamples(samples, gain, bits, result.data());
+            for (usize i = 0; i < samples.size(); ++i) {
+                const auto s = samples[i] * gain;
+                const auto expected = std::clamp(std::round(s < 0 ? s * negative_scale : s * positive_scale),
+                                                 -negative_scale, positive_scale);
+                REQUIRE(result[i] == (s32)expected);
+            }
+        }
+    }
+}
+
+// Run with: tests --test-case="Sample kernels benchmark" --no-skip
+TEST_CASE("Sample kernels benchmark" * doctest::skip()) {
+    // 60 seconds of stereo at 48 kHz
+    std::vector<double> samples(48000 * 60 * 2);
+    for (usize i = 0; i < samples.size(); ++i) {
+        samples[i] = std::sin((double)i * 0.001);
+    }
+    const auto num_mb = (double)(samples.size() * sizeof(double)) / (1024.0 * 1024.0);
+
+    const auto Benchmark = [&](const char *name, auto &&kernel) {
+        constexpr int num_repeats = 20;
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < num_repeats; ++i) {
+            kernel();
+        }
+        const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        MessageWithNewLine("Benchmark", {}, "{}: {:.0f} MB/s", name, num_mb * num_repeats / seconds);
+    };
+
+    volatile double sink = 0;
+    Benchmark("scalar peak", [&] {
+        double peak = 0;
+        for (const auto s : samples) {
+            peak = std::max(peak, std::abs(s));
+        }
+        sink = peak;
+    });
+    Benchmark("peak", [&] { sink = GetPeakMagnitude(samples); });
+    Benchmark("scalar sum of squares", [&] {
+        double sum = 0;
+        for (const auto s : samples) {
+            sum += std::pow(s, 2.0);
+        }
+        sink = sum;
+    });
+    Benchmark("sum of squares", [&] { sink = GetSumOfSquares(samples); });
+    Benchmark("stereo statistics", [&] {
+        SampleStatistics channels[2] {};
+        AddChannelStatistics(samples, 2, channels);
+        sink = channels[0].peak;
+    });
+    Benchmark("multiply", [&] { MultiplySamples(samples, 1.0); });
+    Benchmark("hash", [&] { sink = (double)HashSamples(samples, 0); });
+    std::vector<s32> quantised(samples.size());
+    Benchmark("scalar quantise", [&] {
+        for (usize i = 0; i < samples.size(); ++i) {
+            const auto s = samples[i];
+            quantised[i] = (s32)std::round(s < 0 ? s * std::pow(2, 23) : s * (std::pow(2, 23) - 1));
+        }
+    });
+    Benchmark("quantise", [&] { QuantiseSamples(samples, 1.0, 24, quantised.data()); });
+    std::vector<double> dither(samples.size());
+    Benchmark("triangular dither", [&] { GenerateTriangularDither(0, 1, dither); });
+    Benchmark("quantise with dither",
+              [&] { QuantiseSamplesWithDither(samples, 1.0, 24, dither.data(), quantised.data()); });
+}
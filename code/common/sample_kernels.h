@@ -0,0 +1,66 @@
+#pragma once
+
+#include "span.hpp"
+
+#include "types.h"
+
+// The loops over whole buffers of samples that many of the commands spend most of their time in. They are
+// written so that the compiler can vectorise them. On x86-64 Linux, each one is compiled for SSE2, AVX2 and
+// AVX-512, and the best version for the CPU is chosen when the program is loaded; elsewhere they use the
+// baseline SIMD of the target, such as NEON on ARM64. The reductions always add up the samples in the same
+// order, so every version gives exactly the same result.
+
+struct SampleStatistics {
+    double peak {}; // the largest magnitude
+    double sum_of_squares {};
+    double sum {}; // for the DC offset
+    usize num_samples {};
+
+    void Combine(const SampleStatistics &other);
+    double RMS() const;
+    double DCOffset() const;
+};
+
+void MultiplySamples(tcb::span<double> samples, double amount);
+void AddSamples(tcb::span<double> samples, tcb::span<const double> samples_to_add);
+bool AllSamplesAreZero(tcb::span<const double> samples);
+
+double GetPeakMagnitude(tcb::span<const double> samples);
+double GetSumOfSquares(tcb::span<const double> samples);
+
+// Peak, sum of squares and sum, in one pass over the samples.
+SampleStatistics GetSampleStatistics(tcb::span<const double> samples);
+
+// The statistics of each channel of interleaved samples, in one pass over the samples. out must have
+// num_channels elements; the statistics are added to what is already in out.
+void AddChannelStatistics(tcb::span<const double> interleaved_samples,
+                          unsigned num_channels,
+                          tcb::span<SampleStatistics> out);
+
+// Multiplies each sample by gain and converts it to an integer of the given bit depth, from 8 to 32.
+// Negative samples are scaled by 2^(bits - 1) and positive ones by 2^(bits - 1) - 1 so that -1 and 1 map to
+// the smallest and largest values. The results are rounded half away from zero, like std::round, and clamped
+// to the range of the bit depth.
+void QuantiseSamples(tcb::span<const double> samples, double gain, unsigned bits_per_sample, s32 *out);
+
+// The same as QuantiseSamples, but each sample has the matching value of dither added to it after it has been
+// scaled to the bit depth, so dither is in units of the smallest step.
+void QuantiseSamplesWithDither(tcb::span<const double> samples,
+                               double gain,
+                               unsigned bits_per_sample,
+                               const double *dither,
+                               s32 *out);
+
+// Fills out with noise that has a triangular probability density in [-1, 1); the standard dither for
+// quantisation. The noise of each sample is a hash of its index and the seed, so it is the same whichever
+// order the samples are generated in.
+void GenerateTriangularDither(u64 first_sample_index, u32 seed, tcb::span<double> out);
+
+// A 64-bit hash of the bit patterns of the samples, for telling audio apart by its content. It is fast rather
+// than cryptographic.
+u64 HashSamples(tcb::span<const double> samples, u64 seed);
+
+// Sums the channels of each frame; out must have one element per frame.
+void MixChannelsDown(tcb::span<const double> interleaved_samples,
+                     unsigned num_channels,
+                     tcb::span<double> out);
@@ -0,0 +1,277 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iterator>
+#include <string>
+
+#include "doctest.hpp"
+
+#include "common.h"
+
+static thread_local bool g_is_running_pool_task = false;
+
+ThreadPool::ThreadPool(unsigned num_threads) {
+    num_threads = std::max(1u, num_threads);
+    for (unsigned i = 0; i < num_threads; ++i) {
+        m_ranges.push_back(std::make_unique<Range>());
+    }
+    // The thread that calls ForEach is also used, so it only needs num_threads - 1 new threads
+    for (unsigned i = 1; i < num_threads; ++i) {
+        m_workers.emplace_back([this, i] { WorkerThread(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::scoped_lock lock {m_mutex};
+        m_quit = true;
+    }
+    m_work_available.notify_all();
+    for (auto &t : m_workers) {
+        t.join();
+    }
+}
+
+void ThreadPool::ForEach(usize num_tasks, const std::function<void(usize)> &task) {
+    if (m_workers.empty() || num_tasks <= 1 || g_is_running_pool_task) {
+        for (usize i = 0; i < num_tasks; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    const auto num_threads = NumThreads();
+    for (unsigned i = 0; i < num_threads; ++i) {
+        auto &range = *m_ranges[i];
+        std::scoped_lock lock {range.mutex};
+        range.begin = num_tasks * i / num_threads;
+        range.end = num_tasks * (i + 1) / num_threads;
+    }
+
+    {
+        std::scoped_lock lock {m_mutex};
+        m_task = &task;
+        m_num_busy_workers = (unsigned)m_workers.size();
+        ++m_generation;
+    }
+    m_work_available.notify_all();
+
+    RunTasks(0);
+
+    // A worker is only marked as not busy once it can no longer find any tasks and the task it was running
+    // has finished, so once all the workers are idle every task has completed.
+    std::unique_lock lock {m_mutex};
+    m_work_finished.wait(lock, [this] { return m_num_busy_workers == 0; });
+    m_task = nullptr;
+}
+
+void ThreadPool::WorkerThread(unsigned thread_index) {
+    u64 generation = 0;
+    while (true) {
+        {
+            std::unique_lock lock {m_mutex};
+            m_work_available.wait(lock, [&] { return m_quit || m_generation != generation; });
+            if (m_quit) return;
+            generation = m_generation;
+        }
+
+        RunTasks(thread_index);
+
+        {
+            std::scoped_lock lock {m_mutex};
+            --m_num_busy_workers;
+        }
+        m_work_finished.notify_one();
+    }
+}
+
+void ThreadPool::RunTasks(unsigned thread_index) {
+    g_is_running_pool_task = true;
+    while (true) {
+        usize task_index;
+        if (PopTask(thread_index, task_index)) {
+            (*m_task)(task_index);
+        } else if (!StealTasks(thread_index)) {
+            break;
+        }
+    }
+    g_is_running_pool_task = false;
+}
+
+bool ThreadPool::PopTask(unsigned thread_index, usize &task_index) {
+    auto &range = *m_ranges[thread_index];
+    std::scoped_lock lock {range.mutex};
+    if (range.begin == range.end) return false;
+    task_index = range.begin++;
+    return true;
+}
+
+bool ThreadPool::StealTasks(unsigned thread_index) {
+    while (true) {
+        Range *victim = nullptr;
+        usize victim_size = 0;
+        for (unsigned i = 0; i < m_ranges.size(); ++i) {
+            if (i == thread_index) continue;
+            auto &range = *m_ranges[i];
+            std::scoped_lock lock {range.mutex};
+            if (range.end - range.begin > victim_size) {
+                victim_size = range.end - range.begin;
+                victim = &range;
+            }
+        }
+        if (!victim) return false;
+
+        usize stolen_begin, stolen_end;
+        {
+            std::scoped_lock lock {victim->mutex};
+            const auto size = victim->end - victim->begin;
+            if (size == 0) continue; // the owner or another thread got there first, try again
+            stolen_end = victim->end;
+            stolen_begin = stolen_end - (size + 1) / 2;
+            victim->end = stolen_begin;
+        }
+
+        auto &range = *m_ranges[thread_index];
+        std::scoped_lock lock {range.mutex};
+        range.begin = stolen_begin;
+        range.end = stolen_end;
+        return true;
+    }
+}
+
+static unsigned g_num_parallel_jobs = 1;
+static std::unique_ptr<ThreadPool> g_thread_pool {};
+
+void SetNumParallelJobs(unsigned num_jobs) {
+    if (num_jobs == 0) num_jobs = std::max(1u, std::thread::hardware_concurrency());
+    g_num_parallel_jobs = num_jobs;
+}
+
+unsigned GetNumParallelJobs() { return g_num_parallel_jobs; }
+
+static ThreadPool &GetThreadPool() {
+    if (!g_thread_pool || g_thread_pool->NumThreads() != g_num_parallel_jobs) {
+        g_thread_pool.reset();
+        g_thread_pool = std::make_unique<ThreadPool>(g_num_parallel_jobs);
+    }
+    return *g_thread_pool;
+}
+
+void ParallelFor(usize num_tasks, const std::function<void(usize)> &task) {
+    if (g_num_parallel_jobs == 1 || num_tasks <= 1 || g_is_running_pool_task) {
+        for (usize i = 0; i < num_tasks; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    struct TaskResult {
+        std::vector<LogRecord> log {};
+        std::exception_ptr exception {};
+        bool completed {};
+    };
+    std::vector<TaskResult> results(num_tasks);
+    std::atomic<usize> first_failed_task {num_tasks};
+
+    // The output of each task is printed as soon as all of the tasks before it have completed. Nothing after a
+    // failed task is printed, just like if the tasks were run sequentially.
+    std::vector<LogRecord> *const caller_log_buffer = GetLogCaptureBuffer();
+    std::mutex output_mutex;
+    usize next_task_to_output = 0;
+    const auto OutputCompletedTasks = [&]() {
+        while (next_task_to_output < num_tasks && next_task_to_output <= first_failed_task &&
+               results[next_task_to_output].completed) {
+            // Each task's records are logged as a single unit, so the messages for a file are always printed
+            // together.
+            auto &log = results[next_task_to_output].log;
+            if (caller_log_buffer) {
+                caller_log_buffer->insert(caller_log_buffer->end(), std::make_move_iterator(log.begin()),
+                                          std::make_move_iterator(log.end()));
+            } else {
+                Log(std::move(log));
+            }
+            std::vector<LogRecord>().swap(log);
+            ++next_task_to_output;
+        }
+    };
+
+    GetThreadPool().ForEach(num_tasks, [&](usize task_index) {
+        auto &result = results[task_index];
+
+        // There's no need to run a task if an earlier task has already failed.
+        if (task_index < first_failed_task) {
+            auto const previous_buffer = SetLogCaptureBuffer(&result.log);
+            try {
+                task(task_index);
+            } catch (...) {
+                result.exception = std::current_exception();
+                auto failed = first_failed_task.load();
+                while (task_index < failed && !first_failed_task.compare_exchange_weak(failed, task_index)) {
+                }
+            }
+            SetLogCaptureBuffer(previous_buffer);
+        }
+
+        std::scoped_lock lock {output_mutex};
+        result.completed = true;
+        OutputCompletedTasks();
+    });
+
+    if (const auto failed = first_failed_task.load(); failed != num_tasks) {
+        std::rethrow_exception(results[failed].exception);
+    }
+}
+
+bool CanRunInParallel() { return g_num_parallel_jobs != 1 && !g_is_running_pool_task; }
+
+TEST_CASE("ThreadPool") {
+    SUBCASE("every task is run exactly once") {
+        ThreadPool pool {4};
+        for (const usize num_tasks : {0, 1, 3, 4, 1000}) {
+            std::vector<std::atomic<int>> counts(num_tasks);
+            pool.ForEach(num_tasks, [&](usize i) { counts[i]++; });
+            for (auto &c : counts) {
+                REQUIRE(c == 1);
+            }
+        }
+    }
+
+    SUBCASE("ParallelFor behaves like a sequential loop") {
+        SetNumParallelJobs(4);
+        std::vector<LogRecord> captured;
+        auto const previous_buffer = SetLogCaptureBuffer(&captured);
+        const auto CapturedText = [&]() {
+            std::string result;
+            for (const auto &r : captured) {
+                result += r.text;
+            }
+            return result;
+        };
+
+        std::string expected;
+        for (usize i = 0; i < 100; ++i) {
+            expected += fmt::format("{}\n", i);
+        }
+
+        ParallelFor(100, [](usize i) { WriteOutput(fmt::format("{}\n", i)); });
+        CHECK(CapturedText() == expected);
+
+        captured.clear();
+        std::string error_message;
+        try {
+            ParallelFor(100, [](usize i) {
+                WriteOutput(fmt::format("{}\n", i));
+                if (i == 40 || i == 70) throw std::runtime_error(std::to_string(i));
+            });
+        } catch (const std::runtime_error &e) {
+            error_message = e.what();
+        }
+        CHECK(error_message == "40");
+        CHECK(CapturedText() == expected.substr(0, expected.find("41\n")));
+
+        SetLogCaptureBuffer(previous_buffer);
+        SetNumParallelJobs(1);
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "types.h"
+
+// A fixed set of worker threads for running a batch of tasks that are identified by an index.
+//
+// Each thread is given an equal share of the indices up-front. A thread works through its own share from the
+// front, and when it runs out it steals the back half of whichever other thread has the most remaining. This
+// keeps all the threads busy even when the tasks take very different amounts of time - which is typical for
+// audio files of different lengths.
+class ThreadPool {
+  public:
+    ThreadPool(unsigned num_threads);
+    ~ThreadPool();
+
+    unsigned NumThreads() const { return (unsigned)m_workers.size() + 1; }
+
+    // Calls task(i) for every i in the range [0, num_tasks) and waits until all of them have completed. The
+    // calling thread also runs tasks. The order that the tasks are run in is not defined. The task must not
+    // throw. If this is called from inside a task, the tasks are run sequentially on the calling thread.
+    void ForEach(usize num_tasks, const std::function<void(usize)> &task);
+
+  private:
+    struct Range {
+        std::mutex mutex {};
+        usize begin {};
+        usize end {};
+    };
+
+    void WorkerThread(unsigned thread_index);
+    void RunTasks(unsigned thread_index);
+    bool PopTask(unsigned thread_index, usize &task_index);
+    bool StealTasks(unsigned thread_index);
+
+    std::vector<std::thread> m_workers {};
+    std::vector<std::unique_ptr<Range>> m_ranges {};
+
+    std::mutex m_mutex {};
+    std::condition_variable m_work_available {};
+    std::condition_variable m_work_finished {};
+    u64 m_generation {};
+    unsigned m_num_busy_workers {};
+    bool m_quit {};
+
+    const std::function<void(usize)> *m_task {};
+};
+
+// Sets the number of threads used by ParallelFor. 0 means use all of the hardware's threads.
+void SetNumParallelJobs(unsigned num_jobs);
+unsigned GetNumParallelJobs();
+
+// Calls task(i) for every i in the range [0, num_tasks) using the number of threads set by
+// SetNumParallelJobs(). The observable behaviour is the same as running the tasks sequentially in order:
+// anything that a task logs is captured and then logged in task order, and if tasks throw, the exception of
+// the lowest-indexed one is rethrown after the tasks before it have completed. Output from the tasks after
+// that one is discarded.
+void ParallelFor(usize num_tasks, const std::function<void(usize)> &task);
+
+// True if ParallelFor would run tasks on multiple threads if it were called from the current thread; it runs
+// them sequentially if there is only 1 job or if it is called from inside another ParallelFor.
+bool CanRunInParallel();
@@ -4,6 +4,7 @@
 #include "CLI11_Fwd.hpp"
 
 #include "audio_files.h"
+#include "thread_pool.h"
 
 class SignetBackup;
 
@@ -17,5 +18,16 @@ class Command {
     virtual bool AllowsSingleOutputFile() const { return true; }
 
     virtual void GenerateFiles(AudioFiles &, SignetBackup &) {}
-    virtual void ProcessFiles(AudioFiles &) {}
+    virtual void ProcessFiles(AudioFiles &files) {
+        ParallelFor(files.Size(), [&](usize i) {
+            ProcessFile(files[i]);
+            files[i].PackAudio();
+        });
+    }
+
+    // Commands that do not need any information about the other files can override these. The files are then
+    // processed in parallel when --jobs is given, and the command can be used in --streaming mode, where each
+    // file is loaded, processed, written and freed before the next one is loaded.
+    virtual bool ProcessesFilesIndependently() const { return false; }
+    virtual void ProcessFile(EditTrackedAudioFile &) {}
 };
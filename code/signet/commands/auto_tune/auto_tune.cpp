@@ -27,46 +27,47 @@ CLI::App *AutoTuneCommand::CreateCommandCLI(CLI::App &app) {
     return auto_tune;
 }
 
-void AutoTuneCommand::ProcessFiles(AudioFiles &files) {
-    auto ExpectedNoteIsValid = [this](MIDIPitch target_midi_pitch, EditTrackedAudioFile &f) {
-        if (const auto expected_midi_note = m_expected_midi_pitch.GetExpectedMidiPitch(GetName(), f)) {
-            const auto target_note = target_midi_pitch.midi_note % 12;
-            const auto expected_note = expected_midi_note->midi_note % 12;
-            if (target_note != expected_note) {
-                WarningWithNewLine(
-                    GetName(), f,
-                    "Failed to auto-tune the file because the detected target pitch is {}, while the --expected-note is {}",
-                    target_midi_pitch.ToString(), expected_midi_note->ToString(),
-                    g_note_names[expected_note]);
-                return false;
-            }
+bool AutoTuneCommand::ExpectedNoteIsValid(MIDIPitch target_midi_pitch, EditTrackedAudioFile &f) const {
+    if (const auto expected_midi_note = m_expected_midi_pitch.GetExpectedMidiPitch(GetName(), f)) {
+        const auto target_note = target_midi_pitch.midi_note % 12;
+        const auto expected_note = expected_midi_note->midi_note % 12;
+        if (target_note != expected_note) {
+            WarningWithNewLine(
+                GetName(), f,
+                "Failed to auto-tune the file because the detected target pitch is {}, while the --expected-note is {}",
+                target_midi_pitch.ToString(), expected_midi_note->ToString(), g_note_names[expected_note]);
+            return false;
         }
-        return true;
-    };
+    }
+    return true;
+}
 
-    if (!m_identical_processing_set.ShouldProcessInSets()) {
-        for (auto &f : files) {
-            if (const auto pitch = f.GetAudio().DetectPitch()) {
-                const auto closest_musical_note = FindClosestMidiPitch(*pitch);
-                if (ExpectedNoteIsValid(closest_musical_note, f)) {
-                    const double cents = GetCentsDifference(*pitch, closest_musical_note.pitch);
-                    if (std::abs(cents) < 1) {
-                        MessageWithNewLine(GetName(), f, "Sample is already in tune: {}",
-                                           closest_musical_note.ToString());
-                        continue;
-                    }
-                    MessageWithNewLine(GetName(), f, "Changing pitch by {:.2f} cents", cents);
-                    f.GetWritableAudio().ChangePitch(cents);
-                }
-            } else {
-                WarningWithNewLine(GetName(), f, "No pitch could be found");
+void AutoTuneCommand::ProcessFile(EditTrackedAudioFile &f) {
+    if (const auto pitch = f.GetDetectedPitch()) {
+        const auto closest_musical_note = FindClosestMidiPitch(*pitch);
+        if (ExpectedNoteIsValid(closest_musical_note, f)) {
+            const double cents = GetCentsDifference(*pitch, closest_musical_note.pitch);
+            if (std::abs(cents) < 1) {
+                MessageWithNewLine(GetName(), f, "Sample is already in tune: {}",
+                                   closest_musical_note.ToString());
+                return;
             }
+            MessageWithNewLine(GetName(), f, "Changing pitch by {:.2f} cents", cents);
+            f.GetWritableAudio().ChangePitch(cents);
         }
+    } else {
+        WarningWithNewLine(GetName(), f, "No pitch could be found");
+    }
+}
+
+void AutoTuneCommand::ProcessFiles(AudioFiles &files) {
+    if (!m_identical_processing_set.ShouldProcessInSets()) {
+        Command::ProcessFiles(files);
     } else {
         m_identical_processing_set.ProcessSets(
             files, GetName(),
             [&](EditTrackedAudioFile *authority_file, const std::vector<EditTrackedAudioFile *> &set) {
-                if (const auto pitch = authority_file->GetAudio().DetectPitch()) {
+                if (const auto pitch = authority_file->GetDetectedPitch()) {
                     const auto closest_musical_note = FindClosestMidiPitch(*pitch);
                     if (ExpectedNoteIsValid(closest_musical_note, *authority_file)) {
                         const double cents = GetCentsDifference(*pitch, closest_musical_note.pitch);
@@ -9,8 +9,14 @@ class AutoTuneCommand final : public Command {
     std::string GetName() const override { return "AutoTune"; }
     CLI::App *CreateCommandCLI(CLI::App &app) override;
     void ProcessFiles(AudioFiles &files) override;
+    void ProcessFile(EditTrackedAudioFile &f) override;
+    bool ProcessesFilesIndependently() const override {
+        return !m_identical_processing_set.ShouldProcessInSets();
+    }
 
   private:
+    bool ExpectedNoteIsValid(MIDIPitch target_midi_pitch, EditTrackedAudioFile &f) const;
+
     IdenticalProcessingSet m_identical_processing_set;
     ExpectedMidiPitch m_expected_midi_pitch;
 };
@@ -8,12 +8,14 @@ CLI::App *ConvertCommand::CreateCommandCLI(CLI::App &app) {
     auto convert = app.add_subcommand(
         "convert", "Converts the file format, bit-depth or sample "
                    "rate. Features a high quality resampling algorithm. This command has subcommands; it "
-                   "requires at least one of sample-rate, bit-depth or file-format to be specified.");
+                   "requires at least one of sample-rate, bit-depth, file-format or flac-compression to be "
+                   "specified.");
     convert->require_subcommand();
 
     convert->footer(R"aa(Examples:
   signet . convert file-format flac sample-rate 44100 bit-depth 16
-  signet *.wav convert file-format wav bit-depth 24)aa");
+  signet *.wav convert file-format wav bit-depth 24
+  signet *.flac convert flac-compression 8)aa");
 
     auto sample_rate =
         convert->add_subcommand("sample-rate", "Change the sample rate using a high quality resampler.");
@@ -28,6 +30,21 @@ CLI::App *ConvertCommand::CreateCommandCLI(CLI::App &app) {
         ->add_option<decltype(m_sample_rate), unsigned>("bit-depth", m_bit_depth, "The target bit depth.")
         ->required()
         ->check(CLI::IsMember({8, 16, 20, 24, 32, 64}));
+    const std::map<std::string, DitherType> dither_names {
+        {"none", DitherType::None},
+        {"tpdf", DitherType::Triangular},
+        {"shaped-1", DitherType::FirstOrderNoiseShaped},
+        {"shaped-2", DitherType::SecondOrderNoiseShaped},
+    };
+    bit_depth
+        ->add_option_function<DitherType>(
+            "--dither", [this](DitherType d) { m_dither = d; },
+            "Add dither when the samples are rounded to an integer bit depth, so that quiet sounds such as "
+            "the tails of sustained samples fade into a low-level hiss rather than becoming distorted. tpdf "
+            "is plain triangular dither. shaped-1 and shaped-2 also shape the noise so that more of it is at "
+            "high frequencies where it is less audible; shaped-2 the most. The default is none. 8-bit WAV "
+            "files are never dithered.")
+        ->transform(CLI::CheckedTransformer(dither_names, CLI::ignore_case));
 
     std::map<std::string, AudioFileFormat> file_format_name_dictionary;
     for (const auto &e : magic_enum::enum_entries<AudioFileFormat>()) {
@@ -41,6 +58,43 @@ CLI::App *ConvertCommand::CreateCommandCLI(CLI::App &app) {
         ->required()
         ->transform(CLI::CheckedTransformer(file_format_name_dictionary, CLI::ignore_case));
 
+    auto flac_compression = convert->add_subcommand(
+        "flac-compression",
+        "Change how much FLAC files are compressed. Higher compression levels give smaller files but take "
+        "longer to encode; decoding speed is about the same for all levels. Files are written with level 5 "
+        "unless this is specified. This only affects files that are written as FLAC.");
+    flac_compression
+        ->add_option_function<unsigned>(
+            "compression-level",
+            [this](unsigned level) {
+                if (!m_flac_encoding_settings) m_flac_encoding_settings.emplace();
+                m_flac_encoding_settings->compression_level = level;
+            },
+            "The libFLAC compression preset, from 0 (fastest) to 8 (smallest).")
+        ->required()
+        ->check(CLI::Range(0u, FlacEncodingSettings::k_max_compression_level));
+    flac_compression
+        ->add_option_function<unsigned>(
+            "--block-size",
+            [this](unsigned size) {
+                if (!m_flac_encoding_settings) m_flac_encoding_settings.emplace();
+                m_flac_encoding_settings->block_size = size;
+            },
+            "Override the number of frames in each FLAC block. For files with a sample rate of 48000 Hz or "
+            "lower, a block size larger than 4608 is outside of FLAC's streamable subset, which some hardware "
+            "players require.")
+        ->check(CLI::Range(16u, 16384u));
+    flac_compression
+        ->add_option_function<unsigned>(
+            "--max-lpc-order",
+            [this](unsigned order) {
+                if (!m_flac_encoding_settings) m_flac_encoding_settings.emplace();
+                m_flac_encoding_settings->max_lpc_order = order;
+            },
+            "Override the maximum order of the linear predictor. 0 disables LPC, and only the fixed "
+            "predictors are used.")
+        ->check(CLI::Range(0u, 12u));
+
     return convert;
 }
 
@@ -48,7 +102,8 @@ void ConvertCommand::ProcessFiles(AudioFiles &files) {
     m_files_can_be_converted = true;
     if (m_bit_depth) {
         if (!m_file_format) {
-            for (auto &f : files) {
+            ParallelFor(files.Size(), [&](usize i) {
+                auto &f = files[i];
                 auto &audio = f.GetAudio();
                 if (!CanFileBeConvertedToBitDepth(audio.format, *m_bit_depth)) {
                     WarningWithNewLine(GetName(), f,
@@ -56,7 +111,7 @@ void ConvertCommand::ProcessFiles(AudioFiles &files) {
                                        magic_enum::enum_name(audio.format), *m_bit_depth);
                     m_files_can_be_converted = false;
                 }
-            }
+            });
         } else {
             m_files_can_be_converted = CanFileBeConvertedToBitDepth(*m_file_format, *m_bit_depth);
             if (!m_files_can_be_converted) {
@@ -65,50 +120,79 @@ void ConvertCommand::ProcessFiles(AudioFiles &files) {
             }
         }
     } else if (m_file_format) {
-        for (auto &f : files) {
+        ParallelFor(files.Size(), [&](usize i) {
+            auto &f = files[i];
             auto &audio = f.GetAudio();
             if (!CanFileBeConvertedToBitDepth(*m_file_format, audio.bits_per_sample)) {
                 WarningWithNewLine(GetName(), f, "files of type {} cannot be converted to a bit depth of {}",
                                    magic_enum::enum_name(*m_file_format), audio.bits_per_sample);
                 m_files_can_be_converted = false;
             }
-        }
+        });
     }
 
     if (m_files_can_be_converted) {
-        for (auto &f : files) {
-            const auto &audio = f.GetAudio();
-            bool edited = false;
-            if (m_bit_depth) {
-                MessageWithNewLine(GetName(), f, "Setting the bit rate from {} to {}", audio.bits_per_sample,
-                                   *m_bit_depth);
-                f.GetWritableAudio().bits_per_sample = *m_bit_depth;
-                edited = true;
-            }
-            if (m_sample_rate && audio.sample_rate != *m_sample_rate) {
-                MessageWithNewLine(GetName(), f, "Converting sample rate from {} to {}", audio.sample_rate,
-                                   *m_sample_rate);
-                f.GetWritableAudio().Resample((double)*m_sample_rate);
-                edited = true;
-            }
-            if (m_file_format && audio.format != *m_file_format) {
-                const auto from_name = magic_enum::enum_name(audio.format);
-                const auto to_name = magic_enum::enum_name(*m_file_format);
-                MessageWithNewLine(GetName(), f, "Converting file format from {} to {}", from_name, to_name);
-                f.GetWritableAudio().format = *m_file_format;
-                edited = true;
-            }
-
-            if (!edited) {
-                MessageWithNewLine(GetName(), f, "No conversion necessary");
-            }
-        }
+        ParallelFor(files.Size(), [&](usize i) { ConvertFile(files[i]); });
     } else {
         ErrorWithNewLine(GetName(), {},
                          "one or more files cannot be converted therefore no conversion will take place");
     }
 }
 
+void ConvertCommand::ProcessFile(EditTrackedAudioFile &f) {
+    // When processing one file at a time we cannot check all of the files up-front, so instead each file is
+    // checked just before it is converted.
+    auto &audio = f.GetAudio();
+    const auto target_format = m_file_format ? *m_file_format : audio.format;
+    const auto target_bit_depth = m_bit_depth ? *m_bit_depth : audio.bits_per_sample;
+    if (!CanFileBeConvertedToBitDepth(target_format, target_bit_depth)) {
+        ErrorWithNewLine(GetName(), f, "files of type {} cannot be converted to a bit depth of {}",
+                         magic_enum::enum_name(target_format), target_bit_depth);
+        return;
+    }
+    ConvertFile(f);
+}
+
+void ConvertCommand::ConvertFile(EditTrackedAudioFile &f) const {
+    const auto &audio = f.GetAudio();
+    bool edited = false;
+    if (m_bit_depth) {
+        MessageWithNewLine(GetName(), f, "Setting the bit rate from {} to {}", audio.bits_per_sample,
+                           *m_bit_depth);
+        f.GetWritableAudio().bits_per_sample = *m_bit_depth;
+        if (m_dither) f.GetWritableAudio().dither = *m_dither;
+        edited = true;
+    }
+    if (m_sample_rate && audio.sample_rate != *m_sample_rate) {
+        MessageWithNewLine(GetName(), f, "Converting sample rate from {} to {}", audio.sample_rate,
+                           *m_sample_rate);
+        f.GetWritableAudio().Resample((double)*m_sample_rate);
+        edited = true;
+    }
+    if (m_file_format && audio.format != *m_file_format) {
+        const auto from_name = magic_enum::enum_name(audio.format);
+        const auto to_name = magic_enum::enum_name(*m_file_format);
+        MessageWithNewLine(GetName(), f, "Converting file format from {} to {}", from_name, to_name);
+        f.GetWritableAudio().format = *m_file_format;
+        edited = true;
+    }
+    if (m_flac_encoding_settings) {
+        if (audio.format == AudioFileFormat::Flac) {
+            MessageWithNewLine(GetName(), f, "Setting the FLAC compression level to {}",
+                               m_flac_encoding_settings->compression_level);
+            f.GetWritableAudio().flac_encoding_settings = *m_flac_encoding_settings;
+            edited = true;
+        } else {
+            WarningWithNewLine(GetName(), f,
+                               "FLAC compression settings are ignored because the file is not FLAC");
+        }
+    }
+
+    if (!edited) {
+        MessageWithNewLine(GetName(), f, "No conversion necessary");
+    }
+}
+
 TEST_CASE("[ConvertCommand]") {
     SUBCASE("args") {
         SUBCASE("requires a subcommand") {
@@ -129,6 +213,41 @@ TEST_CASE("[ConvertCommand]") {
             REQUIRE(out->NumFrames() == 12);
         }
 
+        SUBCASE("flac compression") {
+            AudioData buf;
+            buf.interleaved_samples = {0.0, 0.2, 0.4, 0.6, 0.8, 1.0};
+            buf.num_channels = 1;
+            buf.sample_rate = 48000;
+            buf.bits_per_sample = 16;
+            buf.format = AudioFileFormat::Flac;
+
+            auto out = TestHelpers::ProcessBufferWithCommand<ConvertCommand>(
+                "convert flac-compression 8 --block-size 2048 --max-lpc-order 10", buf);
+            REQUIRE(out);
+            CHECK(out->flac_encoding_settings.compression_level == 8);
+            CHECK(out->flac_encoding_settings.block_size == 2048u);
+            CHECK(out->flac_encoding_settings.max_lpc_order == 10u);
+
+            REQUIRE_THROWS(
+                TestHelpers::ProcessBufferWithCommand<ConvertCommand>("convert flac-compression 9", buf));
+        }
+
+        SUBCASE("dither") {
+            AudioData buf;
+            buf.interleaved_samples = {0.0, 0.2, 0.4, 0.6, 0.8, 1.0};
+            buf.num_channels = 1;
+            buf.sample_rate = 48000;
+            buf.bits_per_sample = 24;
+
+            auto out = TestHelpers::ProcessBufferWithCommand<ConvertCommand>(
+                "convert bit-depth 16 --dither shaped-2", buf);
+            REQUIRE(out);
+            CHECK(out->dither == DitherType::SecondOrderNoiseShaped);
+
+            REQUIRE_THROWS(TestHelpers::ProcessBufferWithCommand<ConvertCommand>(
+                "convert bit-depth 16 --dither foo", buf));
+        }
+
         SUBCASE("change file-format to a file format that does not support the bit depth") {
             AudioData buf;
             buf.interleaved_samples = {0.0, 0.2, 0.4, 0.6, 0.8, 1.0};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+
 #include "audio_file_io.h"
 #include "signet_interface.h"
 
@@ -7,11 +9,17 @@ class ConvertCommand final : public Command {
   public:
     CLI::App *CreateCommandCLI(CLI::App &app) override;
     void ProcessFiles(AudioFiles &files) override;
+    void ProcessFile(EditTrackedAudioFile &f) override;
+    bool ProcessesFilesIndependently() const override { return true; }
     std::string GetName() const override { return "Convert"; }
 
   private:
-    bool m_files_can_be_converted {};
+    void ConvertFile(EditTrackedAudioFile &f) const;
+
+    std::atomic<bool> m_files_can_be_converted {};
     std::optional<unsigned> m_sample_rate {};
     std::optional<unsigned> m_bit_depth {};
+    std::optional<DitherType> m_dither {};
     std::optional<AudioFileFormat> m_file_format {};
+    std::optional<FlacEncodingSettings> m_flac_encoding_settings {};
 };
@@ -6,23 +6,101 @@
 #include "audio_files.h"
 #include "common.h"
 #include "midi_pitches.h"
+#include "test_helpers.h"
 
 CLI::App *DetectPitchCommand::CreateCommandCLI(CLI::App &app) {
     auto detect_pitch = app.add_subcommand("detect-pitch", "Prints out the detected pitch of the file(s).");
     return detect_pitch;
 }
 
-void DetectPitchCommand::ProcessFiles(AudioFiles &files) {
-    for (auto &f : files) {
-        const auto pitch = f.GetAudio().DetectPitch();
-        if (pitch) {
-            const auto closest_musical_note = FindClosestMidiPitch(*pitch);
-
-            MessageWithNewLine(GetName(), f, "Detected pitch {:.2f} Hz ({:.1f} cents from {}, MIDI {})",
-                               *pitch, GetCentsDifference(closest_musical_note.pitch, *pitch),
-                               closest_musical_note.name, closest_musical_note.midi_note);
-        } else {
-            MessageWithNewLine(GetName(), f, "No pitch could be found");
-        }
+void DetectPitchCommand::ProcessFile(EditTrackedAudioFile &f) {
+    const auto pitch = f.GetDetectedPitch();
+    if (pitch) {
+        const auto closest_musical_note = FindClosestMidiPitch(*pitch);
+
+        MessageWithNewLine(GetName(), f, "Detected pitch {:.2f} Hz ({:.1f} cents from {}, MIDI {})",
+                           *pitch, GetCentsDifference(closest_musical_note.pitch, *pitch),
+                           closest_musical_note.name, closest_musical_note.midi_note);
+    } else {
+        MessageWithNewLine(GetName(), f, "No pitch could be found");
     }
 }
+
+TEST_CASE("Analyses of the audio are kept until it changes") {
+    EditTrackedAudioFile f("file.wav");
+    f.SetAudioData(TestHelpers::CreateSineWaveAtFrequency(1, 44100, 1, 220));
+
+    const auto pitch = f.GetDetectedPitch();
+    REQUIRE(pitch);
+    CHECK(*pitch == doctest::Approx(220).epsilon(0.01));
+    const auto peak = f.GetSampleStatistics().peak;
+
+    // Changing only the metadata does not change them.
+    f.GetWritableMetadata().markers.push_back({"marker", 10});
+    CHECK(f.GetDetectedPitch() == pitch);
+
+    f.GetWritableAudio().ChangePitch(1200);
+    REQUIRE(f.GetDetectedPitch());
+    CHECK(*f.GetDetectedPitch() == doctest::Approx(440).epsilon(0.01));
+
+    f.GetWritableAudio().MultiplyByScalar(0.5);
+    CHECK(f.GetSampleStatistics().peak == doctest::Approx(peak * 0.5));
+
+    f.TrimFrames(0, f.GetAudio().NumFrames() / 2);
+    CHECK(f.GetSampleStatistics().num_samples == f.GetAudio().NumFrames());
+
+    // They are worked out again while the writable audio could still be changed.
+    auto &audio = f.GetWritableAudio();
+    REQUIRE(f.GetDetectedPitch());
+    CHECK(*f.GetDetectedPitch() == doctest::Approx(440).epsilon(0.01));
+    audio.ChangePitch(-1200);
+    REQUIRE(f.GetDetectedPitch());
+    CHECK(*f.GetDetectedPitch() == doctest::Approx(220).epsilon(0.01));
+}
+
+TEST_CASE("Analyses are looked up in the analysis index") {
+    const auto audio = TestHelpers::CreateSineWaveAtFrequency(1, 44100, 1, 220);
+    AnalysisIndex index {"detect-pitch-analysis-index-test"};
+    AudioAnalysis analysis {};
+    analysis.detected_pitch = 1000.0;
+    index.Update(HashAudioContent(audio), analysis);
+    SetAnalysisIndex(&index);
+
+    EditTrackedAudioFile f("file.wav");
+    f.SetAudioData(audio);
+    REQUIRE(f.GetDetectedPitch());
+    CHECK(*f.GetDetectedPitch() == 1000.0);
+
+    // Once the audio has changed it is analysed, and the new analysis is added to the index.
+    f.GetWritableAudio().MultiplyByScalar(0.5);
+    REQUIRE(f.GetDetectedPitch());
+    CHECK(*f.GetDetectedPitch() == doctest::Approx(220).epsilon(0.01));
+    const auto found = index.Find(HashAudioContent(f.GetAudio()));
+    REQUIRE(found.detected_pitch);
+    CHECK(*found.detected_pitch == f.GetDetectedPitch());
+
+    SetAnalysisIndex(nullptr);
+    index.Delete();
+}
+
+TEST_CASE("Analyses of a file are kept after the file is loaded to analyse it") {
+    const fs::path path = "detect-pitch-loaded-file-test.wav";
+    REQUIRE(WriteAudioFile(path, TestHelpers::CreateSineWaveAtFrequency(1, 44100, 1, 220)));
+    AnalysisIndex index {"detect-pitch-loaded-file-test-index"};
+    SetAnalysisIndex(&index);
+
+    EditTrackedAudioFile f(path);
+    const auto pitch = f.GetDetectedPitch();
+    REQUIRE(pitch);
+    CHECK(*pitch == doctest::Approx(220).epsilon(0.01));
+
+    // If the analysis had been discarded, it would be looked up in the index again.
+    AudioAnalysis analysis {};
+    analysis.detected_pitch = 1000.0;
+    index.Update(HashAudioContent(f.GetAudio()), analysis);
+    CHECK(f.GetDetectedPitch() == pitch);
+
+    SetAnalysisIndex(nullptr);
+    index.Delete();
+    fs::remove(path);
+}
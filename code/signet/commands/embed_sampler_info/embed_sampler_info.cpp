@@ -226,7 +226,7 @@ void EmbedSamplerInfo::ProcessFiles(AudioFiles &files) {
             GetName(), {},
             "Remove command was specified, removing all sampler metadata from all given files");
         for (auto &f : files) {
-            auto &metadata = f.GetWritableAudio().metadata;
+            auto &metadata = f.GetWritableMetadata();
             metadata.midi_mapping = std::nullopt;
         }
         return;
@@ -234,7 +234,7 @@ void EmbedSamplerInfo::ProcessFiles(AudioFiles &files) {
 
     for (auto &f : files) {
         const auto filename = GetJustFilenameWithNoExtension(f.GetPath());
-        auto &metadata = f.GetWritableAudio().metadata;
+        auto &metadata = f.GetWritableMetadata();
         if (!metadata.midi_mapping) metadata.midi_mapping.emplace();
 
         if (!metadata.midi_mapping->sampler_mapping) {
@@ -271,7 +271,7 @@ void EmbedSamplerInfo::ProcessFiles(AudioFiles &files) {
             SetFromFilenameRegexMatch(m_root_regex_pattern.value(), metadata.midi_mapping->root_midi_note);
         } else if (m_root_auto_detect_name) {
             int midi_note = 60;
-            if (auto pitch = f.GetAudio().DetectPitch()) {
+            if (auto pitch = f.GetDetectedPitch()) {
                 midi_note = FindClosestMidiPitch(*pitch).midi_note;
             }
 
@@ -327,8 +327,8 @@ void EmbedSamplerInfo::ProcessFiles(AudioFiles &files) {
             });
 
             if (sorted_files.size() == 1) {
-                sorted_files[0]->GetWritableAudio().metadata.midi_mapping->sampler_mapping->low_note = 0;
-                sorted_files[0]->GetWritableAudio().metadata.midi_mapping->sampler_mapping->high_note = 127;
+                sorted_files[0]->GetWritableMetadata().midi_mapping->sampler_mapping->low_note = 0;
+                sorted_files[0]->GetWritableMetadata().midi_mapping->sampler_mapping->high_note = 127;
             } else {
                 struct MappingData {
                     int root;
@@ -346,8 +346,8 @@ void EmbedSamplerInfo::ProcessFiles(AudioFiles &files) {
 
                 auto MapFile = [&](EditTrackedAudioFile &f, MappingData prev, MappingData next) {
                     auto this_data = GetMappingData(f);
-                    f.GetWritableAudio().metadata.midi_mapping->sampler_mapping->low_note = prev.high + 1;
-                    f.GetWritableAudio().metadata.midi_mapping->sampler_mapping->high_note =
+                    f.GetWritableMetadata().midi_mapping->sampler_mapping->low_note = prev.high + 1;
+                    f.GetWritableMetadata().midi_mapping->sampler_mapping->high_note =
                         this_data.root + (next.root - this_data.root) / 2;
                 };
 
@@ -361,7 +361,7 @@ void EmbedSamplerInfo::ProcessFiles(AudioFiles &files) {
                                 GetMappingData(*sorted_files[i + 1]));
                     }
                 }
-                sorted_files.back()->GetWritableAudio().metadata.midi_mapping->sampler_mapping->high_note =
+                sorted_files.back()->GetWritableMetadata().midi_mapping->sampler_mapping->high_note =
                     127;
             }
         }
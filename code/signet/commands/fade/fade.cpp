@@ -98,28 +98,26 @@ void FadeCommand::PerformFade(AudioData &audio,
     }
 }
 
-void FadeCommand::ProcessFiles(AudioFiles &files) {
-    for (auto &f : files) {
-        auto &audio = f.GetWritableAudio();
-        if (m_fade_in_duration) {
-            const auto fade_in_frames =
-                std::min(audio.NumFrames() - 1,
-                         m_fade_in_duration->GetDurationAsFrames(audio.sample_rate, audio.NumFrames()));
-            PerformFade(audio, 0, (s64)fade_in_frames, m_fade_in_shape);
-
-            MessageWithNewLine(GetName(), f, "Fading in {} frames with a {} curve", fade_in_frames,
-                               magic_enum::enum_name(m_fade_in_shape));
-        }
-        if (m_fade_out_duration) {
-            const auto fade_out_frames =
-                m_fade_out_duration->GetDurationAsFrames(audio.sample_rate, audio.NumFrames());
-            const auto last = (s64)audio.NumFrames() - 1;
-            const auto start_frame = std::max<s64>(0, (s64)last - (s64)fade_out_frames);
-            PerformFade(audio, last, start_frame, m_fade_out_shape);
-
-            MessageWithNewLine(GetName(), f, "Fading out {} frames with a {} curve", fade_out_frames,
-                               magic_enum::enum_name(m_fade_out_shape));
-        }
+void FadeCommand::ProcessFile(EditTrackedAudioFile &f) {
+    auto &audio = f.GetWritableAudio();
+    if (m_fade_in_duration) {
+        const auto fade_in_frames =
+            std::min(audio.NumFrames() - 1,
+                     m_fade_in_duration->GetDurationAsFrames(audio.sample_rate, audio.NumFrames()));
+        PerformFade(audio, 0, (s64)fade_in_frames, m_fade_in_shape);
+
+        MessageWithNewLine(GetName(), f, "Fading in {} frames with a {} curve", fade_in_frames,
+                           magic_enum::enum_name(m_fade_in_shape));
+    }
+    if (m_fade_out_duration) {
+        const auto fade_out_frames =
+            m_fade_out_duration->GetDurationAsFrames(audio.sample_rate, audio.NumFrames());
+        const auto last = (s64)audio.NumFrames() - 1;
+        const auto start_frame = std::max<s64>(0, (s64)last - (s64)fade_out_frames);
+        PerformFade(audio, last, start_frame, m_fade_out_shape);
+
+        MessageWithNewLine(GetName(), f, "Fading out {} frames with a {} curve", fade_out_frames,
+                           magic_enum::enum_name(m_fade_out_shape));
     }
 }
 
@@ -10,7 +10,8 @@ class FadeCommand final : public Command {
 
     std::string GetName() const override { return "Fade"; }
     CLI::App *CreateCommandCLI(CLI::App &app) override;
-    void ProcessFiles(AudioFiles &files) override;
+    void ProcessFile(EditTrackedAudioFile &f) override;
+    bool ProcessesFilesIndependently() const override { return true; }
 
     static void PerformFade(AudioData &audio,
                             const s64 silent_frame,
@@ -6,27 +6,24 @@
 #include "common.h"
 #include "filter.h"
 
-void FilterProcessFiles(AudioFiles &files,
-                        const Filter::RBJType type,
-                        const double cutoff,
-                        const double Q,
-                        const double gain_db) {
-    for (auto &f : files) {
-        auto &audio = f.GetWritableAudio();
-
-        Filter::Params params;
-        Filter::Coeffs coeffs;
-        Filter::SetParamsAndCoeffs(Filter::Type::RBJ, params, coeffs, (int)type, (double)audio.sample_rate,
-                                   cutoff, Q, gain_db);
-
-        for (unsigned chan = 0; chan < audio.num_channels; ++chan) {
-            Filter::Data data {};
-            for (size_t frame = 0; frame < audio.NumFrames(); ++frame) {
-                auto &v = audio.GetSample(chan, frame);
-                v = Filter::Process(data, coeffs, v);
-            }
+void FilterProcessFile(EditTrackedAudioFile &f,
+                       const Filter::RBJType type,
+                       const double cutoff,
+                       const double Q,
+                       const double gain_db) {
+    auto &audio = f.GetWritableAudio();
+
+    Filter::Params params;
+    Filter::Coeffs coeffs;
+    Filter::SetParamsAndCoeffs(Filter::Type::RBJ, params, coeffs, (int)type, (double)audio.sample_rate,
+                               cutoff, Q, gain_db);
+
+    audio.ProcessChannels([&](tcb::span<double> samples, unsigned) {
+        Filter::Data data {};
+        for (auto &v : samples) {
+            v = Filter::Process(data, coeffs, v);
         }
-    }
+    });
 }
 
 CLI::App *HighpassCommand::CreateCommandCLI(CLI::App &app) {
@@ -39,8 +36,8 @@ CLI::App *HighpassCommand::CreateCommandCLI(CLI::App &app) {
     return hp;
 }
 
-void HighpassCommand::ProcessFiles(AudioFiles &files) {
-    FilterProcessFiles(files, Filter::RBJType::HighPass, m_cutoff, Filter::default_q_factor, 0);
+void HighpassCommand::ProcessFile(EditTrackedAudioFile &f) {
+    FilterProcessFile(f, Filter::RBJType::HighPass, m_cutoff, Filter::default_q_factor, 0);
 }
 
 CLI::App *LowpassCommand::CreateCommandCLI(CLI::App &app) {
@@ -54,6 +51,6 @@ CLI::App *LowpassCommand::CreateCommandCLI(CLI::App &app) {
     return lp;
 }
 
-void LowpassCommand::ProcessFiles(AudioFiles &files) {
-    FilterProcessFiles(files, Filter::RBJType::LowPass, m_cutoff, Filter::default_q_factor, 0);
+void LowpassCommand::ProcessFile(EditTrackedAudioFile &f) {
+    FilterProcessFile(f, Filter::RBJType::LowPass, m_cutoff, Filter::default_q_factor, 0);
 }
@@ -3,16 +3,17 @@
 #include "filter.h"
 #include "command.h"
 
-void FilterProcessFiles(const tcb::span<EditTrackedAudioFile> files,
-                        Filter::RBJType type,
-                        double cutoff,
-                        double Q,
-                        double gain_db);
+void FilterProcessFile(EditTrackedAudioFile &f,
+                       Filter::RBJType type,
+                       double cutoff,
+                       double Q,
+                       double gain_db);
 
 class HighpassCommand final : public Command {
   public:
     CLI::App *CreateCommandCLI(CLI::App &app) override;
-    void ProcessFiles(AudioFiles &files) override;
+    void ProcessFile(EditTrackedAudioFile &f) override;
+    bool ProcessesFilesIndependently() const override { return true; }
     std::string GetName() const override { return "Highpass"; }
 
   private:
@@ -22,7 +23,8 @@ class HighpassCommand final : public Command {
 class LowpassCommand final : public Command {
   public:
     CLI::App *CreateCommandCLI(CLI::App &app) override;
-    void ProcessFiles(AudioFiles &files) override;
+    void ProcessFile(EditTrackedAudioFile &f) override;
+    bool ProcessesFilesIndependently() const override { return true; }
     std::string GetName() const override { return "Lowpass"; }
 
   private:
@@ -34,20 +34,22 @@ CLI::App *FixPitchDriftCommand::CreateCommandCLI(CLI::App &app) {
     return fix_pitch_drift;
 }
 
+void FixPitchDriftCommand::ProcessFile(EditTrackedAudioFile &f) {
+    PitchDriftCorrector pitch_drift_corrector(f.GetAudio(), GetName(), f.OriginalPath(),
+                                              m_chunk_length_milliseconds, m_print_csv);
+    if (pitch_drift_corrector.CanFileBePitchCorrected()) {
+        MessageWithNewLine(GetName(), f, "Correcting pitch-drift");
+
+        if (pitch_drift_corrector.ProcessFile(f.GetWritableAudio(),
+                                              m_expected_midi_pitch.GetExpectedMidiPitch(GetName(), f))) {
+            MessageWithNewLine(GetName(), f, "Successfully pitch-drift corrected");
+        }
+    }
+}
+
 void FixPitchDriftCommand::ProcessFiles(AudioFiles &files) {
     if (!m_identical_processing_set.ShouldProcessInSets()) {
-        for (auto &f : files) {
-            PitchDriftCorrector pitch_drift_corrector(f.GetAudio(), GetName(), f.OriginalPath(),
-                                                      m_chunk_length_milliseconds, m_print_csv);
-            if (pitch_drift_corrector.CanFileBePitchCorrected()) {
-                MessageWithNewLine(GetName(), f, "Correcting pitch-drift");
-
-                if (pitch_drift_corrector.ProcessFile(
-                        f.GetWritableAudio(), m_expected_midi_pitch.GetExpectedMidiPitch(GetName(), f))) {
-                    MessageWithNewLine(GetName(), f, "Successfully pitch-drift corrected");
-                }
-            }
-        }
+        Command::ProcessFiles(files);
     } else {
         m_identical_processing_set.ProcessSets(
             files, GetName(),
@@ -10,6 +10,10 @@ class FixPitchDriftCommand final : public Command {
     std::string GetName() const override { return "FixPitchDrift"; }
     CLI::App *CreateCommandCLI(CLI::App &app) override;
     void ProcessFiles(AudioFiles &files) override;
+    void ProcessFile(EditTrackedAudioFile &f) override;
+    bool ProcessesFilesIndependently() const override {
+        return !m_identical_processing_set.ShouldProcessInSets();
+    }
 
   private:
     IdenticalProcessingSet m_identical_processing_set;
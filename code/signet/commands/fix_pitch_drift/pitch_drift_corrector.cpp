@@ -100,10 +100,11 @@ PitchDriftCorrector::PitchDriftCorrector(const AudioData &data,
 
 void PitchDriftCorrector::PrintChunkCSV() const {
     if (m_print_csv) {
-        fmt::print("detected-pitch,is-outlier,ignore-tuning,target-pitch,pitch-ratio\n");
+        WriteOutput("detected-pitch,is-outlier,ignore-tuning,target-pitch,pitch-ratio\n");
         for (const auto &c : m_chunks) {
-            fmt::print("{:7.2f},{},{},{:7.2f},{:.3f}\n", c.detected_pitch, (int)c.is_detected_pitch_outlier,
-                       (int)c.ignore_tuning, c.target_pitch, c.pitch_ratio_for_print);
+            WriteOutput(fmt::format("{:7.2f},{},{},{:7.2f},{:.3f}\n", c.detected_pitch,
+                                    (int)c.is_detected_pitch_outlier, (int)c.ignore_tuning, c.target_pitch,
+                                    c.pitch_ratio_for_print));
         }
     }
 }
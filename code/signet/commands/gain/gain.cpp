@@ -50,16 +50,14 @@ CLI::App *GainCommand::CreateCommandCLI(CLI::App &app) {
     return gain;
 }
 
-void GainCommand::ProcessFiles(AudioFiles &files) {
-    for (auto &f : files) {
-        auto &audio = f.GetWritableAudio();
-        if (audio.IsEmpty()) continue;
+void GainCommand::ProcessFile(EditTrackedAudioFile &f) {
+    auto &audio = f.GetWritableAudio();
+    if (audio.IsEmpty()) return;
 
-        const auto amp = m_gain.GetMultiplier();
-        MessageWithNewLine(GetName(), f, "Applying a gain of {:.2f}", amp);
-        for (auto &s : audio.interleaved_samples) {
-            s *= amp;
-        }
+    const auto amp = m_gain.GetMultiplier();
+    MessageWithNewLine(GetName(), f, "Applying a gain of {:.2f}", amp);
+    for (auto &s : audio.interleaved_samples) {
+        s *= amp;
     }
 }
 
@@ -70,27 +70,32 @@ void NormaliseCommand::ProcessFiles(AudioFiles &files) {
     bool normalising_independently = false;
     if (files.Size() > 1 && !m_normalise_independently) {
         for (auto &f : files) {
-            if (!gain_calculator->RegisterBufferMagnitudes(f.GetAudio(), {})) {
+            if (!gain_calculator->RegisterChannelStatistics(f.GetChannelStatistics(), {})) {
                 ErrorWithNewLine(
                     GetName(), {},
                     "Unable to perform normalisation because the common gain was not successfully found");
                 return;
             }
+            f.PackAudio();
         }
     } else {
         normalising_independently = true;
     }
 
-    const auto GetGain = [&](AudioData &audio, EditTrackedAudioFile const &f) {
+    const auto GetGain = [&](tcb::span<const SampleStatistics> channel_stats, EditTrackedAudioFile const &f) {
         if (normalising_independently) {
             gain_calculator->Reset();
-            gain_calculator->RegisterBufferMagnitudes(audio, {});
+            gain_calculator->RegisterChannelStatistics(channel_stats, {});
         }
         auto gain =
             ScaleMultiplier(gain_calculator->GetGain(DBToAmp(m_target_decibels)), m_norm_mix_percent / 100.0);
         if (m_crest_factor_scaling) {
-            auto const rms = GetRMS(audio.interleaved_samples);
-            auto const peak = GetPeak(audio.interleaved_samples);
+            SampleStatistics stats {};
+            for (const auto &channel : channel_stats) {
+                stats.Combine(channel);
+            }
+            auto const rms = stats.RMS();
+            auto const peak = stats.peak;
 
             constexpr auto k_max_crest_factor = 200.0;
             constexpr auto k_max_reduction_db = -12.0;
@@ -120,9 +125,12 @@ void NormaliseCommand::ProcessFiles(AudioFiles &files) {
     };
 
     for (auto &f : files) {
+        // The statistics are likely to be known already, but they are forgotten when the audio is changed.
+        const auto stats_span = f.GetChannelStatistics();
+        const std::vector<SampleStatistics> channel_stats(stats_span.begin(), stats_span.end());
         auto &audio = f.GetWritableAudio();
         if (!m_normalise_channels_separately) {
-            const auto gain = GetGain(audio, f);
+            const auto gain = GetGain(channel_stats, f);
             MessageWithNewLine(GetName(), f, "Applying a gain of {:.2f}", gain);
             audio.MultiplyByScalar(gain);
         } else {
@@ -130,21 +138,24 @@ void NormaliseCommand::ProcessFiles(AudioFiles &files) {
             std::vector<double> channel_peaks;
             for (unsigned chan = 0; chan < audio.num_channels; ++chan) {
                 channels_gain_calculator->Reset();
-                channels_gain_calculator->RegisterBufferMagnitudes(audio, chan);
+                channels_gain_calculator->RegisterChannelStatistics(channel_stats, chan);
                 channel_peaks.push_back(channels_gain_calculator->GetLargestRegisteredMagnitude());
             }
             const auto max_channel_gain = *std::max_element(channel_peaks.begin(), channel_peaks.end());
 
-            const auto gain = GetGain(audio, f);
+            const auto gain = GetGain(channel_stats, f);
 
+            std::vector<double> channel_gains;
             for (unsigned chan = 0; chan < audio.num_channels; ++chan) {
                 auto channel_gain = gain * ScaleMultiplier(max_channel_gain / channel_peaks[chan],
                                                            m_norm_channel_mix_percent / 100.0);
                 MessageWithNewLine(GetName(), f, "Applying a gain of {:.2f} to channel {}", channel_gain,
                                    chan);
-                audio.MultiplyByScalar(chan, channel_gain);
+                channel_gains.push_back(channel_gain);
             }
+            audio.MultiplyByScalars(channel_gains);
         }
+        f.PackAudio();
     }
 }
 
@@ -48,18 +48,16 @@ inline void SetEqualPan(double pan_pos, double &out_left, double &out_right) {
     out_right *= right;
 }
 
-void PanCommand::ProcessFiles(AudioFiles &files) {
-    for (auto &f : files) {
-        auto &audio = f.GetWritableAudio();
-        if (audio.IsEmpty()) continue;
-        if (audio.num_channels != 2) {
-            MessageWithNewLine(GetName(), f, "Skipping non-stereo file");
-            continue;
-        }
-
-        for (size_t frame = 0; frame < audio.NumFrames(); ++frame) {
-            SetEqualPan(m_pan, audio.GetSample(0, frame), audio.GetSample(1, frame));
-        }
+void PanCommand::ProcessFile(EditTrackedAudioFile &f) {
+    auto &audio = f.GetWritableAudio();
+    if (audio.IsEmpty()) return;
+    if (audio.num_channels != 2) {
+        MessageWithNewLine(GetName(), f, "Skipping non-stereo file");
+        return;
+    }
+
+    for (size_t frame = 0; frame < audio.NumFrames(); ++frame) {
+        SetEqualPan(m_pan, audio.GetSample(0, frame), audio.GetSample(1, frame));
     }
 }
 
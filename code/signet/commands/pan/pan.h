@@ -13,7 +13,8 @@ struct PanUnit {
 class PanCommand final : public Command {
   public:
     CLI::App *CreateCommandCLI(CLI::App &app) override;
-    void ProcessFiles(AudioFiles &files) override;
+    void ProcessFile(EditTrackedAudioFile &f) override;
+    bool ProcessesFilesIndependently() const override { return true; }
     std::string GetName() const override { return "Pan"; }
 
   private:
@@ -5,6 +5,7 @@
 class PrintInfoCommand : public Command {
   public:
     CLI::App *CreateCommandCLI(CLI::App &app) override;
-    void ProcessFiles(AudioFiles &files) override;
+    void ProcessFile(EditTrackedAudioFile &f) override;
+    bool ProcessesFilesIndependently() const override { return true; }
     std::string GetName() const override { return "PrintInfo"; }
 };
\ No newline at end of file
@@ -37,40 +37,14 @@ std::pair<usize, usize> RemoveSilenceCommand::GetLoudRegion(EditTrackedAudioFile
     auto &audio = f.GetAudio();
     usize loud_region_start = 0;
     usize loud_region_end = audio.NumFrames();
-    const auto amp_threshold = DBToAmp(m_silence_threshold_db);
+    const auto bounds = f.GetSilenceBounds(DBToAmp(m_silence_threshold_db));
 
     if (m_region == Region::Start || m_region == Region::Both) {
-        for (usize frame = 0; frame < audio.NumFrames(); ++frame) {
-            bool is_silent = true;
-            for (unsigned channel = 0; channel < audio.num_channels; ++channel) {
-                if (std::abs(audio.GetSample(channel, frame)) > amp_threshold) {
-                    is_silent = false;
-                    break;
-                }
-            }
-
-            if (!is_silent) {
-                loud_region_start = frame;
-                break;
-            }
-        }
+        if (bounds.first_loud_frame != audio.NumFrames()) loud_region_start = bounds.first_loud_frame;
     }
 
     if (m_region == Region::End || m_region == Region::Both) {
-        for (usize frame = audio.NumFrames(); frame-- > 0;) {
-            bool is_silent = true;
-            for (unsigned channel = 0; channel < audio.num_channels; ++channel) {
-                if (std::abs(audio.GetSample(channel, frame)) > amp_threshold) {
-                    is_silent = false;
-                    break;
-                }
-            }
-
-            if (!is_silent) {
-                loud_region_end = frame + 1;
-                break;
-            }
-        }
+        if (bounds.end_loud_frame) loud_region_end = bounds.end_loud_frame;
     }
 
     // Allow there to be a few silent samples before we start chopping. Particularly at the start of a
@@ -85,9 +59,9 @@ std::pair<usize, usize> RemoveSilenceCommand::GetLoudRegion(EditTrackedAudioFile
     return {loud_region_start, loud_region_end};
 }
 
-void RemoveSilenceCommand::ProcessFile(EditTrackedAudioFile &f,
-                                       usize loud_region_start,
-                                       usize loud_region_end) const {
+void RemoveSilenceCommand::RemoveSilenceFromFile(EditTrackedAudioFile &f,
+                                                 usize loud_region_start,
+                                                 usize loud_region_end) const {
     auto &audio = f.GetAudio();
     if (loud_region_start >= loud_region_end) {
         MessageWithNewLine(GetName(), f, "The whole sample is silence - no change will be made");
@@ -108,30 +82,19 @@ void RemoveSilenceCommand::ProcessFile(EditTrackedAudioFile &f,
                            audio.NumFrames() - loud_region_end);
     }
 
-    if (m_region == Region::End || m_region == Region::Both) {
-        const auto new_size = loud_region_end * audio.num_channels;
-        if (audio.interleaved_samples.size() != new_size) {
-            f.GetWritableAudio().interleaved_samples.resize(new_size);
-            f.GetWritableAudio().FramesWereRemovedFromEnd();
-        }
-    }
-    if (m_region == Region::Start || m_region == Region::Both) {
-        const auto num_samples = loud_region_start * audio.num_channels;
-        if (num_samples) {
-            auto &out_audio = f.GetWritableAudio();
-            out_audio.interleaved_samples.erase(out_audio.interleaved_samples.begin(),
-                                                out_audio.interleaved_samples.begin() + num_samples);
-            out_audio.FramesWereRemovedFromStart(loud_region_start);
-        }
-    }
+    const auto trim_start = m_region == Region::Start || m_region == Region::Both;
+    const auto trim_end = m_region == Region::End || m_region == Region::Both;
+    f.TrimFrames(trim_start ? loud_region_start : 0, trim_end ? audio.NumFrames() - loud_region_end : 0);
+}
+
+void RemoveSilenceCommand::ProcessFile(EditTrackedAudioFile &f) {
+    const auto [loud_region_start, loud_region_end] = GetLoudRegion(f);
+    RemoveSilenceFromFile(f, loud_region_start, loud_region_end);
 }
 
 void RemoveSilenceCommand::ProcessFiles(AudioFiles &files) {
     if (!m_identical_processing_set.ShouldProcessInSets()) {
-        for (auto &f : files) {
-            const auto [loud_region_start, loud_region_end] = GetLoudRegion(f);
-            ProcessFile(f, loud_region_start, loud_region_end);
-        }
+        Command::ProcessFiles(files);
     } else {
         m_identical_processing_set.ProcessSets(
             files, GetName(),
@@ -145,7 +108,7 @@ void RemoveSilenceCommand::ProcessFiles(AudioFiles &files) {
 
                 const auto [loud_region_start, loud_region_end] = GetLoudRegion(*authority_file);
                 for (auto f : set) {
-                    ProcessFile(*f, loud_region_start, loud_region_end);
+                    RemoveSilenceFromFile(*f, loud_region_start, loud_region_end);
                 }
             });
     }
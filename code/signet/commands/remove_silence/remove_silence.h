@@ -7,11 +7,16 @@ class RemoveSilenceCommand final : public Command {
   public:
     CLI::App *CreateCommandCLI(CLI::App &app) override;
     void ProcessFiles(AudioFiles &files) override;
+    void ProcessFile(EditTrackedAudioFile &f) override;
+    bool ProcessesFilesIndependently() const override {
+        return !m_identical_processing_set.ShouldProcessInSets();
+    }
     std::string GetName() const override { return "RemoveSilence"; }
 
   private:
     std::pair<usize, usize> GetLoudRegion(EditTrackedAudioFile &f) const;
-    void ProcessFile(EditTrackedAudioFile &f, usize loud_region_start, usize loud_region_end) const;
+    void
+    RemoveSilenceFromFile(EditTrackedAudioFile &f, usize loud_region_start, usize loud_region_end) const;
 
     IdenticalProcessingSet m_identical_processing_set;
     enum class Region { Start, End, Both };
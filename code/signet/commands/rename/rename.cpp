@@ -110,7 +110,7 @@ void RenameCommand::ProcessFiles(AudioFiles &files) {
                     Contains(filename, "<detected-midi-note-octave-minus-1>") ||
                     Contains(filename, "<detected-midi-note-octave-minus-2>") ||
                     Contains(filename, "<detected-midi-note-octave-nearest-to-middle-c>")) {
-                    if (const auto pitch = f->GetAudio().DetectPitch()) {
+                    if (const auto pitch = f->GetDetectedPitch()) {
                         const auto closest_musical_note = FindClosestMidiPitch(*pitch);
 
                         Replace(filename, "<detected-pitch>",
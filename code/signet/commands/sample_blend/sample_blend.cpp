@@ -71,14 +71,12 @@ void SampleBlendCommand::GenerateSamplesByBlending(SignetBackup &backup,
 
         constexpr double cents_in_semitone = 100;
 
-        AudioData out = f1.file->GetAudio();
         const auto pitch_change1 = (root_note - f1.root_note) * cents_in_semitone;
-        out.ChangePitch(pitch_change1);
+        auto out = f1.file->GetAudio().WithPitchChanged(pitch_change1);
         out.MultiplyByScalar(distance_from_f1);
 
-        AudioData other = f2.file->GetAudio();
         const auto pitch_change2 = (root_note - f2.root_note) * cents_in_semitone;
-        other.ChangePitch(pitch_change2);
+        auto other = f2.file->GetAudio().WithPitchChanged(pitch_change2);
         other.MultiplyByScalar(distance_from_f2);
 
         if (m_make_same_length) {
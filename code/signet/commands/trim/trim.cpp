@@ -25,52 +25,42 @@ CLI::App *TrimCommand::CreateCommandCLI(CLI::App &app) {
     return trim;
 }
 
-void TrimCommand::ProcessFiles(AudioFiles &files) {
-    for (auto &f : files) {
-        auto &audio = f.GetAudio();
-        if (audio.IsEmpty()) continue;
-
-        usize remaining_region_start = 0, remaining_region_end = audio.NumFrames();
-        if (m_start_duration) {
-            const auto start_size =
-                m_start_duration->GetDurationAsFrames(audio.sample_rate, audio.NumFrames());
-            remaining_region_start = start_size;
-        }
-        if (m_end_duration) {
-            const auto end_size = m_end_duration->GetDurationAsFrames(audio.sample_rate, audio.NumFrames());
-            remaining_region_end = audio.NumFrames() - end_size;
-        }
-
-        if (remaining_region_start >= remaining_region_end) {
-            WarningWithNewLine(
-                GetName(), f,
-                "The trim region would result in the whole sample being removed - no change will be made");
-            continue;
-        }
+void TrimCommand::ProcessFile(EditTrackedAudioFile &f) {
+    // Only the file's length is needed, so the samples don't have to be loaded or unpacked. A FLAC stream
+    // doesn't have to state its length in its headers though.
+    auto num_frames = (usize)f.GetInfo().num_frames;
+    if (!num_frames && !f.GetAudio().IsEmpty()) num_frames = f.GetAudio().NumFrames();
+    const auto sample_rate = f.GetInfo().sample_rate;
+    if (num_frames == 0) return;
+
+    usize remaining_region_start = 0, remaining_region_end = num_frames;
+    if (m_start_duration) {
+        const auto start_size = m_start_duration->GetDurationAsFrames(sample_rate, num_frames);
+        remaining_region_start = start_size;
+    }
+    if (m_end_duration) {
+        const auto end_size = m_end_duration->GetDurationAsFrames(sample_rate, num_frames);
+        remaining_region_end = num_frames - end_size;
+    }
 
-        if (m_start_duration && m_end_duration) {
-            MessageWithNewLine(GetName(), f, "Trimming {} frames from the start and {} frames from the end",
-                               remaining_region_start, audio.NumFrames() - remaining_region_end);
-        } else if (m_start_duration) {
-            MessageWithNewLine(GetName(), f, "Trimming {} frames from the start", remaining_region_start);
-        } else {
-            MessageWithNewLine(GetName(), f, "Trimming {} frames from the end",
-                               audio.NumFrames() - remaining_region_end);
-        }
+    if (remaining_region_start >= remaining_region_end) {
+        WarningWithNewLine(
+            GetName(), f,
+            "The trim region would result in the whole sample being removed - no change will be made");
+        return;
+    }
 
-        if (m_end_duration && remaining_region_end != audio.NumFrames()) {
-            auto &out_audio = f.GetWritableAudio();
-            out_audio.interleaved_samples.resize(remaining_region_end * out_audio.num_channels);
-            out_audio.FramesWereRemovedFromEnd();
-        }
-        if (m_start_duration && remaining_region_start != 0) {
-            auto &out_audio = f.GetWritableAudio();
-            out_audio.interleaved_samples.erase(out_audio.interleaved_samples.begin(),
-                                                out_audio.interleaved_samples.begin() +
-                                                    remaining_region_start * out_audio.num_channels);
-            out_audio.FramesWereRemovedFromStart(remaining_region_start);
-        }
+    if (m_start_duration && m_end_duration) {
+        MessageWithNewLine(GetName(), f, "Trimming {} frames from the start and {} frames from the end",
+                           remaining_region_start, num_frames - remaining_region_end);
+    } else if (m_start_duration) {
+        MessageWithNewLine(GetName(), f, "Trimming {} frames from the start", remaining_region_start);
+    } else {
+        MessageWithNewLine(GetName(), f, "Trimming {} frames from the end",
+                           num_frames - remaining_region_end);
     }
+
+    f.TrimFrames(remaining_region_start, num_frames - remaining_region_end);
 }
 
 TEST_CASE("[TrimCommand]") {
@@ -206,3 +196,38 @@ TEST_CASE("[TrimCommand]") {
         }
     }
 }
+
+TEST_CASE("Trimming frames is deferred until the audio is needed") {
+    AudioData buf;
+    buf.num_channels = 2;
+    buf.sample_rate = 44100;
+    buf.bits_per_sample = 16;
+    for (int i = 0; i < 10; ++i) {
+        buf.interleaved_samples.push_back(i / 32768.0);
+        buf.interleaved_samples.push_back(-i / 32768.0);
+    }
+    buf.metadata.markers.push_back({"marker1", 4});
+
+    for (const auto precision : {SamplePrecision::F64, SamplePrecision::Native}) {
+        SetSampleStoragePrecision(precision);
+
+        EditTrackedAudioFile f("file.wav");
+        f.SetAudioData(buf);
+        f.PackAudio();
+
+        f.TrimFrames(1, 2);
+        CHECK(f.GetInfo().num_frames == 7);
+        f.TrimFrames(2, 1);
+        CHECK(f.GetInfo().num_frames == 4);
+        CHECK(f.GetInfo().metadata.markers.at(0).start_frame == 1);
+        CHECK(f.AudioChanged());
+
+        const auto &audio = f.GetAudio();
+        REQUIRE(audio.NumFrames() == 4);
+        CHECK(audio.GetSample(0, 0) == 3 / 32768.0);
+        CHECK(audio.GetSample(1, 3) == -6 / 32768.0);
+        CHECK(audio.metadata.markers.at(0).start_frame == 1);
+    }
+
+    SetSampleStoragePrecision(SamplePrecision::F64);
+}
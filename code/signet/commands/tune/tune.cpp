@@ -19,11 +19,9 @@ CLI::App *TuneCommand::CreateCommandCLI(CLI::App &app) {
     return tune;
 }
 
-void TuneCommand::ProcessFiles(AudioFiles &files) {
-    for (auto &f : files) {
-        MessageWithNewLine(GetName(), f, "Tuning sample by {} cents", m_tune_cents);
-        f.GetWritableAudio().ChangePitch(m_tune_cents);
-    }
+void TuneCommand::ProcessFile(EditTrackedAudioFile &f) {
+    MessageWithNewLine(GetName(), f, "Tuning sample by {} cents", m_tune_cents);
+    f.GetWritableAudio().ChangePitch(m_tune_cents);
 }
 
 TEST_CASE("TuneCommand") {
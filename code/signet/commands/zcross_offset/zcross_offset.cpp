@@ -1,5 +1,7 @@
 #include "zcross_offset.h"
 
+#include <algorithm>
+
 #include "doctest.hpp"
 
 #include "test_helpers.h"
@@ -39,18 +41,15 @@ bool ZeroCrossOffsetCommand::CreateSampleOffsetToNearestZCross(AudioData &audio,
     MessageWithNewLine(GetNameInternal(), {}, "Found best approx zero-crossing frame at position {}",
                        new_start_frame);
 
-    auto interleaved_samples_new_start_it =
-        audio.interleaved_samples.begin() + new_start_frame * audio.num_channels;
-    std::vector<double> new_interleaved_samples {interleaved_samples_new_start_it,
-                                                 audio.interleaved_samples.end()};
-
+    // Done in place, so the buffer is not copied.
+    auto &samples = audio.interleaved_samples;
+    const auto new_start_it = samples.begin() + new_start_frame * audio.num_channels;
     if (append_skipped_frames_on_end) {
-        new_interleaved_samples.insert(new_interleaved_samples.end(), audio.interleaved_samples.begin(),
-                                       interleaved_samples_new_start_it);
-        REQUIRE(new_interleaved_samples.size() == audio.interleaved_samples.size());
+        std::rotate(samples.begin(), new_start_it, samples.end());
+    } else {
+        samples.erase(samples.begin(), new_start_it);
     }
 
-    audio.interleaved_samples = new_interleaved_samples;
     if (new_start_frame) {
         audio.FramesWereRemovedFromStart(new_start_frame);
     }
@@ -21,14 +21,12 @@ class ZeroCrossOffsetCommand final : public Command {
                                                   const AudioDuration &search_size,
                                                   const bool append_skipped_frames_on_end);
 
-    void ProcessFiles(AudioFiles &files) override {
-        for (auto &f : files) {
-            auto &audio = f.GetAudio();
-            if (audio.IsEmpty()) continue;
-            CreateSampleOffsetToNearestZCross(f.GetWritableAudio(), m_search_size,
-                                              m_append_skipped_frames_on_end);
-        }
+    void ProcessFile(EditTrackedAudioFile &f) override {
+        auto &audio = f.GetAudio();
+        if (audio.IsEmpty()) return;
+        CreateSampleOffsetToNearestZCross(f.GetWritableAudio(), m_search_size, m_append_skipped_frames_on_end);
     }
+    bool ProcessesFilesIndependently() const override { return true; }
     std::string GetName() const override { return GetNameInternal(); }
     static std::string GetNameInternal() { return "ZeroCrossOffset"; }
 
@@ -1,8 +1,12 @@
 #include "signet_interface.h"
 
+#include <atomic>
+#include <exception>
 #include <functional>
+#include <set>
 
 #include "doctest.hpp"
+#include "magic_enum.hpp"
 
 #include "audio_file_io.h"
 #include "cli_formatter.h"
@@ -26,8 +30,10 @@
 #include "commands/trim/trim.h"
 #include "commands/tune/tune.h"
 #include "commands/zcross_offset/zcross_offset.h"
+#include "packed_samples.h"
 #include "test_helpers.h"
 #include "tests_config.h"
+#include "thread_pool.h"
 #include "version.h"
 
 SignetInterface::SignetInterface() {
@@ -54,7 +60,187 @@ SignetInterface::SignetInterface() {
     m_commands.push_back(std::make_unique<ZeroCrossOffsetCommand>());
 }
 
+// Applies each of the commands to the file in turn. num_audio_edits counts the files that each command
+// changed.
+static void ProcessFileWithStreamedCommands(EditTrackedAudioFile &f,
+                                            const std::vector<Command *> &commands,
+                                            std::vector<std::atomic<int>> &num_audio_edits) {
+    for (usize command_index = 0; command_index < commands.size(); ++command_index) {
+        const auto initial_num_audio_edits = f.NumTimesAudioChanged();
+        commands[command_index]->ProcessFile(f);
+        f.CommandFinished();
+        if (f.NumTimesAudioChanged() != initial_num_audio_edits) ++num_audio_edits[command_index];
+    }
+}
+
+bool SignetInterface::ProcessAndWriteFilesOneAtATime() {
+    // None of the streamed commands change the filepath, so the final paths can be set and checked for
+    // conflicts before any file is written.
+    if (m_output_path) {
+        for (auto &f : m_input_audio_files) {
+            auto new_path = *m_output_path / f.GetPath().filename();
+            f.SetPath(new_path);
+        }
+    } else if (m_single_output_file) {
+        REQUIRE(m_input_audio_files.Size() == 1);
+        m_input_audio_files.begin()[0].SetPath(*m_single_output_file);
+    }
+    if (m_input_audio_files.WouldWritingAllFilesCreateConflicts()) {
+        return false;
+    }
+
+    MessageWithNewLine("Signet", {}, "Processing {} files one at a time", m_input_audio_files.Size());
+
+    // When there are multiple jobs, a batch of files is processed in parallel and then the batch is written
+    // in order. If a file fails to process, the files before it in the batch are still written, just as they
+    // would have been if there was only 1 job.
+    const bool create_copies = m_output_path || m_single_output_file;
+    const usize batch_size = GetNumParallelJobs();
+    std::vector<std::atomic<int>> num_audio_edits(m_streamed_commands.size());
+    for (usize batch_begin = 0; batch_begin < m_input_audio_files.Size(); batch_begin += batch_size) {
+        const auto batch_end = std::min(batch_begin + batch_size, m_input_audio_files.Size());
+
+        std::vector<u8> file_processed(batch_end - batch_begin, false);
+        std::exception_ptr processing_error {};
+        try {
+            ParallelFor(batch_end - batch_begin, [&](usize i) {
+                ProcessFileWithStreamedCommands(m_input_audio_files[batch_begin + i], m_streamed_commands,
+                                                num_audio_edits);
+                file_processed[i] = true;
+            });
+        } catch (...) {
+            processing_error = std::current_exception();
+        }
+
+        for (usize i = batch_begin; i < batch_end && file_processed[i - batch_begin]; ++i) {
+            auto &f = m_input_audio_files[i];
+            const bool needs_writing = f.AudioChanged() || f.PathChanged() || f.FormatChanged();
+            if (!AudioFiles::WriteFileIfEdited(f, m_backup, create_copies)) {
+                ErrorWithNewLine(
+                    "Signet", f,
+                    "An error happened while backing-up or writing an audio files. Signet has stopped. Run 'signet undo' to undo any changes that happened up to the point of this error");
+                if (m_incremental_manifest) m_incremental_manifest->Save();
+                return false;
+            }
+            if (needs_writing) ++m_num_streamed_files_written;
+            if (m_incremental_manifest) {
+                m_incremental_manifest->FileWasProcessed(f.OriginalPath(), AudioFiles::GetWrittenPath(f));
+            }
+            f.ReleaseAudio();
+        }
+
+        if (processing_error) {
+            // The files that have been written are still recorded, since they would not be processed in
+            // the same way again.
+            if (m_incremental_manifest) m_incremental_manifest->Save();
+            std::rethrow_exception(processing_error);
+        }
+    }
+
+    for (usize i = 0; i < m_streamed_commands.size(); ++i) {
+        MessageWithNewLine(m_streamed_commands[i]->GetName(), {}, "Total audio files edited: {}",
+                           num_audio_edits[i].load());
+    }
+    return true;
+}
+
+// The options that do not change the files that are written, so they are not part of the command chain that
+// --incremental compares. The output paths are added separately, as absolute paths.
+static const std::set<std::string> k_options_not_in_command_chain = {
+    "input-files", "--output-folder", "--output-file", "--incremental", "--jobs", "--streaming",
+    "--silent", "--json-output", "--recursive", "--warnings-are-errors", "--no-analysis-index",
+    "--rebuild-analysis-index"};
+
+// Appends the options and commands that were given to chain in a canonical form: the options are in the
+// order they are defined in, whatever order they were given in, and only their values are used, not how
+// they were written.
+static void AppendCommandChain(const CLI::App &app, std::string &chain) {
+    for (const auto *option : app.get_options()) {
+        if (!option->count() || k_options_not_in_command_chain.count(option->get_name())) continue;
+        chain += option->get_name();
+        for (const auto &value : option->results()) {
+            chain += fmt::format(" \"{}\"", value);
+        }
+        chain += '\n';
+    }
+    for (const auto *subcommand : app.get_subcommands()) {
+        chain += subcommand->get_name() + " {\n";
+        AppendCommandChain(*subcommand, chain);
+        chain += "}\n";
+    }
+}
+
+void SignetInterface::SkipFilesThatAreUpToDate(const CLI::App &app,
+                                               const std::map<const CLI::App *, Command *> &commands) {
+    for (const auto *subcommand : app.get_subcommands()) {
+        const auto command = commands.find(subcommand);
+        // Utility subcommands such as undo do not process the input files.
+        if (command == commands.end()) return;
+        if (!command->second->ProcessesFilesIndependently()) {
+            throw CLI::ValidationError(
+                command->second->GetName(),
+                "This command cannot be used with --incremental because it needs to consider all of the files together");
+        }
+    }
+
+    std::string chain = fmt::format("signet {}\n", SIGNET_VERSION);
+    AppendCommandChain(app, chain);
+    if (m_output_path) {
+        chain += fmt::format("--output-folder \"{}\"\n", fs::absolute(*m_output_path).generic_string());
+    }
+    if (m_single_output_file) {
+        chain += fmt::format("--output-file \"{}\"\n", fs::absolute(*m_single_output_file).generic_string());
+    }
+    m_incremental_manifest.emplace(*m_incremental_manifest_path, chain);
+
+    std::vector<EditTrackedAudioFile> files_to_process;
+    for (auto &f : m_input_audio_files) {
+        if (m_incremental_manifest->IsUpToDate(f.OriginalPath())) {
+            ++m_num_files_up_to_date;
+        } else {
+            files_to_process.push_back(std::move(f));
+        }
+    }
+    MessageWithNewLine("Signet", {}, "Skipping {} files that are up-to-date", m_num_files_up_to_date);
+    m_input_audio_files = AudioFiles(std::move(files_to_process));
+}
+
 int SignetInterface::Main(const int argc, const char *const argv[]) {
+    m_streaming = false;
+    m_streamed_commands.clear();
+    m_num_streamed_files_written = 0;
+    m_incremental_manifest_path.reset();
+    m_incremental_manifest.reset();
+    m_num_files_up_to_date = 0;
+    SetNumParallelJobs(1);
+    SetSampleStoragePrecision(SamplePrecision::F64);
+    SetLogFormat(LogFormat::Text);
+
+    // Messages are printed by a separate thread, make sure they have all been printed before returning.
+    struct FlushLogOnReturn {
+        ~FlushLogOnReturn() { FlushLog(); }
+    } flush_log_on_return;
+
+    // The backup's journal of the changes that were made in this run is only needed until the run is over.
+    // If it cannot be merged into the database it is kept, and it is read back in on the next run. The
+    // warning is logged directly because WarningWithNewLine can throw, which a destructor must not do.
+    struct CompactBackupJournalOnReturn {
+        ~CompactBackupJournalOnReturn() {
+            if (!backup.CompactJournal()) {
+                Log({LogLevel::Warning, "Signet", {},
+                     "Could not merge the backup journal into the backup database, it will be tried again on "
+                     "the next run"});
+            }
+        }
+        SignetBackup &backup;
+    } compact_backup_journal_on_return {m_backup};
+
+    m_analysis_index.emplace(GetTempDir() / "signet-analysis-index");
+    SetAnalysisIndex(&*m_analysis_index);
+    struct ClearAnalysisIndexOnReturn {
+        ~ClearAnalysisIndexOnReturn() { SetAnalysisIndex(nullptr); }
+    } clear_analysis_index_on_return;
+
     CLI::App app {
         R"^^(Signet is a command-line program designed for bulk editing audio files. It has commands for converting, editing, renaming and moving WAV and FLAC files. It also features commands that generate audio files. Signet was primarily designed for people who make sample libraries, but its features can be useful for any type of bulk audio processing.)^^"};
 
@@ -80,6 +266,7 @@ int SignetInterface::Main(const int argc, const char *const argv[]) {
     app.add_flag_callback(
         "--version",
         [&]() {
+            FlushLog();
             fmt::print("Signet version {}", SIGNET_VERSION);
 #ifdef SIGNET_DEBUG
             fmt::print(" (debug)");
@@ -212,6 +399,7 @@ int SignetInterface::Main(const int argc, const char *const argv[]) {
         ->final_callback([&]() {
             MessageWithNewLine("Signet", {}, "Clearing all backed-up files...");
             m_backup.ClearBackup();
+            m_analysis_index->Delete();
             MessageWithNewLine("Signet", {}, "Done.");
             success_thrown = true;
             throw CLI::Success();
@@ -219,13 +407,46 @@ int SignetInterface::Main(const int argc, const char *const argv[]) {
 
     app.add_flag_callback("--silent", []() { g_messages_enabled = false; }, "Disable all messages");
 
+    app.add_flag_callback(
+        "--json-output", []() { SetLogFormat(LogFormat::JsonLines); },
+        "Print all messages, warnings and errors as JSON-lines rather than as coloured text. Each line is a JSON object with the fields \"level\", \"text\", and where relevant, \"heading\" and \"file\". This is useful when Signet's output is to be read by another program.");
+
     app.add_flag_callback(
         "--warnings-are-errors", []() { g_warnings_as_errors = true; },
         "Attempt to exit Signet and return a non-zero value as soon as possible if a warning occurs.");
 
+    app.add_flag_callback(
+        "--no-analysis-index", []() { SetAnalysisIndex(nullptr); },
+        "Do not use the analysis index. Signet keeps an index of analyses of audio that it has done, such as pitch detection, in your OS's temporary folder. When audio is given to Signet that has the same content as audio that it has seen before, the analyses are taken from the index rather than worked out again. With this flag, everything is analysed from scratch and the index is not changed.");
+
+    app.add_flag_callback(
+        "--rebuild-analysis-index", [&]() { m_analysis_index->Rebuild(); },
+        "Ignore the analyses that are in the analysis index, and replace them with the ones from this run.");
+
     app.add_flag("--recursive", m_recursive_directory_search,
                  "When the input is a directory, scan for files in it recursively.");
 
+    app.add_option_function<unsigned>(
+        "--jobs", [](unsigned num_jobs) { SetNumParallelJobs(num_jobs); },
+        "The number of files to process at the same time. The default is 1. Use 0 to use all of the CPU's threads. The messages that are printed are the same and in the same order regardless of the number of jobs. Commands that need to consider all of the files together, such as rename or norm (without --independently), process the files one after another regardless of this option. Large FLAC files are also encoded using this number of threads.");
+
+    std::map<std::string, SamplePrecision> precision_name_dictionary;
+    for (const auto &e : magic_enum::enum_entries<SamplePrecision>()) {
+        precision_name_dictionary[std::string(e.second)] = e.first;
+    }
+    app.add_option_function<SamplePrecision>(
+           "--processing-precision", [](SamplePrecision precision) { SetSampleStoragePrecision(precision); },
+           "The precision that the audio of each file is stored at in memory while it is waiting to be processed by the next command or to be written. The commands themselves always process audio in 64-bit floating point. F64, the default, stores it in 64-bit floating point too. F32 uses half the memory, with 24 bits of precision. Native stores it at the bit depth of the file, which uses a quarter of the memory for 16-bit files. Native never changes the audio: audio that is no longer exactly at its bit depth, such as after a gain change, is stored as F32 instead, or in 64-bit floating point if F32 cannot hold it exactly. This is useful when processing a very large number of files with commands that need all of the files together, such as norm.")
+        ->transform(CLI::CheckedTransformer(precision_name_dictionary, CLI::ignore_case));
+
+    app.add_flag(
+        "--streaming", m_streaming,
+        "Process the files one at a time rather than all together. Each file is loaded, has every command applied to it, and is written before the next file is loaded. This keeps the memory usage low no matter how many files there are. Only commands that process each file independently of the others can be used in this mode, such as gain, fade, trim, pan, highpass, lowpass, tune and convert. If an error occurs part way through, the files that were processed before it will have already been saved; use the undo command to restore them.");
+
+    app.add_option(
+        "--incremental", m_incremental_manifest_path,
+        "Only process the files that have changed since the last time that the same commands were run on them. This option takes 1 argument - the path of a manifest file, where Signet records each file that it processes along with the commands and the file that was written. Files that were processed with the same commands and options by the same version of Signet, and that have not changed since, are skipped without being read, as long as the files that were written for them have not changed either. This makes it quick to re-run the same command over a large folder in which only a few files have changed. Only commands that process each file independently of the others can be used in this mode, the same as with --streaming.");
+
     auto input_files_option = app.add_option_function<std::vector<std::string>>(
         "input-files",
         [&](const std::vector<std::string> &input) {
@@ -256,10 +477,23 @@ int SignetInterface::Main(const int argc, const char *const argv[]) {
                 return {};
             });
 
+    std::map<const CLI::App *, Command *> command_apps;
     for (auto &command : m_commands) {
         auto s = command->CreateCommandCLI(app);
+        command_apps[s] = command.get();
         s->needs(input_files_option);
         s->final_callback([&] {
+            if (m_streaming) {
+                if (!command->ProcessesFilesIndependently()) {
+                    throw CLI::ValidationError(
+                        command->GetName(),
+                        "This command cannot be used with --streaming because it needs to consider all of the files together");
+                }
+                // The commands are run after parsing has finished, one file at a time.
+                m_streamed_commands.push_back(command.get());
+                return;
+            }
+
             struct FileEditState {
                 int num_audio_edits, num_path_edits;
             };
@@ -272,6 +506,9 @@ int SignetInterface::Main(const int argc, const char *const argv[]) {
             MessageWithNewLine(command->GetName(), {}, "Starting processing");
             command->ProcessFiles(m_input_audio_files);
             command->GenerateFiles(m_input_audio_files, m_backup);
+            for (auto &f : m_input_audio_files) {
+                f.PackAudio();
+            }
 
             int num_audio_edits = 0;
             int num_path_edits = 0;
@@ -292,14 +529,33 @@ int SignetInterface::Main(const int argc, const char *const argv[]) {
         }
     }
 
-    const auto PrintSuccess = []() {
-        fmt::print(fmt::fg(fmt::terminal_color::green), "Signet completed successfully.\n");
+    // This is run once everything has been parsed, but before any of the commands are run.
+    app.parse_complete_callback([&]() {
+        if (m_incremental_manifest_path) SkipFilesThatAreUpToDate(app, command_apps);
+    });
+
+    const auto PrintSuccess = []() { Log({LogLevel::Success, {}, {}, "Signet completed successfully."}); };
+
+    const auto PrintProcessingStopped = [&](const std::exception &e) {
+        if (m_num_streamed_files_written) {
+            Log({LogLevel::Failure, {}, {},
+                 fmt::format(
+                     "{}. Processing has stopped. {} files had already been saved; run 'signet undo' to restore them.",
+                     e.what(), m_num_streamed_files_written)});
+        } else {
+            Log({LogLevel::Failure, {}, {},
+                 fmt::format("{}. Processing has stopped. No files have been changed or saved.", e.what())});
+        }
     };
 
     try {
         app.parse(argc, argv);
 
-        if (m_input_audio_files.GetNumFilesProcessed()) {
+        if (m_streaming) {
+            if (!ProcessAndWriteFilesOneAtATime()) {
+                return SignetResult::FailedToWriteFiles;
+            }
+        } else if (m_input_audio_files.GetNumFilesProcessed()) {
             if (m_output_path) {
                 for (auto &f : m_input_audio_files) {
                     auto new_path = *m_output_path / f.GetPath().filename();
@@ -314,17 +570,31 @@ int SignetInterface::Main(const int argc, const char *const argv[]) {
                     m_backup, m_output_path || m_single_output_file ? true : false)) {
                 return SignetResult::FailedToWriteFiles;
             }
+            if (m_incremental_manifest) {
+                for (auto &f : m_input_audio_files) {
+                    m_incremental_manifest->FileWasProcessed(f.OriginalPath(), AudioFiles::GetWrittenPath(f));
+                }
+            }
         }
 
-        if (m_input_audio_files.Size() == 0) {
+        // Commands such as detect-pitch analyse the files without changing them, so this is done even if no
+        // files were written.
+        if (GetAnalysisIndex()) GetAnalysisIndex()->Save();
+        if (m_incremental_manifest && !m_incremental_manifest->Save()) {
+            return SignetResult::FailedToWriteFiles;
+        }
+
+        // Files that are skipped by --incremental count as success, even if there was nothing else to do.
+        if (m_input_audio_files.Size() == 0 && !m_num_files_up_to_date) {
             return SignetResult::NoFilesMatchingInput;
-        } else if (m_input_audio_files.GetNumFilesProcessed() == 0) {
+        } else if (m_input_audio_files.GetNumFilesProcessed() == 0 && !m_num_files_up_to_date) {
             return SignetResult::NoFilesWereProcessed;
         }
 
         PrintSuccess();
         return SignetResult::Success;
     } catch (const CLI::ParseError &e) {
+        FlushLog();
         if (!success_thrown) PrintSignetHeading();
         if (e.get_exit_code() != 0) {
             std::stringstream out;
@@ -342,12 +612,10 @@ int SignetInterface::Main(const int argc, const char *const argv[]) {
             return SignetResult::Success;
         }
     } catch (const SignetError &e) {
-        fmt::print(fg(fmt::color::red) | fmt::emphasis::bold,
-                   "{}. Processing has stopped. No files have been changed or saved.\n", e.what());
+        PrintProcessingStopped(e);
         return SignetResult::FatalErrorOcurred;
     } catch (const SignetWarning &e) {
-        fmt::print(fg(fmt::color::red) | fmt::emphasis::bold,
-                   "{}. Processing has stopped. No files have been changed or saved.\n", e.what());
+        PrintProcessingStopped(e);
         return SignetResult::WarningsAreErrors;
     }
 }
@@ -399,6 +667,11 @@ TEST_CASE("[SignetInterface]") {
             REQUIRE(signet.Main(args.Size(), args.Args()) == 0);
         }
 
+        SUBCASE("multiple jobs") {
+            const auto args = TestHelpers::StringToArgs {"signet --jobs 4 test-folder/*.wav fade in 50smp"};
+            REQUIRE(signet.Main(args.Size(), args.Args()) == 0);
+        }
+
         SUBCASE("multiple comma separated files") {
             const auto args =
                 TestHelpers::StringToArgs {"signet test-folder/test.wav test-folder/tf1.wav norm -3"};
@@ -583,4 +856,210 @@ TEST_CASE("[SignetInterface]") {
             }
         }
     }
+
+    SUBCASE("processing precision") {
+        const auto ProcessWithPrecision = [&](std::string precision) {
+            const auto args = TestHelpers::StringToArgs {fmt::format(
+                "signet --processing-precision {} --output-folder test-folder/{} test-folder/tf*.wav gain 50% trim start 50% norm -3",
+                precision, precision)};
+            REQUIRE(signet.Main(args.Size(), args.Args()) == 0);
+        };
+        ProcessWithPrecision("f64");
+        ProcessWithPrecision("f32");
+        ProcessWithPrecision("native");
+
+        for (const auto filename : {"tf1.wav", "tf2.wav"}) {
+            const auto expected = ReadAudioFile(fs::path("test-folder/f64") / filename);
+            REQUIRE(expected);
+
+            // Any differences come from rounding to f32 in between the commands, which is much smaller than
+            // the quantisation of a 16-bit file.
+            const auto f32_result = ReadAudioFile("test-folder/f32" / fs::path(filename));
+            REQUIRE(f32_result);
+            REQUIRE(f32_result->interleaved_samples.size() == expected->interleaved_samples.size());
+            for (usize i = 0; i < f32_result->interleaved_samples.size(); ++i) {
+                REQUIRE(std::abs(f32_result->interleaved_samples[i] - expected->interleaved_samples[i]) <=
+                        1.0 / 32768.0);
+            }
+
+            // Native never changes the audio.
+            const auto native_result = ReadAudioFile("test-folder/native" / fs::path(filename));
+            REQUIRE(native_result);
+            REQUIRE(native_result->interleaved_samples == expected->interleaved_samples);
+        }
+
+        // Rounding a quiet 16-bit file to its bit depth after the gain would be heard once it is normalised.
+        const auto white_noise = ReadAudioFile(in_file);
+        REQUIRE(white_noise);
+        REQUIRE(WriteAudioFile("test-folder/16bit.wav", *white_noise, 16));
+        for (const auto precision : {"f64", "native"}) {
+            const auto args = TestHelpers::StringToArgs {fmt::format(
+                "signet --processing-precision {} --output-folder test-folder/{} test-folder/16bit.wav gain -40db norm 0",
+                precision, precision)};
+            REQUIRE(signet.Main(args.Size(), args.Args()) == 0);
+        }
+        const auto expected_16_bit = ReadAudioFile("test-folder/f64/16bit.wav");
+        const auto native_16_bit = ReadAudioFile("test-folder/native/16bit.wav");
+        REQUIRE(expected_16_bit);
+        REQUIRE(native_16_bit);
+        REQUIRE(native_16_bit->interleaved_samples == expected_16_bit->interleaved_samples);
+    }
+
+    SUBCASE("processing precision with dither") {
+        // The dither must be added to the samples at their full precision, not after they have already been
+        // rounded to the new bit depth, so native precision gives the same result as f64.
+        for (const auto precision : {"f64", "native"}) {
+            const auto args = TestHelpers::StringToArgs {fmt::format(
+                "signet --processing-precision {} --output-folder test-folder/{} test-folder/tf1.wav convert bit-depth 16 --dither tpdf",
+                precision, precision)};
+            REQUIRE(signet.Main(args.Size(), args.Args()) == 0);
+        }
+
+        const auto expected = ReadAudioFile("test-folder/f64/tf1.wav");
+        const auto result = ReadAudioFile("test-folder/native/tf1.wav");
+        REQUIRE(expected);
+        REQUIRE(result);
+        REQUIRE(result->bits_per_sample == 16);
+        REQUIRE(result->interleaved_samples == expected->interleaved_samples);
+    }
+
+    SUBCASE("streaming") {
+        const auto starting_size = ReadAudioFile("test-folder/tf1.wav")->interleaved_samples.size();
+
+        SUBCASE("independent commands are applied to every file") {
+            const auto args =
+                TestHelpers::StringToArgs {"signet --streaming test-folder/tf*.wav gain 50% trim start 50%"};
+            REQUIRE(signet.Main(args.Size(), args.Args()) == 0);
+
+            for (const auto path : {"test-folder/tf1.wav", "test-folder/tf2.wav"}) {
+                const auto f = ReadAudioFile(path);
+                REQUIRE(f);
+                REQUIRE(f->interleaved_samples.size() < starting_size);
+            }
+        }
+
+        SUBCASE("commands that need all of the files are not allowed") {
+            const auto args = TestHelpers::StringToArgs {"signet --streaming test-folder/tf*.wav norm -3"};
+            REQUIRE(signet.Main(args.Size(), args.Args()) != 0);
+        }
+
+        SUBCASE("streaming with multiple jobs") {
+            const auto args =
+                TestHelpers::StringToArgs {"signet --jobs 2 --streaming test-folder/tf*.wav trim start 50%"};
+            REQUIRE(signet.Main(args.Size(), args.Args()) == 0);
+
+            for (const auto path : {"test-folder/tf1.wav", "test-folder/tf2.wav"}) {
+                const auto f = ReadAudioFile(path);
+                REQUIRE(f);
+                REQUIRE(f->interleaved_samples.size() < starting_size);
+            }
+        }
+
+        SUBCASE("undo of streamed changes") {
+            auto args = TestHelpers::StringToArgs {"signet --streaming test-folder/tf1.wav trim start 50%"};
+            REQUIRE(signet.Main(args.Size(), args.Args()) == 0);
+
+            args = TestHelpers::StringToArgs {"signet undo"};
+            REQUIRE(signet.Main(args.Size(), args.Args()) == 0);
+
+            const auto f = ReadAudioFile("test-folder/tf1.wav");
+            REQUIRE(f);
+            REQUIRE(f->interleaved_samples.size() == starting_size);
+        }
+    }
+
+    SUBCASE("incremental") {
+        const fs::path manifest = "test-folder/incremental-manifest.json";
+        std::error_code ec;
+        fs::remove(manifest, ec);
+        fs::remove_all("test-folder/incremental-output", ec);
+        const auto Run = [&](std::string command) {
+            const auto args = TestHelpers::StringToArgs {
+                "signet --incremental test-folder/incremental-manifest.json test-folder/tf*.wav "
+                "--output-folder test-folder/incremental-output " +
+                command};
+            return signet.Main(args.Size(), args.Args());
+        };
+        const auto Peak = [](const char *path) {
+            const auto audio = ReadAudioFile(path);
+            REQUIRE(audio);
+            return GetPeakMagnitude(audio->interleaved_samples);
+        };
+
+        REQUIRE(Run("gain 50%") == 0);
+        const auto tf1_peak = Peak("test-folder/incremental-output/tf1.wav");
+        const auto tf2_peak = Peak("test-folder/incremental-output/tf2.wav");
+
+        SUBCASE("files that have not changed are skipped") {
+            // A file that is written again gets a new modification time.
+            const fs::path output = "test-folder/incremental-output/tf1.wav";
+            const auto old_time = fs::last_write_time(output) - std::chrono::hours(1);
+            fs::last_write_time(output, old_time);
+            REQUIRE(Run("gain 50%") == 0);
+            CHECK(fs::last_write_time(output) == old_time);
+        }
+
+        SUBCASE("a changed input is processed again") {
+            REQUIRE(fs::copy_file(TEST_DATA_DIRECTORY "/test.wav", "test-folder/tf1.wav",
+                                  fs::copy_options::overwrite_existing));
+            REQUIRE(Run("gain 50%") == 0);
+            CHECK(Peak("test-folder/incremental-output/tf1.wav") != tf1_peak);
+            CHECK(Peak("test-folder/incremental-output/tf2.wav") == tf2_peak);
+        }
+
+        SUBCASE("different options process every file again") {
+            REQUIRE(Run("gain 25%") == 0);
+            CHECK(Peak("test-folder/incremental-output/tf1.wav") < tf1_peak);
+            CHECK(Peak("test-folder/incremental-output/tf2.wav") < tf2_peak);
+        }
+
+        SUBCASE("commands that need all of the files are not allowed") { CHECK(Run("norm -3") != 0); }
+    }
+}
+
+TEST_CASE("Analyses are kept between streamed commands") {
+    struct HalveCommand : public Command {
+        CLI::App *CreateCommandCLI(CLI::App &) override { return nullptr; }
+        std::string GetName() const override { return "Halve"; }
+        bool ProcessesFilesIndependently() const override { return true; }
+        void ProcessFile(EditTrackedAudioFile &f) override { f.GetWritableAudio().MultiplyByScalar(0.5); }
+    };
+    struct RecordPitchCommand : public Command {
+        RecordPitchCommand(std::vector<std::optional<double>> &pitches) : pitches(pitches) {}
+        CLI::App *CreateCommandCLI(CLI::App &) override { return nullptr; }
+        std::string GetName() const override { return "RecordPitch"; }
+        bool ProcessesFilesIndependently() const override { return true; }
+        void ProcessFile(EditTrackedAudioFile &f) override {
+            pitches.push_back(f.GetDetectedPitch());
+
+            // If the analysis were not kept, the next command would look it up in the index and get this.
+            AudioAnalysis analysis {};
+            analysis.detected_pitch = 1000.0;
+            GetAnalysisIndex()->Update(HashAudioContent(f.GetAudio()), analysis);
+        }
+        std::vector<std::optional<double>> &pitches;
+    };
+
+    AnalysisIndex index {"streamed-commands-analysis-index-test"};
+    SetAnalysisIndex(&index);
+
+    std::vector<std::optional<double>> pitches;
+    HalveCommand halve;
+    RecordPitchCommand record_pitch {pitches};
+    const std::vector<Command *> commands {&halve, &record_pitch, &record_pitch};
+    std::vector<std::atomic<int>> num_audio_edits(commands.size());
+
+    EditTrackedAudioFile f("file.wav");
+    f.SetAudioData(TestHelpers::CreateSineWaveAtFrequency(1, 44100, 1, 220));
+    ProcessFileWithStreamedCommands(f, commands, num_audio_edits);
+
+    REQUIRE(pitches.size() == 2);
+    REQUIRE(pitches[0]);
+    CHECK(*pitches[0] == doctest::Approx(220).epsilon(0.01));
+    CHECK(pitches[1] == pitches[0]);
+    CHECK(num_audio_edits[0] == 1);
+    CHECK(num_audio_edits[1] == 0);
+
+    SetAnalysisIndex(nullptr);
+    index.Delete();
 }
@@ -1,16 +1,19 @@
 #pragma once
 
+#include <map>
 #include <memory>
 
 #include "doctest.hpp"
 #include "json.hpp"
 
+#include "analysis_index.h"
 #include "audio_file_io.h"
 #include "audio_files.h"
 #include "backup.h"
 #include "command.h"
 #include "common.h"
 #include "filesystem.hpp"
+#include "incremental_manifest.h"
 
 namespace SignetResult {
 enum SignetResultEnum {
@@ -30,12 +33,24 @@ class SignetInterface final {
     int Main(const int argc, const char *const argv[]);
 
   private:
+    bool ProcessAndWriteFilesOneAtATime();
+    void SkipFilesThatAreUpToDate(const CLI::App &app, const std::map<const CLI::App *, Command *> &commands);
+
     std::vector<std::unique_ptr<Command>> m_commands {};
     SignetBackup m_backup {};
+    std::optional<AnalysisIndex> m_analysis_index {};
 
     AudioFiles m_input_audio_files {};
     bool m_recursive_directory_search {};
     fs::path m_make_docs_filepath {};
     std::optional<fs::path> m_output_path {};
     std::optional<fs::path> m_single_output_file {};
+
+    bool m_streaming {};
+    std::vector<Command *> m_streamed_commands {};
+    usize m_num_streamed_files_written {};
+
+    std::optional<fs::path> m_incremental_manifest_path {};
+    std::optional<IncrementalManifest> m_incremental_manifest {};
+    usize m_num_files_up_to_date {};
 };
@@ -0,0 +1,3 @@
+#pragma once
+#define TEST_DATA_DIRECTORY "/root/repo/test_data"
+#define BUILD_DIRECTORY "/root/repo/build"